@@ -92,6 +92,8 @@ struct MemoryEditor
     ImU8            (*ReadFn)(const ImU8* data, size_t off);    // = 0      // optional handler to read bytes.
     void            (*WriteFn)(ImU8* data, size_t off, ImU8 d); // = 0      // optional handler to write bytes.
     bool            (*HighlightFn)(const ImU8* data, size_t off);//= 0      // optional handler to return Highlight property (to support non-contiguous highlighting).
+    ImU32           (*HighlightColorFn)(const ImU8* data, size_t off);//= 0 // optional handler to return the background color of a byte HighlightFn highlights.
+    const char*     (*LabelFn)(const ImU8* data, size_t off);   // = 0      // optional handler to name a byte, shown as a tooltip while hovered.
 
     // [Internal State]
     bool            ContentsWidthChanged;
@@ -126,6 +128,8 @@ struct MemoryEditor
         ReadFn = NULL;
         WriteFn = NULL;
         HighlightFn = NULL;
+        HighlightColorFn = NULL;
+        LabelFn = NULL;
 
         // State/Internals
         ContentsWidthChanged = false;
@@ -315,7 +319,8 @@ struct MemoryEditor
                             if (OptMidColsCount > 0 && n > 0 && (n + 1) < Cols && ((n + 1) % OptMidColsCount) == 0)
                                 highlight_width += s.SpacingBetweenMidCols;
                         }
-                        draw_list->AddRectFilled(pos, ImVec2(pos.x + highlight_width, pos.y + s.LineHeight), HighlightColor);
+                        ImU32 color = (is_highlight_from_user_func && HighlightColorFn) ? HighlightColorFn(mem_data, addr) : HighlightColor;
+                        draw_list->AddRectFilled(pos, ImVec2(pos.x + highlight_width, pos.y + s.LineHeight), color);
                     }
 
                     if (is_highlight_from_pc)
@@ -423,6 +428,12 @@ struct MemoryEditor
                             DataEditingTakeFocus = true;
                             data_editing_addr_next = addr;
                         }
+                        if (LabelFn && ImGui::IsItemHovered())
+                        {
+                            const char* label = LabelFn(mem_data, addr);
+                            if (label && label[0])
+                                ImGui::SetTooltip("%s", label);
+                        }
                     }
                 }
 
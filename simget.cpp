@@ -9,15 +9,18 @@
 
 #include "framebuffer.h"
 
-// comes from the imgui_club repo
-#include "imgui_memory_editor.h"
-
 #include <iostream>
 #include <string>
 #include <vector>
 #include <signal.h>
+#include <stdlib.h>
 
 #include "simgetavr.h"
+#include "simgetpov.h"
+#include "simgetsched.h"
+#include "simgetui.h"
+#include "simgetsweep.h"
+#include "simgetwave.h"
 
 extern "C"
 {
@@ -38,7 +41,7 @@ extern "C"
 #define BIT_TEST(port, bit) ((port) & (1 << (bit)))
 
 int setupAVRDisasm();
-void Disasm(char *Bitstream, int Pos, int Read);
+int Benchmark_Opcode_Decode();
 
 void sig_int(int sign)
 {
@@ -48,6 +51,13 @@ void sig_int(int sign)
     exit(0);
 }
 
+static volatile sig_atomic_t headless_stop = 0;
+
+void sig_int_headless(int sign)
+{
+    headless_stop = 1;
+}
+
 int m_width, m_height;
 
 FrameBuffer *sceneBuffer;
@@ -58,331 +68,233 @@ void list_cores()
 {
 }
 
-void ShowAvrDetailsFull(AvrSimulator &avrSim)
+// one line of JSON so farm scripts can parse the result
+void PrintRunSummary(const AvrSimulator &avrSim, const std::string &firmware_file, const RunStats &stats)
 {
-    avr_t *avr = avrSim.avr;
-
-    if (!avr)
-        return;
-
-    // Start a new ImGui window
-    if (ImGui::Begin("AVR Details Full"))
-    { // Only proceed if the window is open
-        ImGui::Text("IO End: %u", avr->ioend);
-        ImGui::Text("RAM End: %u", avr->ramend);
-        ImGui::Text("Flash End: %u", avr->flashend);
-        ImGui::Text("E2 End: %u", avr->e2end);
-        ImGui::Text("Vector Size: %u", avr->vector_size);
-
-        ImGui::Text("Fuse:");
-        for (int i = 0; i < 6; ++i)
-            ImGui::Text("\t[%d]: 0x%X", i, avr->fuse[i]);
-
-        ImGui::Text("Lockbits: 0x%X", avr->lockbits);
-
-        ImGui::Text("Signature:");
-        ImGui::Text("\t0x%X%X%X", avr->signature[0], avr->signature[1], avr->signature[2]);
-
-        ImGui::Text("Serial:");
-        for (int i = 0; i < 9; ++i)
-            ImGui::Text("\t[%d]: 0x%X", i, avr->serial[i]);
-
-        ImGui::Text("RAMPZ: %u", avr->rampz);
-        ImGui::Text("EIND: %u", avr->eind);
-        ImGui::Text("Address Size: %u", avr->address_size);
-
-        ImGui::Text("Reset Flags:");
-        ImGui::Text("\tPORF: %u", avr->reset_flags.porf.bit);
-        ImGui::Text("\tEXTRF: %u", avr->reset_flags.extrf.bit);
-        ImGui::Text("\tBORF: %u", avr->reset_flags.borf.bit);
-        ImGui::Text("\tWDRF: %u", avr->reset_flags.wdrf.bit);
-
-        ImGui::Text("Code End: %u", avr->codeend);
-        ImGui::Text("Run Cycle Count: %lu", avr->run_cycle_count);
-        ImGui::Text("Run Cycle Limit: %lu", avr->run_cycle_limit);
-        ImGui::Text("Sleep Usec: %u", avr->sleep_usec);
-        ImGui::Text("Time Base: %lu", avr->time_base);
-
-        // Custom init/deinit functions and data are not displayed as they are function pointers and context data
-
-        // Skipping run and sleep function pointers for the same reason
-
-        // Skipping irq_pool, sreg, interrupt_state, pc, reset_pc, io, io_shared_io, flash, data, io_port, commands, cycle_timers, interrupts, trace, log, trace_data, vcd, gdb, gdb_port, io_console_buffer, data_names as these are complex types or pointers
-
-        ImGui::End();
-    }
+    printf("{\"firmware\":\"%s\",\"mcu\":\"%s\",\"frequency\":%u,\"cycles\":%llu,\"instructions\":%llu,"
+           "\"sim_usec\":%.3f,\"wall_seconds\":%.6f,\"effective_mhz\":%.3f,\"state\":\"%s\",\"stop_reason\":\"%s\"}\n",
+           firmware_file.c_str(), avrSim.avr->mmcu, avrSim.avr->frequency,
+           (unsigned long long)stats.cycles, (unsigned long long)stats.instructions,
+           avrSim.avr->frequency ? stats.cycles * 1000000.0 / avrSim.avr->frequency : 0.0,
+           stats.wallSeconds, stats.mhz, GetAvrStateName(stats.state), stats.reason);
+    fflush(stdout);
 }
 
-void HexEditor(AvrSimulator &avrSim, bool run)
+// hooks the port pins plus any --add-trace registers and starts the writer thread
+// --add-trace specs become data watches, shown live and written by --output
+bool AddWatchSignals(AvrSimulator &avrSim, const std::vector<std::string> &traces)
 {
-    static MemoryEditor mem_edit_1;
-
-    avr_t *avr = avrSim.avr;
-
-    if (!avr)
-        return;
-
-    static size_t start;
-
-    // only chase if not pc changed
+    for (const std::string &spec : traces)
     {
-
-        if (start != avr->pc)
-        {
-
-            size_t end = avr->pc + 1;
-            start = avr->pc;
-
-            mem_edit_1.HighlightPC(start, end);
-        }
+        if (!avrSim.watch.AddSignal(spec))
+            return false;
     }
-
-    mem_edit_1.DrawWindow("Memory Editor FLASH", avr->flash, avr->flashend);
+    return true;
 }
 
-void HexEditorRAM(AvrSimulator &avrSim)
+// --watch specs, after Initialize so data symbols resolve
+bool AddWatchpoints(AvrSimulator &avrSim, const std::vector<std::string> &watches)
 {
-
-    avr_t *avr = avrSim.avr;
-
-    static MemoryEditor mem_edit_1;
-    mem_edit_1.DrawWindow("Memory Editor RAM", avr->data, avr->ramend);
+    for (const std::string &spec : watches)
+    {
+        if (!avrSim.watch.AddWatchpoint(spec, avrSim.symbols))
+            return false;
+    }
+    return true;
 }
 
-void displayIO(AvrSimulator &avrSim, const std::string &io_type, uint8_t addr, char *cname)
+// --break and --tracepoint specs, after Initialize so functions and data symbols resolve
+bool AddBreakpoints(AvrSimulator &avrSim, const std::vector<std::string> &breaks, bool tracepoint)
 {
-    avr_t *avr = avrSim.avr;
-
-    // display register name, address, and current value
-    ImGui::Text("%s%s (0x%02X) 0x%02X", io_type.c_str(), cname, addr, avrSim.avr->data[addr]);
-    // ImGui::SameLine();
-
-    // calculate spacing based on window width
-    float windowWidth = ImGui::GetWindowWidth();
-    float spacing = windowWidth / 9; // 8 bits + label
-
-    // display the bit numbers
-    ImGui::SetCursorPosX(spacing); // Initial spacing for alignment
-    for (int i = 7; i >= 0; --i)
+    for (const std::string &spec : breaks)
     {
-        ImGui::Text("%d", i);
-        if (i > 0)
+        Breakpoint bp;
+        std::string error;
+        if (!avrSim.breakpoints.Parse(spec, tracepoint, avrSim.symbols, bp, error))
         {
-            ImGui::SameLine();
-            ImGui::SetCursorPosX((spacing * (8 - i + 1)));
+            std::cerr << (tracepoint ? "--tracepoint" : "--break") << " '" << spec << "': " << error << std::endl;
+            return false;
         }
+        avrSim.breakpoints.Set(std::move(bp));
     }
+    return true;
+}
 
-    // put text in box
-    ImGui::SameLine();
-
-    std::string name;
+// headless tracepoints go straight to stderr
+void PrintTracepoints(AvrSimulator &avrSim)
+{
+    avrSim.breakpoints.onLog = [&avrSim](const Breakpoint &bp, const TracepointHit &hit) {
+        char function[96];
+        avrSim.symbols.Format(SYMBOL_FLASH, hit.addr, function, sizeof(function));
+        fprintf(stderr, "trace: cycle %llu pc 0x%04x %s", (unsigned long long)hit.cycle, hit.addr, function);
+        if (!bp.log.Empty())
+            fprintf(stderr, " %s = %d (0x%x)", bp.log.Source().c_str(), hit.value, (unsigned)hit.value);
+        fprintf(stderr, "\n");
+    };
+}
 
-    // display the checkboxes for each bit
-    for (int i = 7; i >= 0; --i)
+// the hits of the instruction a headless run stopped on
+void PrintWatchHits(const AvrSimulator &avrSim)
+{
+    const std::deque<WatchHit> &hits = avrSim.watch.hits;
+    for (auto it = hits.rbegin(); it != hits.rend() && it->cycle == hits.back().cycle; ++it)
     {
-        ImGui::SetCursorPosX((spacing * (8 - i))); // adjust for checkbox size
-        bool bitSet = avrSim.avr->data[addr] & (1 << i);
-        name = std::string("##") + io_type + cname + std::to_string(i);
+        char data[96], code[96];
+        avrSim.symbols.Format(SYMBOL_DATA, it->addr, data, sizeof(data));
+        avrSim.symbols.Format(SYMBOL_FLASH, it->pc, code, sizeof(code));
 
-        if (ImGui::Checkbox(name.c_str(), &bitSet))
-        {
-            if (io_type == "PIN")
-            {
-
-                avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(cname[0]), i);
-
-                if (irq)
-                {
-                    if (bitSet)
-                    {
-
-                        avr_raise_irq(irq, 1); // Simulate a high state on the pin
-                    }
-                    else
-                    {
-
-                        avr_raise_irq(irq, 0); // Simulate a low state on the pin
-                    }
-                }
-            }
-            else
-            {
-                // toggle the bit if the checkbox is clicked
-                if (bitSet)
-                {
-                    avrSim.avr->data[addr] |= (1 << i);
-                }
-                else
-                {
-                    avrSim.avr->data[addr] &= ~(1 << i);
-                }
-            }
-        }
-        if (i > 0)
-        {
-            ImGui::SameLine();
-        }
+        const char *kind = it->flags & WATCH_VALUE ? "value" : it->flags & WATCH_WRITE ? "write" : "read";
+        fprintf(stderr, "watch: %s 0x%04x %s 0x%02x -> 0x%02x, pc 0x%04x %s, cycle %llu\n", kind, it->addr, data,
+                it->before, it->after, it->pc, code, (unsigned long long)it->cycle);
     }
 }
 
-void ModifyAvrIoRegister(AvrSimulator &avrSim, avr_ioport_t *port)
+// hooks the port pins plus the --add-trace signals and starts the writer thread
+bool StartWaveOutput(WaveWriter &wave, AvrSimulator &avrSim, const std::string &path, const std::string &format)
 {
-    if (!port)
-        return;
+    if (format != "vcd" && format != "compact")
+    {
+        std::cerr << "--output-format must be vcd or compact" << std::endl;
+        return false;
+    }
+
+    wave.AddPortPins(avrSim.avr);
 
-    char cname[2] = {
-        0,
-        0,
+    // watch signal i is wave signal base + i
+    const auto &signals = avrSim.watch.Signals();
+    uint32_t base = 0;
+    for (size_t i = 0; i < signals.size(); i++)
+    {
+        uint32_t id = wave.AddSignal(signals[i].name, signals[i].width, signals[i].last);
+        if (i == 0)
+            base = id;
+    }
+    avrSim.watch.onChange = [&wave, base](int index, const WatchSignal &signal, avr_cycle_count_t cycle) {
+        wave.Record(cycle, base + index, signal.last);
     };
-    cname[0] = port->name;
 
-    displayIO(avrSim, "PORT", port->r_port, cname);
-    displayIO(avrSim, "DDR", port->r_ddr, cname);
-    displayIO(avrSim, "PIN", port->r_pin, cname);
+    return wave.Start(path, format == "compact" ? WAVE_COMPACT : WAVE_VCD, avrSim.avr->frequency);
 }
 
-void ModifyAvrIoRegisters(AvrSimulator &avrSim)
+void StopWaveOutput(WaveWriter &wave, AvrSimulator &avrSim, const std::string &path)
 {
-    avr_t *avr = avrSim.avr;
-
-    if (!avr)
+    if (!wave.Active())
         return;
 
-    // recast to mcu type
-    mcu_attiny4313_t *mcu = (mcu_attiny4313_t *)avr;
-
-    ImGui::Begin("AVR IO Register Control");
-
-    ModifyAvrIoRegister(avrSim, &mcu->porta);
-    ModifyAvrIoRegister(avrSim, &mcu->portb);
-    ModifyAvrIoRegister(avrSim, &mcu->portd);
-
-    ImGui::End();
+    avrSim.watch.onChange = nullptr;
+    wave.Stop();
+    std::cerr << path << ": " << wave.Recorded() << " events, " << wave.Dropped() << " dropped, "
+              << wave.Stale() << " out of order" << std::endl;
 }
 
-const char *GetAvrStateName(int state)
+bool StartInstructionTrace(InstructionTrace &trace, AvrSimulator &avrSim, const std::string &path,
+                           const std::string &start, const std::string &stop, bool registers)
 {
-    switch (state)
+    if (!start.empty() && !ParseTraceTrigger(start, trace.start))
     {
-    case cpu_Limbo:
-        return "Limbo";
-    case cpu_Stopped:
-        return "Stopped";
-    case cpu_Running:
-        return "Running";
-    case cpu_Sleeping:
-        return "Sleeping";
-    case cpu_Step:
-        return "Step";
-    case cpu_StepDone:
-        return "Step Done";
-    case cpu_Done:
-        return "Done";
-    case cpu_Crashed:
-        return "Crashed";
-    default:
-        return "Unknown";
+        std::cerr << "bad --trace-start '" << start << "'" << std::endl;
+        return false;
     }
+    if (!stop.empty() && !ParseTraceTrigger(stop, trace.stop))
+    {
+        std::cerr << "bad --trace-stop '" << stop << "'" << std::endl;
+        return false;
+    }
+
+    if (!trace.Open(path, avrSim.avr, registers, &avrSim.symbols))
+        return false;
+
+    avrSim.trace = &trace;
+    return true;
 }
 
-void ShowAvrState(const int state)
+void StopInstructionTrace(InstructionTrace &trace, AvrSimulator &avrSim, const std::string &path)
 {
+    if (!avrSim.trace)
+        return;
 
-    ImGui::Text("State: %s", GetAvrStateName(state));
+    avrSim.trace = nullptr;
+    trace.Close();
+    std::cerr << path << ": " << trace.Records() << " instructions in " << trace.Frames() << " frames, "
+              << trace.RawBytes() << " -> " << trace.FileBytes() << " bytes, " << trace.Dropped() << " dropped"
+              << std::endl;
 }
 
-void DumpAvrRegisters(AvrSimulator &avrSim)
+void StartProfile(AvrSimulator &avrSim, uint32_t sampleEvery)
 {
+    avrSim.profile.Start(avrSim.avr, sampleEvery);
+    if (sampleEvery)
+        std::cerr << "profiling, pc sampled every " << sampleEvery << " cycles" << std::endl;
+}
 
-    avr_t *avr = avrSim.avr;
+// hottest instructions first, with their share of every profiled cycle. the sim thread must be stopped
+void WriteProfileReport(AvrSimulator &avrSim, const std::string &path, size_t top)
+{
+    Profiler &profile = avrSim.profile;
+    const uint32_t every = profile.SampleEvery();
+    profile.Stop(avrSim.avr);
 
-    if (!avr)
+    FILE *out = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (!out)
+    {
+        std::cerr << "failed to open " << path << " for writing" << std::endl;
         return;
+    }
 
-    ImGui::Begin("AVR Register Dump");
+    const uint64_t total = profile.TotalCycles();
+    const std::vector<Hotspot> spots = profile.Hotspots(top);
+    const std::vector<DisasmLine> &lines = avrSim.disasm.Lines();
+    const std::vector<DisasmRow> &rows = avrSim.disasm.Rows();
 
-    for (int i = 0; i < 32; i++)
-    {
-        ImGui::Text("%s=%02x", avr_regname(avr, i), avr->data[i]);
-        if ((i % 8) != 7)
-            ImGui::SameLine();
-    }
+    if (every)
+        fprintf(out, "# %llu cycles, pc sampled every %u cycles\n", (unsigned long long)total, every);
+    else
+        fprintf(out, "# %llu cycles, every instruction counted\n", (unsigned long long)total);
+    fprintf(out, "#  addr  %12s  %14s  %6s  %6s  %-24s  instruction\n", every ? "samples" : "hits", "cycles", "%", "cum%",
+            "function");
 
-    uint16_t y = avr->data[R_YL] | (avr->data[R_YH] << 8);
-    for (int i = 0; i < 20; i++)
+    uint64_t sum = 0;
+    for (const Hotspot &spot : spots)
     {
-        if( y + i < 352 )   {
-            ImGui::Text("Y+%02d=%02x", i, avr->data[y + i]);
-        }
-        if (i % 10 != 9)
-            ImGui::SameLine();
+        sum += spot.cycles;
+        int row = avrSim.disasm.RowForAddress(spot.addr);
+        const char *text = row >= 0 ? lines[rows[row].line].text.c_str() : "";
+        char function[96];
+        avrSim.symbols.Format(SYMBOL_FLASH, spot.addr, function, sizeof(function));
+
+        fprintf(out, "%06x  %12llu  %14llu  %6.2f  %6.2f  %-24s  %s\n", spot.addr, (unsigned long long)spot.hits,
+                (unsigned long long)spot.cycles, total ? 100.0 * spot.cycles / total : 0.0,
+                total ? 100.0 * sum / total : 0.0, function, text);
     }
 
-    ImGui::End();
-}
-
-bool ShowAvrDisasm(AvrSimulator &avr)
-{
-    if (ImGui::Begin("AVR Disasm Window"))
+    if (out != stdout)
     {
-        Disasm((char *)avr.avr->flash, avr.avr->pc, 4096);
-        ImGui::End();
+        fclose(out);
+        std::cerr << path << ": " << spots.size() << " hotspots, " << total << " cycles" << std::endl;
     }
-    return true;
 }
 
-bool ShowAvrDetails(AvrSimulator &avr)
+// the sim thread must be stopped
+void WriteCallGraph(AvrSimulator &avrSim, const std::string &path, const std::string &firmware)
 {
-    // Start a new ImGui window
-    if (ImGui::Begin("AVR Details Window"))
-    { // Only proceed if the window is open
-
-        ImGui::Text("MCU: %s", avr.avr->mmcu);
-        ImGui::Text("Frequency: %d Hz", avr.avr->frequency);
-        ImGui::Text("Cycle Counter: %lu", avr.avr->cycle);
-
-        ImGui::Text("VCC: %d V", avr.avr->vcc);
-        ImGui::Text("AVCC: %d V", avr.avr->avcc);
-        ImGui::Text("AREF: %d V", avr.avr->aref);
-
-        ImGui::Text("pc:       0x%x", avr.avr->pc);
-        ImGui::Text("reset pc: 0x%x", avr.avr->reset_pc);
-
-        {
-            const char *_sreg_bit_name = "cznvshti";
-            char buffer[32];
-            for (int _sbi = 0; _sbi < 8; _sbi++)
-            {
-                sprintf(buffer, "%c", avr.avr->sreg[_sbi] ? toupper(_sreg_bit_name[_sbi]) : '.');
-            }
-            ImGui::Text("sreg: %s", buffer);
-        }
-
-        ImGui::Checkbox("run", &avr.run);
-        ImGui::Checkbox("animate", &avr.animate);
-
-        if (ImGui::Button("step"))
-        {
-            avr.RunAnimate();
-        }
-
-        if (ImGui::Button("reset"))
-        {
-            avr.Reset();
-        }
-
-        ShowAvrState(avr.state);
-
-        if (avr.state == cpu_Done || avr.state == cpu_Crashed)
-        {
-            ImGui::Text("DONE/CRASHED");
-        };
+    CallGraph &graph = avrSim.callGraph;
+    graph.Stop();
+
+    // vectors and functions without a symbol go by address
+    auto name = [&](uint32_t addr) {
+        char text[96];
+        if (!avrSim.symbols.Format(SYMBOL_FLASH, addr, text, sizeof(text)))
+            snprintf(text, sizeof(text), "0x%04x", addr);
+        return std::string(text);
+    };
 
-        ImGui::End(); // End of AVR Details Window
+    if (!graph.WriteCallgrind(path, firmware, name))
+    {
+        std::cerr << "failed to open " << path << " for writing" << std::endl;
+        return;
     }
-
-    return avr.run;
+    std::cerr << path << ": " << graph.Totals()->nodes.size() << " call contexts, " << graph.Overflows()
+              << " calls past the depth limit" << std::endl;
 }
 
 /**
@@ -427,70 +339,46 @@ class FidgetSpinner
 {
 public:
     FidgetSpinner();
-    void update();
+    void update(const SimSnapshot &snap);
     void draw(ImVec2 center, ImVec2 size);
-    void calculateRPM();
     void sineWaveEffect();
 
-    void setAvr(avr_t *_avr)
+    void setAvr(avr_t *_avr, SimScheduler *_scheduler)
     {
         avr = _avr;
+        scheduler = _scheduler;
     }
 
     avr_t *avr;
+    SimScheduler *scheduler = nullptr;
 
 private:
-    double angle; // Current angle of rotation in radians
+    double angle; // rotor angle in radians at the snapshot's cycle
     std::vector<std::pair<float, float>> ledPositions;
     std::vector<bool> ledStates; // LED states: true for on, false for off
-    std::chrono::steady_clock::time_point lastTDC;
     double rpm;
+    uint64_t turns = 0;
     int waveIndex;
     void calculateLedPositions();
-    void updateLedStates();
+    void updateLedStates(const SimSnapshot &snap);
 };
 
 FidgetSpinner::FidgetSpinner() : angle(0), rpm(0), waveIndex(0)
 {
     ledStates.resize(LED_COUNT, false);
-    lastTDC = std::chrono::steady_clock::now();
     calculateLedPositions();
-    updateLedStates();
 }
 
-void FidgetSpinner::update()
+void FidgetSpinner::update(const SimSnapshot &snap)
 {
-    
-    angle += PI / 100;
-    if (angle >= 2 * PI)
-    {
-        angle -= 2 * PI;
-        calculateRPM();
-
-        {
-            //std::cerr << "trigger\n";
-
-            if(avr) {
-                avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 3);
-
-                if (irq)
-                {
-                    static bool state = 0;
-                    state = 1 - state;
-
-                    if (state)
-                        avr_raise_irq(irq, 1); // Simulate a low state on the pin
-                    else
-                        avr_raise_irq(irq, 0); // Simulate a high state on the pin
-                }
-            }
-        }
-    }
-
-    // std::cout << angle <<std::endl;
+    // the rotor and its TDC sensor run in simulated time on the sim thread, this only
+    // draws where it was at the snapshot's cycle
+    angle = snap.rotorAngle;
+    rpm = snap.rotorRpm;
+    turns = snap.rotorTurns;
 
     calculateLedPositions();
-    updateLedStates();
+    updateLedStates(snap);
 }
 
 void FidgetSpinner::calculateLedPositions()
@@ -504,18 +392,18 @@ void FidgetSpinner::calculateLedPositions()
     }
 }
 
-void FidgetSpinner::updateLedStates()
+void FidgetSpinner::updateLedStates(const SimSnapshot &snap)
 {
 
-    if (!avr) {
+    if (!avr || snap.data.empty()) {
        return;
     }
 
     mcu_attiny4313_t *mcu = (mcu_attiny4313_t *)avr;
 
-#define PORTA avr->data[mcu->porta.r_port]
-#define PORTB avr->data[mcu->portb.r_port]
-#define PORTD avr->data[mcu->portd.r_port]
+#define PORTA snap.data[mcu->porta.r_port]
+#define PORTB snap.data[mcu->portb.r_port]
+#define PORTD snap.data[mcu->portd.r_port]
 
     if (BIT_TEST(PORTD, 0))
         ledStates[0] = true;
@@ -568,17 +456,6 @@ void FidgetSpinner::updateLedStates()
     ;
 }
 
-void FidgetSpinner::calculateRPM()
-{
-    auto now = std::chrono::steady_clock::now();
-    std::chrono::duration<double> timePassed = now - lastTDC;
-    if (timePassed.count() > 0)
-    {
-        rpm = 60 / timePassed.count();
-        lastTDC = now;
-    }
-}
-
 void FidgetSpinner::sineWaveEffect()
 {
     const int sineWaveSize = LED_COUNT * 2;
@@ -608,12 +485,23 @@ void FidgetSpinner::draw(ImVec2 center, ImVec2 size)
         drawCircle(x, y, 4.0f, ledStates[i]);
     }
 
-    ImGui::Text("RPM: %d", static_cast<int>(rpm));
+    ImGui::Text("RPM: %d  turns: %llu", static_cast<int>(rpm), (unsigned long long)turns);
+
+    // absolute slider, the snapshot catching up a frame late doesn't fight the drag
+    float set = (float)rpm;
+    ImGui::SetNextItemWidth(size.x > 0 ? size.x : 200);
+    if (scheduler && ImGui::SliderFloat("##rpm", &set, 0.0f, 6000.0f, "%.0f rpm"))
+    {
+        SimCommand cmd;
+        cmd.type = CMD_SPINNER_RPM;
+        cmd.target = (uint64_t)(std::max(set, 0.0f) * 1000.0);
+        scheduler->Post(cmd);
+    }
 }
 
 FidgetSpinner spinner;
 
-void renderLEDsInImGuiWindow()
+void renderLEDsInImGuiWindow(AvrSimulator &avrSim)
 {
     ImGui::SetNextWindowContentSize(ImVec2(200,200));
     ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0,0));
@@ -629,7 +517,7 @@ void renderLEDsInImGuiWindow()
     center.x += p1.x;
     center.y += p1.y;
 
-    spinner.update();
+    spinner.update(avrSim.snapshot.Front());
     spinner.draw(center, size); // Pass the center and size to the draw method
 
     ImGui::End();
@@ -638,6 +526,59 @@ void renderLEDsInImGuiWindow()
 
 }
 
+PovImage pov;
+
+// the persistence image the worker rebuilds from every led change, uploaded when a new
+// one is published
+void renderPovImage(const SimSnapshot &snap)
+{
+    static GLuint texture = 0;
+    static int textureSize = 0;
+
+    if (pov.frames.Update())
+    {
+        const PovFrame &frame = pov.frames.Front();
+        if (frame.size)
+        {
+            if (!texture)
+                glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            if (textureSize != frame.size)
+            {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame.size, frame.size, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame.rgba.data());
+                textureSize = frame.size;
+            }
+            else
+            {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.size, frame.size, GL_RGBA, GL_UNSIGNED_BYTE, frame.rgba.data());
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+    if (ImGui::Begin("POV image"))
+    {
+        if (texture)
+            ImGui::Image((ImTextureID)(intptr_t)texture, ImVec2((float)textureSize, (float)textureSize));
+        if (snap.rotorRpm <= 0)
+            ImGui::TextDisabled("the spinner is standing still, give it some rpm");
+
+        float persistence = pov.persistence;
+        if (ImGui::SliderFloat("persistence", &persistence, 0.0f, 0.99f, "%.2f a turn"))
+            pov.persistence = persistence;
+        ImGui::SameLine();
+        if (ImGui::Button("clear"))
+            pov.Clear();
+
+        const PovFrame &frame = pov.frames.Front();
+        ImGui::Text("led changes: %llu  dropped: %llu  turns: %.1f", (unsigned long long)pov.Recorded(),
+                    (unsigned long long)pov.Dropped(), frame.turns);
+    }
+    ImGui::End();
+}
+
 void window_size_callback_static(GLFWwindow *window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -659,6 +600,11 @@ int main(int argc, char **argv)
             .implicit_value(true)
             .help("List all supported AVR cores and exit");
 
+        program.add_argument("--bench-disasm")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Benchmark the opcode decoder against the linear matcher and exit");
+
         program.add_argument("--mcu", "-m")
             .default_value(std::string("attiny4313"))
             .help("Sets the MCU type for an .hex firmware");
@@ -673,10 +619,53 @@ int main(int argc, char **argv)
             .implicit_value(1234)
             .help("Listen for gdb connection on <port> (default 1234)");
 
+        program.add_argument("--headless")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Run without a display until a limit is hit or the cpu is done/crashed, then print a JSON summary");
+
+        program.add_argument("--cycles")
+            .scan<'u', uint64_t>()
+            .default_value(static_cast<uint64_t>(0))
+            .help("Headless: stop after this many simulated cycles (0 = no limit)");
+
+        program.add_argument("--sim-usec")
+            .scan<'u', uint64_t>()
+            .default_value(static_cast<uint64_t>(0))
+            .help("Headless: stop after this much simulated time in microseconds (0 = no limit)");
+
+        program.add_argument("--pace")
+            .default_value(std::string("realtime"))
+            .help("Sim thread pacing: max, realtime or a multiplier of the frequency such as 0.5");
+
+        program.add_argument("--checkpoint-every")
+            .scan<'u', uint64_t>()
+            .default_value(static_cast<uint64_t>(250000))
+            .help("Keep a checkpoint of the whole machine every this many cycles (0 = off), bounds the cost of stepping back");
+
+        program.add_argument("--checkpoint-mb")
+            .scan<'u', unsigned>()
+            .default_value(16u)
+            .help("Memory budget of the checkpoint ring in MB");
+
         program.add_argument("--firmware")
-            .required()
+            .default_value(std::string(""))
             .help("Path to the firmware file for simulation (ELF or hex)");
 
+        program.add_argument("--sweep")
+            .default_value(std::string(""))
+            .help("Run every scenario in this file headless in parallel and print one JSON report");
+
+        program.add_argument("--jobs", "-j")
+            .scan<'u', unsigned>()
+            .default_value(0u)
+            .help("Sweep: worker threads (0 = one per core)");
+
+        program.add_argument("--rpm")
+            .scan<'g', double>()
+            .default_value(600.0)
+            .help("Spinner speed, its TDC sensor toggles PD3 once a revolution in simulated time. headless runs only spin with --rpm");
+
         program.add_argument("--input", "-i")
             .default_value("")
             .help("A VCD file to use as input signals");
@@ -685,14 +674,64 @@ int main(int argc, char **argv)
             .default_value("")
             .help("A VCD file to save the traced signals");
 
+        program.add_argument("--output-format")
+            .default_value(std::string("vcd"))
+            .help("--output file format: vcd or compact (varint records, about 4 bytes an event)");
+
         program.add_argument("--trace", "-t")
+            .default_value(std::string(""))
+            .help("Record every executed instruction to this file, read it back with simget-trace");
+
+        program.add_argument("--trace-regs")
             .default_value(false)
             .implicit_value(true)
-            .help("Run full scale decoder trace");
+            .help("--trace also records the registers each instruction changed");
+
+        program.add_argument("--trace-start")
+            .default_value(std::string(""))
+            .help("Start --trace at pc=<byte addr>, cycle=<n> or pin=PD3:1 (default: from the start)");
+
+        program.add_argument("--trace-stop")
+            .default_value(std::string(""))
+            .help("Stop --trace at pc=<byte addr>, cycle=<n> or pin=PD3:1, pc and pin windows repeat");
+
+        program.add_argument("--profile")
+            .default_value(std::string(""))
+            .help("Count cycles per instruction and write a hotspot report to this file on exit (- for stdout)");
+
+        program.add_argument("--profile-sample")
+            .scan<'u', unsigned>()
+            .default_value(0u)
+            .help("--profile samples the pc every N cycles instead of counting every instruction");
+
+        program.add_argument("--profile-top")
+            .scan<'u', unsigned>()
+            .default_value(40u)
+            .help("Hotspots listed in the --profile report");
+
+        program.add_argument("--callgrind")
+            .default_value(std::string(""))
+            .help("Follow calls, returns and interrupts and write a callgrind file for kcachegrind on exit");
 
         program.add_argument("--add-trace", "-at")
-            .default_value("")
-            .help("Add signal to be included in VCD output (format: name=kind@addr/mask)");
+            .default_value(std::vector<std::string>())
+            .append()
+            .help("Add signal to be included in VCD output (format: name=kind@addr/mask, kind trace or portpin), repeatable");
+
+        program.add_argument("--break")
+            .default_value(std::vector<std::string>())
+            .append()
+            .help("Stop at a pc (format: addr|function[+offset] [if condition], condition like 'r24 == 0x10 && PORTB & 4'), repeatable");
+
+        program.add_argument("--tracepoint")
+            .default_value(std::vector<std::string>())
+            .append()
+            .help("Log and carry on at a pc (format: addr|function[+offset] [if condition] [log expression]), repeatable");
+
+        program.add_argument("--watch")
+            .default_value(std::vector<std::string>())
+            .append()
+            .help("Stop on a data access (format: kind@addr[:size][=value[/mask]], kind read, write, rw or value, addr may be a data symbol), repeatable");
 
         try
         {
@@ -711,14 +750,129 @@ int main(int argc, char **argv)
             return 0;
         }
 
+        if (program["--bench-disasm"] == true)
+        {
+            setupAVRDisasm();
+            return Benchmark_Opcode_Decode() ? 1 : 0;
+        }
+
         std::string mcu = program.get<std::string>("--mcu");
         int frequency = program.get<int>("--freq");
         int gdb_port = program.get<int>("--gdb");
         std::string firmware_file = program.get<std::string>("--firmware");
         std::string vcd_input = program.get<std::string>("--input");
         std::string vcd_output = program.get<std::string>("--output");
-        bool trace = program.get<bool>("--trace");
-        std::string add_trace = program.get<std::string>("--add-trace");
+        std::string trace_file = program.get<std::string>("--trace");
+        std::vector<std::string> add_trace = program.get<std::vector<std::string>>("--add-trace");
+        std::vector<std::string> watches = program.get<std::vector<std::string>>("--watch");
+        std::vector<std::string> breaks = program.get<std::vector<std::string>>("--break");
+        std::vector<std::string> tracepoints = program.get<std::vector<std::string>>("--tracepoint");
+        std::string profile_file = program.get<std::string>("--profile");
+        unsigned profile_sample = program.get<unsigned>("--profile-sample");
+        unsigned profile_top = program.get<unsigned>("--profile-top");
+        std::string callgrind_file = program.get<std::string>("--callgrind");
+
+        std::string sweep_file = program.get<std::string>("--sweep");
+        if (!sweep_file.empty())
+        {
+            signal(SIGINT, sig_int_headless);
+            signal(SIGTERM, sig_int_headless);
+
+            std::vector<Scenario> scenarios;
+            if (!LoadScenarioFile(sweep_file, scenarios))
+                return 1;
+
+            return RunSweep(scenarios, program.get<unsigned>("--jobs"), &headless_stop);
+        }
+
+        avrSim.checkpointEvery = program.get<uint64_t>("--checkpoint-every");
+        avrSim.checkpoints.budget = (size_t)program.get<unsigned>("--checkpoint-mb") << 20;
+
+        if (firmware_file.empty())
+        {
+            std::cerr << "--firmware is required" << std::endl;
+            std::cerr << program;
+            return 1;
+        }
+
+        // parsed once up front, replayed by a cycle timer from Initialize on
+        VcdStimulus stimulus;
+        if (!vcd_input.empty())
+        {
+            if (!stimulus.Load(vcd_input, frequency))
+                return 1;
+            std::cerr << vcd_input << ": " << stimulus.Events() << " events on " << stimulus.Pins() << " pins, "
+                      << stimulus.Ignored() << " signals ignored" << std::endl;
+            avrSim.stimulus = &stimulus;
+        }
+
+        // a peripheral like the stimulus, its sensor timer is part of every checkpoint
+        SpinnerRotor rotor(program.get<double>("--rpm"));
+        if (program["--headless"] == false || program.is_used("--rpm"))
+            avrSim.rotor = &rotor;
+
+        if (program["--headless"] == true)
+        {
+            signal(SIGINT, sig_int_headless);
+            signal(SIGTERM, sig_int_headless);
+
+            // batch runs only pay for checkpoints when asked to
+            if (!program.is_used("--checkpoint-every"))
+                avrSim.checkpointEvery = 0;
+
+            // the report lists the instruction text
+            if (!profile_file.empty())
+                setupAVRDisasm();
+
+            if (!avrSim.Initialize(mcu, firmware_file, frequency, gdb_port))
+                return 1;
+
+            if (!AddWatchSignals(avrSim, add_trace) || !AddWatchpoints(avrSim, watches) ||
+                !AddBreakpoints(avrSim, breaks, false) || !AddBreakpoints(avrSim, tracepoints, true))
+                return 1;
+            PrintTracepoints(avrSim);
+
+            WaveWriter wave;
+            if (!vcd_output.empty() &&
+                !StartWaveOutput(wave, avrSim, vcd_output, program.get<std::string>("--output-format")))
+                return 1;
+
+            InstructionTrace trace;
+            if (!trace_file.empty() &&
+                !StartInstructionTrace(trace, avrSim, trace_file, program.get<std::string>("--trace-start"),
+                                       program.get<std::string>("--trace-stop"), program.get<bool>("--trace-regs")))
+                return 1;
+
+            if (!profile_file.empty())
+                StartProfile(avrSim, profile_sample);
+            if (!callgrind_file.empty())
+                avrSim.callGraph.Start();
+
+            HeadlessLimits limits;
+            limits.cycles = program.get<uint64_t>("--cycles");
+            limits.usec = program.get<uint64_t>("--sim-usec");
+            limits.stop = &headless_stop;
+
+            RunStats stats = avrSim.RunHeadless(limits);
+            PrintRunSummary(avrSim, firmware_file, stats);
+            if (avrSim.watch.triggered)
+                PrintWatchHits(avrSim);
+            if (avrSim.breakpoints.triggered)
+            {
+                char function[96];
+                avrSim.symbols.Format(SYMBOL_FLASH, avrSim.avr->pc, function, sizeof(function));
+                fprintf(stderr, "break: pc 0x%04x %s, cycle %llu\n", avrSim.avr->pc, function,
+                        (unsigned long long)avrSim.avr->cycle);
+            }
+            StopWaveOutput(wave, avrSim, vcd_output);
+            StopInstructionTrace(trace, avrSim, trace_file);
+            if (!profile_file.empty())
+                WriteProfileReport(avrSim, profile_file, profile_top);
+            if (!callgrind_file.empty())
+                WriteCallGraph(avrSim, callgrind_file, firmware_file);
+
+            return stats.state == cpu_Crashed ? 2 : 0;
+        }
 
         std::cout << "init glfw\n";
 
@@ -793,22 +947,62 @@ int main(int argc, char **argv)
 
         avrSim.Initialize(mcu, firmware_file, frequency, gdb_port);
 
+        if (!AddWatchSignals(avrSim, add_trace) || !AddWatchpoints(avrSim, watches) ||
+            !AddBreakpoints(avrSim, breaks, false) || !AddBreakpoints(avrSim, tracepoints, true))
+            return 1;
+
+        WaveWriter wave;
+        if (!vcd_output.empty() &&
+            !StartWaveOutput(wave, avrSim, vcd_output, program.get<std::string>("--output-format")))
+            return 1;
+
+        InstructionTrace trace;
+        if (!trace_file.empty() &&
+            !StartInstructionTrace(trace, avrSim, trace_file, program.get<std::string>("--trace-start"),
+                                   program.get<std::string>("--trace-stop"), program.get<bool>("--trace-regs")))
+            return 1;
+
+        if (!profile_file.empty())
+            StartProfile(avrSim, profile_sample);
+        if (!callgrind_file.empty())
+            avrSim.callGraph.Start();
+
         // Setup signal handlers
         signal(SIGINT, sig_int);
         signal(SIGTERM, sig_int);
 
         std::cout << "starting thread\n";
 
-        // Start a new thread and use a lambda to call the run() method on the Avr instance
-        std::thread avrThread([&avrSim]()
-                              {
-        while(1) {
-            if (avrSim.run || avrSim.animate) {
-                avrSim.Run();
+        // sim thread, parks until run or animate is set
+        SimScheduler scheduler(avrSim);
+
+        std::string pace = program.get<std::string>("--pace");
+        if (pace == "max")
+        {
+            scheduler.mode = PACE_MAX;
+        }
+        else if (pace != "realtime")
+        {
+            char *end;
+            double multiplier = strtod(pace.c_str(), &end);
+            if (pace.empty() || *end || !(multiplier > 0))
+            {
+                std::cerr << "bad --pace '" << pace << "'" << std::endl;
+                return 1;
             }
+            scheduler.mode = PACE_MULTIPLIER;
+            scheduler.multiplier = multiplier;
+        }
 
-            std::this_thread::yield();
-        } });
+        // every led change with its rotor angle, before the sim thread starts
+        if (avrSim.rotor)
+        {
+            pov.Attach(avrSim.avr, avrSim.rotor);
+            pov.Start();
+            avrSim.pov = &pov;
+        }
+
+        scheduler.Start();
 
 #ifndef __APPLE__
         std::cout << "setup scenebuffer\n";
@@ -824,7 +1018,7 @@ int main(int argc, char **argv)
 
 #endif
 
-        spinner.setAvr(avrSim.avr);
+        spinner.setAvr(avrSim.avr, &scheduler);
 
         std::cout << "main loop\n";
         // Main loop
@@ -838,19 +1032,13 @@ int main(int argc, char **argv)
             ImGui_ImplGlfw_NewFrame();
             ImGui::NewFrame();
 
-            bool run = ShowAvrDetails(avrSim);
-
-            ShowAvrDisasm(avrSim);
-
-            ShowAvrDetailsFull(avrSim);
-            DumpAvrRegisters(avrSim);
+            // latest machine state published by the sim thread
+            avrSim.snapshot.Update();
 
-            HexEditor(avrSim, run);
-            HexEditorRAM(avrSim);
+            ShowAvrWindows(avrSim, scheduler);
 
-            ModifyAvrIoRegisters(avrSim);
-
-            renderLEDsInImGuiWindow();
+            renderLEDsInImGuiWindow(avrSim);
+            renderPovImage(avrSim.snapshot.Front());
 
             // Rendering
             ImGui::Render();
@@ -864,6 +1052,16 @@ int main(int argc, char **argv)
             glfwSwapBuffers(window);
         }
 
+        scheduler.Stop();
+
+        pov.Stop();
+        StopWaveOutput(wave, avrSim, vcd_output);
+        StopInstructionTrace(trace, avrSim, trace_file);
+        if (!profile_file.empty())
+            WriteProfileReport(avrSim, profile_file, profile_top);
+        if (!callgrind_file.empty())
+            WriteCallGraph(avrSim, callgrind_file, firmware_file);
+
         // Cleanup
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
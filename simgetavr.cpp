@@ -1,11 +1,10 @@
 #include <signal.h>
 #include <iostream>
 #include <string.h>
-#include "imgui.h"
-#include "imgui_stdlib.h"
-#include "imgui_internal.h"
-#include "imgui_impl_glfw.h"
-#include "imgui_impl_opengl3.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
 #include "simgetavr.h"
 #include "sim_hex.h"
 
@@ -21,6 +20,10 @@ extern "C" {
     #include "simavr/sim/sim_hex.h"
     #include "simavr/sim/sim_elf.h"
     #include "simavr/sim/sim_mcu_structs.h"
+    #include "simavr/sim/avr_eeprom.h"
+    #include "simavr/sim/avr_timer.h"
+    #include "simavr/sim/avr_adc.h"
+    #include "simavr/sim/sim_io.h"
 
 
     #include "Globals.h"
@@ -41,11 +44,35 @@ static int Number_Opcodes = 0;
 static struct Opcode Opcodes[256];
 static int Registers[256];
 
+/* Bitmask strings compiled by setupAVRDisasm(). Pattern bit i maps to bit (31 - i)
+ * of the two opcode words packed as (first << 16) | second. */
+struct Compiled_Field {
+	unsigned char Name;			/* register letter, index into Registers[] */
+	unsigned char Runs;
+	unsigned char Shift[16];	/* contiguous bit runs, most significant first */
+	unsigned char Width[16];
+};
+
+struct Compiled_Opcode {
+	uint32_t Mask;				/* identification bits */
+	uint32_t Value;
+	int Length;					/* in bytes */
+	int Field_Count;
+	struct Compiled_Field Fields[8];
+};
+
+static struct Compiled_Opcode Compiled_Opcodes[256];
+static short Opcode_Table[65536];	/* first opcode word -> first candidate in Opcodes[], -1 if none */
+
 struct Options Options;
 static char Code_Line[256];
 static char Comment_Line[256];
 static char After_Code_Line[256];
 
+/* avrdisas decodes into the statics above and collects jumps/calls in its own
+ * globals, so only one DisasmCache may decode at a time across all simulators */
+static std::mutex Disasm_Lock;
+
 AvrSimulator::AvrSimulator()
 : mcu_type(""),
   firmware_file(""),
@@ -69,6 +96,7 @@ bool AvrSimulator::Initialize(const std::string& mcu_type, const std::string& fi
 {
 
     sim_setup_firmware(firmware_file.c_str(), loadBase, &f, "");
+    symbols.Load(f);
 
     // initialize simavr
     avr = avr_make_mcu_by_name(mcu_type.c_str());
@@ -90,6 +118,8 @@ bool AvrSimulator::Initialize(const std::string& mcu_type, const std::string& fi
 
     // load firmware (ELF or hex)
     avr_load_firmware(avr, &f);
+
+    FinishInitialize();
     
     // setup GDB if specified
     if (gdb_port) {
@@ -100,6 +130,479 @@ bool AvrSimulator::Initialize(const std::string& mcu_type, const std::string& fi
     return true;
 }
 
+bool AvrSimulator::Initialize(const std::string& mcu_type, const std::vector<uint8_t>& image, uint32_t frequency)
+{
+    avr = avr_make_mcu_by_name(mcu_type.c_str());
+    if (!avr) {
+        std::cerr << "AVR '" << mcu_type << "' not known" << std::endl;
+        return false;
+    }
+
+    avr_init(avr);
+    avr->frequency = frequency;
+
+    if (image.size() > avr->flashend + 1) {
+        std::cerr << "image of " << image.size() << " bytes does not fit in flash" << std::endl;
+        return false;
+    }
+
+    avr_loadcode(avr, (uint8_t *)image.data(), image.size(), 0);
+    symbols.Clear();
+
+    FinishInitialize();
+
+    return true;
+}
+
+void AvrSimulator::FinishInitialize()
+{
+    if (disassemble) {
+        disasm.symbols = &symbols;
+        disasm.Build(avr->flash, avr->flashend + 1);
+    }
+
+    // 8 is IOPORT_IRQ_PIN_ALL, missing ports just return no irq
+    pinIrqs.clear();
+    for (char port = 'A'; port <= 'L'; port++) {
+        for (int bit = 0; bit <= 8; bit++) {
+            avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit);
+            if (irq) {
+                pinIrqs.push_back(irq);
+            }
+        }
+    }
+
+    breakpoints.Attach(avr);
+    watch.Attach(avr);
+    profile.Attach(avr);
+    callGraph.Attach(avr);
+
+    // its cycle timer becomes part of the power on state and every checkpoint
+    if (stimulus) {
+        stimulus->Attach(avr);
+    }
+    if (rotor) {
+        rotor->Attach(avr);
+    }
+
+    SaveState(powerOn);
+    ForgetHistory();
+
+    PublishSnapshot();
+}
+
+// fixed part of the state blob, copied field by field so padding stays zero
+struct CoreState {
+    avr_flashaddr_t pc;
+    avr_cycle_count_t cycle;
+    int state;
+    uint8_t sreg[8];
+    int8_t interrupt_state;
+    avr_cycle_count_t run_cycle_count;
+    avr_cycle_count_t run_cycle_limit;
+    uint32_t sleep_usec;
+    uint64_t instructions;
+    avr_cycle_timer_pool_t cycle_timers;
+    avr_int_pending_fifo_t pending;         // the interrupt table minus its irqs, they carry hooks
+    uint8_t running_ptr;
+    avr_int_vector_p running[64];
+    uint8_t vector_pending[64];
+    SpinnerRotor::State rotor;
+};
+
+// what simavr's peripherals work out from their registers and keep to themselves. the
+// registers are in the data space, but a timer's TCNT for one is read back from tov_base,
+// and a replay that starts from stale copies of these isn't the run it replays
+template <class Visit>
+static void PeripheralFields(avr_t *avr, Visit &&visit)
+{
+    for (avr_io_t *io = avr->io_port; io; io = io->next) {
+        if (!strcmp(io->kind, "timer")) {
+            avr_timer_t *t = (avr_timer_t *)io;
+            visit(t->mode);
+            visit(t->wgm_op_mode_kind);
+            visit(t->wgm_op_mode_size);
+            visit(t->ext_clock_flags);
+            visit(t->tov_cycles);
+            visit(t->tov_cycles_fract);
+            visit(t->phase_accumulator);
+            visit(t->tov_base);
+            visit(t->tov_top);
+            for (int i = 0; i < AVR_TIMER_COMP_COUNT; i++) {
+                visit(t->comp[i].comp_cycles);
+            }
+        } else if (!strcmp(io->kind, "uart")) {
+            avr_uart_t *u = (avr_uart_t *)io;
+            visit(u->input);
+            visit(u->tx_cnt);
+            visit(u->cycles_per_byte);
+            visit(u->rxc_raise_time);
+        } else if (!strcmp(io->kind, "adc")) {
+            avr_adc_t *a = (avr_adc_t *)io;
+            visit(a->adc_values);
+            visit(a->temp);
+            visit(a->first);
+            visit(a->read_status);
+        }
+    }
+}
+
+static size_t PeripheralBytes(avr_t *avr)
+{
+    size_t size = 0;
+    PeripheralFields(avr, [&](const auto &field) { size += sizeof(field); });
+    return size;
+}
+
+void AvrSimulator::SaveState(std::vector<uint8_t> &blob) const
+{
+    const size_t dataSize = avr->ramend + 1;
+    const size_t flashSize = avr->flashend + 1;
+    const size_t eepromSize = avr->e2end ? avr->e2end + 1 : 0;
+
+    blob.resize(sizeof(CoreState) + dataSize + flashSize + eepromSize + pinIrqs.size() * sizeof(uint32_t) +
+                PeripheralBytes(avr));
+
+    CoreState core;
+    memset(&core, 0, sizeof(core));
+    core.pc = avr->pc;
+    core.cycle = avr->cycle;
+    core.state = avr->state;
+    memcpy(core.sreg, avr->sreg, sizeof(core.sreg));
+    core.interrupt_state = avr->interrupt_state;
+    core.run_cycle_count = avr->run_cycle_count;
+    core.run_cycle_limit = avr->run_cycle_limit;
+    core.sleep_usec = avr->sleep_usec;
+    core.instructions = instructions;
+    core.cycle_timers = avr->cycle_timers;
+    if (rotor) {
+        core.rotor = rotor->state;
+    }
+    core.pending = avr->interrupts.pending;
+    core.running_ptr = avr->interrupts.running_ptr;
+    memcpy(core.running, avr->interrupts.running, sizeof(core.running));
+    for (int i = 0; i < avr->interrupts.vector_count && i < 64; i++) {
+        if (avr->interrupts.vector[i]) {
+            core.vector_pending[i] = avr->interrupts.vector[i]->pending;
+        }
+    }
+
+    uint8_t *out = blob.data();
+    memcpy(out, &core, sizeof(core));
+    out += sizeof(core);
+    memcpy(out, avr->data, dataSize);
+    out += dataSize;
+    memcpy(out, avr->flash, flashSize);
+    out += flashSize;
+
+    if (eepromSize) {
+        avr_eeprom_desc_t ee = { out, 0, (uint32_t)eepromSize };
+        if (avr_ioctl(avr, AVR_IOCTL_EEPROM_GET, &ee) != 0) {
+            memset(out, 0, eepromSize);
+        }
+        out += eepromSize;
+    }
+
+    for (avr_irq_t *irq : pinIrqs) {
+        memcpy(out, &irq->value, sizeof(uint32_t));
+        out += sizeof(uint32_t);
+    }
+
+    PeripheralFields(avr, [&](const auto &field) {
+        memcpy(out, &field, sizeof(field));
+        out += sizeof(field);
+    });
+}
+
+bool AvrSimulator::LoadState(const std::vector<uint8_t> &blob)
+{
+    const size_t dataSize = avr->ramend + 1;
+    const size_t flashSize = avr->flashend + 1;
+    const size_t eepromSize = avr->e2end ? avr->e2end + 1 : 0;
+
+    if (blob.size() != sizeof(CoreState) + dataSize + flashSize + eepromSize + pinIrqs.size() * sizeof(uint32_t) +
+                       PeripheralBytes(avr)) {
+        return false;
+    }
+
+    // every peripheral back to power on first, like avr_reset does. what the blob carries of
+    // them is copied over below, the rest must not be left over from the run we're leaving.
+    // cycle timers, interrupts and registers the resets touch are all restored after this
+    for (avr_io_t *io = avr->io_port; io; io = io->next) {
+        if (io->reset) {
+            io->reset(io);
+        }
+    }
+
+    const uint8_t *in = blob.data();
+
+    CoreState core;
+    memcpy(&core, in, sizeof(core));
+    in += sizeof(core);
+
+    avr->pc = core.pc;
+    avr->cycle = core.cycle;
+    avr->state = core.state;
+    memcpy(avr->sreg, core.sreg, sizeof(core.sreg));
+    avr->interrupt_state = core.interrupt_state;
+    avr->run_cycle_count = core.run_cycle_count;
+    avr->run_cycle_limit = core.run_cycle_limit;
+    avr->sleep_usec = core.sleep_usec;
+    instructions = core.instructions;
+    avr->cycle_timers = core.cycle_timers;
+    if (rotor) {
+        rotor->state = core.rotor;
+    }
+    avr->interrupts.pending = core.pending;
+    avr->interrupts.running_ptr = core.running_ptr;
+    memcpy(avr->interrupts.running, core.running, sizeof(core.running));
+    for (int i = 0; i < avr->interrupts.vector_count && i < 64; i++) {
+        if (avr->interrupts.vector[i]) {
+            avr->interrupts.vector[i]->pending = core.vector_pending[i];
+        }
+    }
+
+    memcpy(avr->data, in, dataSize);
+    in += dataSize;
+    // going back past a flash write puts the old bytes back, the disassembly needs to know
+    if (memcmp(avr->flash, in, flashSize) != 0) {
+        uint32_t first = 0, last = flashSize;
+        while (avr->flash[first] == in[first]) {
+            first++;
+        }
+        while (avr->flash[last - 1] == in[last - 1]) {
+            last--;
+        }
+        MarkFlash(writtenFlash, first, last);
+        memcpy(avr->flash, in, flashSize);
+        // and so do the decoded words the watch and call graph step loops work from
+        for (uint32_t addr = first & ~1u; addr < last; addr += 2) {
+            watch.Invalidate(addr);
+            callGraph.Invalidate(addr);
+        }
+    }
+    in += flashSize;
+
+    if (eepromSize) {
+        avr_eeprom_desc_t ee = { (uint8_t *)in, 0, (uint32_t)eepromSize };
+        avr_ioctl(avr, AVR_IOCTL_EEPROM_SET, &ee);
+        in += eepromSize;
+    }
+
+    // levels only, restoring must not fire pin change logic
+    for (avr_irq_t *irq : pinIrqs) {
+        memcpy(&irq->value, in, sizeof(uint32_t));
+        in += sizeof(uint32_t);
+    }
+
+    PeripheralFields(avr, [&](auto &field) {
+        memcpy(&field, in, sizeof(field));
+        in += sizeof(field);
+    });
+
+    state = avr->state;
+    nextCheckpoint = avr->cycle + checkpointEvery;
+
+    // the blob may or may not hold the sampling timer, depending on when it was taken
+    profile.Arm(avr);
+    callGraph.Unwind();
+    if (pov) {
+        pov->Resync();
+    }
+
+    return true;
+}
+
+bool AvrSimulator::Restart()
+{
+    if (!LoadState(powerOn)) {
+        return false;
+    }
+    ForgetHistory();
+    return true;
+}
+
+void AvrSimulator::TakeCheckpoint()
+{
+    // re-executing through history that already has its checkpoints
+    if (checkpoints.Size() && checkpoints.Cycle(checkpoints.Size() - 1) >= avr->cycle) {
+        nextCheckpoint = checkpoints.Cycle(checkpoints.Size() - 1) + checkpointEvery;
+        return;
+    }
+
+    SaveState(checkpointBlob);
+    checkpoints.Push(checkpointBlob, avr->cycle);
+    nextCheckpoint = avr->cycle + checkpointEvery;
+
+    // input from before the oldest checkpoint can't be replayed any more
+    while (!inputLog.empty() && inputLog.front().cycle < checkpoints.Cycle(0)) {
+        inputLog.pop_front();
+        if (replayNext) {
+            replayNext--;
+        }
+    }
+}
+
+bool AvrSimulator::RestoreCheckpoint(size_t index)
+{
+    if (!checkpoints.Get(index, checkpointBlob) || !LoadState(checkpointBlob)) {
+        return false;
+    }
+    SetReplayFrom(avr->cycle);
+    return true;
+}
+
+bool AvrSimulator::DiffCheckpoints(avr_cycle_count_t cycleA, avr_cycle_count_t cycleB)
+{
+    const size_t dataSize = avr->ramend + 1;
+    std::vector<uint8_t> blobA, blobB;
+
+    // either may have been dropped from the ring since the UI picked it
+    const int a = checkpoints.Find(cycleA), b = checkpoints.Find(cycleB);
+    if (a < 0 || b < 0 || checkpoints.Cycle(a) != cycleA || checkpoints.Cycle(b) != cycleB) {
+        return false;
+    }
+
+    if (!checkpoints.Get(a, blobA) || !checkpoints.Get(b, blobB) ||
+        blobA.size() < sizeof(CoreState) + dataSize || blobB.size() < sizeof(CoreState) + dataSize) {
+        return false;
+    }
+
+    // the data space follows the core state in the blob
+    std::shared_ptr<DataDiff> diff = std::make_shared<DataDiff>();
+    diff->cycleA = checkpoints.Cycle(a);
+    diff->cycleB = checkpoints.Cycle(b);
+    diff->a.assign(blobA.begin() + sizeof(CoreState), blobA.begin() + sizeof(CoreState) + dataSize);
+    diff->b.assign(blobB.begin() + sizeof(CoreState), blobB.begin() + sizeof(CoreState) + dataSize);
+    DiffBytes(diff->a.data(), diff->b.data(), dataSize, diff->ranges);
+
+    checkpointDiff = diff;
+    return true;
+}
+
+// reset/restart start a new timeline, cycles begin again and old history is meaningless
+void AvrSimulator::ForgetHistory()
+{
+    checkpoints.Clear();
+    checkpointDiff.reset();
+    inputLog.clear();
+    replayNext = 0;
+    replayCycle = UINT64_MAX;
+    timelineEnd = avr->cycle;
+    nextCheckpoint = avr->cycle;
+    breakOnEntry = true;
+
+    if (checkpointEvery) {
+        TakeCheckpoint();
+    }
+}
+
+// new input after seeking back, what used to follow can't happen any more
+void AvrSimulator::TruncateFuture()
+{
+    inputLog.erase(inputLog.begin() + replayNext, inputLog.end());
+    replayCycle = UINT64_MAX;
+    checkpoints.Truncate(avr->cycle);
+    timelineEnd = avr->cycle;
+}
+
+void AvrSimulator::SetReplayFrom(avr_cycle_count_t cycle)
+{
+    // inputs stamped at the checkpoint's own cycle were applied after it was taken
+    replayNext = std::lower_bound(inputLog.begin(), inputLog.end(), cycle,
+        [](const SimCommand &c, avr_cycle_count_t v) { return c.cycle < v; }) - inputLog.begin();
+    replayCycle = replayNext < inputLog.size() ? inputLog[replayNext].cycle : UINT64_MAX;
+}
+
+void AvrSimulator::ApplyReplay()
+{
+    while (replayNext < inputLog.size() && inputLog[replayNext].cycle <= avr->cycle) {
+        ApplyInput(inputLog[replayNext++]);
+    }
+    replayCycle = replayNext < inputLog.size() ? inputLog[replayNext].cycle : UINT64_MAX;
+}
+
+avr_cycle_count_t AvrSimulator::Replay(avr_cycle_count_t target, bool atBreakpoint)
+{
+    avr_cycle_count_t found = UINT64_MAX;
+
+    // watchpoints already stopped here, the profiler and call graph counted it the first time round
+    watch.quiet = true;
+    profile.quiet = true;
+    callGraph.quiet = true;
+    while (avr->cycle < target) {
+
+        if (!atBreakpoint) {
+            found = avr->cycle;
+        } else if (breakpoints.Armed(avr->pc) && breakpoints.Stop(avr, false)) {
+            found = avr->cycle;
+        }
+
+        StepInstruction();
+
+        if (state == cpu_Done || state == cpu_Crashed) {
+            break;
+        }
+    }
+    watch.quiet = false;
+    profile.quiet = false;
+    callGraph.quiet = false;
+
+    return found;
+}
+
+bool AvrSimulator::Seek(avr_cycle_count_t target)
+{
+    if (!checkpoints.Size()) {
+        return false;
+    }
+
+    int index = std::max(checkpoints.Find(target), 0);
+
+    // already between that checkpoint and the target, just carry on forward
+    if (avr->cycle > target || avr->cycle < checkpoints.Cycle(index)) {
+        RestoreCheckpoint(index);
+    }
+
+    Replay(target, false);
+    return true;
+}
+
+bool AvrSimulator::ReverseStep()
+{
+    const avr_cycle_count_t now = avr->cycle;
+    const int index = now ? checkpoints.Find(now - 1) : -1;
+
+    if (index < 0 || !RestoreCheckpoint(index)) {
+        return false;
+    }
+
+    // the first replay finds where the previous instruction started, the second stops there
+    avr_cycle_count_t previous = Replay(now, false);
+    return previous != UINT64_MAX && Seek(previous);
+}
+
+bool AvrSimulator::ReverseContinue()
+{
+    avr_cycle_count_t end = avr->cycle;
+
+    // newest segment first, each one ends where the next newer one starts
+    for (int index = end ? checkpoints.Find(end - 1) : -1; index >= 0; index--) {
+        if (!RestoreCheckpoint(index)) {
+            return false;
+        }
+
+        avr_cycle_count_t hit = Replay(end, true);
+        if (hit != UINT64_MAX) {
+            return Seek(hit);
+        }
+        end = checkpoints.Cycle(index);
+    }
+
+    // no breakpoint in the recorded history, stop at its start like gdb does
+    return Seek(checkpoints.Size() ? checkpoints.Cycle(0) : avr->cycle);
+}
+
 AvrSimulator::~AvrSimulator()
 {
     Cleanup(); // Ensure all resources are released
@@ -134,29 +637,752 @@ int AvrSimulator::Run()
     return state;
 }
 
-int AvrSimulator::RunAnimate() 
+// one instruction, re-applying logged input first when re-executing through history
+int AvrSimulator::StepInstruction()
 {
-    static std::chrono::steady_clock::time_point lastCall = std::chrono::steady_clock::now();
-    auto now = std::chrono::steady_clock::now();
-    
-    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastCall);
-    
-    if ( elapsed.count() > animateDelay ) {
+    if (avr->cycle >= replayCycle) {
+        ApplyReplay();
+    }
 
-		for( int i =0 ; i < 20 ;i ++ )
-	        state = avr_run(avr);
-      
-        // update the time of the last call to the current time
-        lastCall = std::chrono::steady_clock::now();
+    if (avr->state == cpu_Running) {
+        instructions++;
+    }
 
-    } else {
-        return 0;
+    if (!watch.armed && !trace && !profile.exact && !callGraph.enabled) {
+        return state = avr_run(avr);
+    }
+
+    const uint32_t pc = avr->pc;
+    const avr_cycle_count_t cycle = avr->cycle;
+
+    if (watch.armed) {
+        watch.Before(avr);
+    }
+    // the shadow stack picks up again from the root on the first live instruction
+    const bool calls = callGraph.enabled && !callGraph.quiet;
+    if (calls) {
+        callGraph.Before(avr);
+    }
+
+    state = avr_run(avr);
+
+    if (watch.armed) {
+        watch.After(avr, cycle);
+    }
+    if (trace) {
+        trace->Record(avr, pc, cycle);
+    }
+    if (profile.exact && !profile.quiet) {
+        profile.Count(pc, avr->cycle - cycle);
+    }
+    if (calls) {
+        callGraph.After(avr, cycle);
+    }
+
+    return state;
+}
+
+// wall time since the last call times the rate adds to a fractional budget, whole units of
+// it run and the remainder carries over. the rate holds over any stretch of wall time no
+// matter how often the caller comes round or how fast the host is
+int AvrSimulator::RunAnimate()
+{
+    // stalls (a dragged window, a breakpoint in the debugger) aren't made up in one burst
+    const double maxCatchUp = 0.25;
+
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::min(std::chrono::duration<double>(now - lastAnimate).count(), maxCatchUp);
+    lastAnimate = now;
+
+    // simulated time is budgeted in cycles at the core's current clock
+    const double scale = animateUnit == ANIMATE_SIM_USEC ? (avr->frequency ? avr->frequency : 1000000) / 1e6 : 1.0;
+    animateBudget = std::min(animateBudget + elapsed * animateRate * scale, maxCatchUp * animateRate * scale + 1.0);
+
+    const avr_cycle_count_t start = avr->cycle;
+    uint64_t ran = 0;
+
+    state = avr->state;
+    watch.triggered = false;
+    breakpoints.triggered = false;
+    if (animateBudget >= 1.0 && BreakOnEntry()) {
+        animate = false;
+        return state;
+    }
+    while (animateBudget >= 1.0) {
+        const avr_cycle_count_t before = avr->cycle;
+        StepInstruction();
+        animateBudget -= animateUnit == ANIMATE_SIM_USEC ? (double)(avr->cycle - before) : 1.0;
+        ran++;
+
+        // stop on the instruction that hit it
+        if (state == cpu_Done || state == cpu_Crashed || watch.triggered ||
+            (breakpoints.Count() && breakpoints.Armed(avr->pc) && breakpoints.Stop(avr, true))) {
+            animate = false;
+            break;
+        }
+    }
+
+    animateCount += animateUnit == ANIMATE_SIM_USEC ? (avr->cycle - start) / scale : (double)ran;
+    const double window = std::chrono::duration<double>(now - animateWindow).count();
+    if (window >= 0.5) {
+        animateAchieved = animateCount / window;
+        animateCount = 0;
+        animateWindow = now;
+    }
+
+    if (ran) {
+        timelineEnd = std::max(timelineEnd, avr->cycle);
+        if (checkpointEvery && avr->cycle >= nextCheckpoint) {
+            TakeCheckpoint();
+        }
     }
 
     return state;
 }
 
+bool AvrSimulator::BreakOnEntry()
+{
+    if (!breakOnEntry) {
+        return false;
+    }
+    breakOnEntry = false;
+    return breakpoints.Count() && breakpoints.Armed(avr->pc) && breakpoints.Stop(avr, true);
+}
+
+double AvrSimulator::AnimateDueUsec() const
+{
+    const double scale = animateUnit == ANIMATE_SIM_USEC ? (avr->frequency ? avr->frequency : 1000000) / 1e6 : 1.0;
+    return animateRate > 0 ? std::max(0.0, 1.0 - animateBudget) / (animateRate * scale) * 1e6 : 1e6;
+}
+
+void AvrSimulator::StartAnimate()
+{
+    lastAnimate = animateWindow = std::chrono::steady_clock::now();
+    animateBudget = 0;
+    animateCount = 0;
+    animateAchieved = 0;
+}
+
+
+int AvrSimulator::RunQuantum(avr_cycle_count_t cycles)
+{
+    const avr_cycle_count_t target = avr->cycle + cycles;
+
+    state = avr->state;
+    watch.triggered = false;
+    breakpoints.triggered = false;
+    if (BreakOnEntry()) {
+        run = false;
+        animate = false;
+        return state;
+    }
+    while (avr->cycle < target) {
+
+        if (!commands.Empty() && ApplyCommands()) {
+            break;
+        }
+
+        StepInstruction();
+
+        if (state == cpu_Done || state == cpu_Crashed) {
+            break;
+        }
+
+        if (watch.triggered) {
+            run = false;
+            animate = false;
+            break;
+        }
+
+        if (breakpoints.Count() && breakpoints.Armed(avr->pc) && breakpoints.Stop(avr, true)) {
+            run = false;
+            animate = false;
+            break;
+        }
+    }
+
+    timelineEnd = std::max(timelineEnd, avr->cycle);
+
+    // quantum granularity is plenty, checkpoints are thousands of cycles apart
+    if (checkpointEvery && avr->cycle >= nextCheckpoint) {
+        TakeCheckpoint();
+    }
+
+    return state;
+}
+
+void AvrSimulator::SetRunTarget(const SimCommand &cmd)
+{
+    const uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+    const uint16_t op = avr->pc + 1 <= avr->flashend ? avr->flash[avr->pc] | (avr->flash[avr->pc + 1] << 8) : 0;
+
+    runTo = RunTarget();
+    switch (cmd.type) {
+    case CMD_STEP_OVER:
+        // call is two words, rcall/icall/eicall one. the same return address with SP back
+        // where it was, a recursive call returning there first has SP lower
+        if ((op & 0xfe0e) == 0x940e || (op & 0xf000) == 0xd000 || op == 0x9509 || op == 0x9519) {
+            runTo.until = UNTIL_PC;
+            runTo.pc = avr->pc + ((op & 0xfe0e) == 0x940e ? 4 : 2);
+            runTo.sp = sp;
+        }
+        break;
+    case CMD_STEP_OUT:
+        // whatever the function pushed, its own return pops the address above the current SP
+        runTo.until = UNTIL_RETURN;
+        runTo.sp = sp;
+        break;
+    case CMD_RUN_TO:
+        runTo.until = UNTIL_PC;
+        runTo.pc = cmd.addr;
+        break;
+    case CMD_RUN_CYCLES:
+        runTo.until = UNTIL_CYCLE;
+        runTo.cycle = avr->cycle + std::max<uint64_t>(cmd.target, 1);
+        break;
+    }
+    step = true;
+}
+
+bool AvrSimulator::RunTowards(avr_cycle_count_t cycles)
+{
+    const avr_cycle_count_t limit = avr->cycle + cycles;
+    bool reached = false;
+
+    state = avr->state;
+    watch.triggered = false;
+    breakpoints.triggered = false;
+    // a single step moves off the instruction whatever is on it
+    if (runTo.until == UNTIL_STEP) {
+        breakOnEntry = false;
+    } else if (BreakOnEntry()) {
+        step = false;
+        return true;
+    }
+    while (!reached && avr->cycle < limit) {
+
+        // a new target, run or reset replaces this one
+        if (!commands.Empty() && ApplyCommands()) {
+            return !step;
+        }
+
+        bool returning = false, reti = false;
+        if (runTo.until == UNTIL_RETURN && avr->pc + 1 <= avr->flashend) {
+            const uint16_t op = avr->flash[avr->pc] | (avr->flash[avr->pc + 1] << 8);
+            returning = op == 0x9508 || op == 0x9518;
+            reti = op == 0x9518;
+        }
+        const uint8_t interrupts = avr->interrupts.running_ptr;
+
+        StepInstruction();
+
+        // an interrupt taken right after the ret pushed the return address, SP is back down.
+        // see the call graph, reti drops the running count before a back to back one
+        if (returning) {
+            const uint8_t expected = reti && interrupts ? interrupts - 1 : interrupts;
+            if (avr->interrupts.running_ptr > expected) {
+                const uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+                if (sp + avr->address_size > runTo.sp) {
+                    // out of the function, stop where the interrupt returns to
+                    avr_flashaddr_t pc = 0;
+                    for (int i = 0; i < avr->address_size; i++) {
+                        pc |= (avr_flashaddr_t)avr->data[sp + avr->address_size - i] << (8 * i);
+                    }
+                    runTo.until = UNTIL_PC;
+                    runTo.pc = pc << 1;
+                    runTo.sp = sp + avr->address_size;
+                }
+            }
+        }
+
+        switch (runTo.until) {
+        case UNTIL_STEP:
+            reached = true;
+            break;
+        case UNTIL_PC:
+            reached = avr->pc == runTo.pc && (avr->data[R_SPL] | (avr->data[R_SPH] << 8)) >= runTo.sp;
+            break;
+        case UNTIL_RETURN:
+            reached = returning && (avr->data[R_SPL] | (avr->data[R_SPH] << 8)) > runTo.sp;
+            break;
+        case UNTIL_CYCLE:
+            reached = avr->cycle >= runTo.cycle;
+            break;
+        }
+
+        if (state == cpu_Done || state == cpu_Crashed || watch.triggered) {
+            reached = true;
+        }
+        if (!reached && breakpoints.Count() && breakpoints.Armed(avr->pc) && breakpoints.Stop(avr, true)) {
+            reached = true;
+        }
+    }
+
+    timelineEnd = std::max(timelineEnd, avr->cycle);
+    if (checkpointEvery && avr->cycle >= nextCheckpoint) {
+        TakeCheckpoint();
+    }
+
+    if (reached) {
+        step = false;
+    }
+    return reached;
+}
+
+const char *GetAvrStateName(int state)
+{
+    switch (state) {
+    case cpu_Limbo:
+        return "Limbo";
+    case cpu_Stopped:
+        return "Stopped";
+    case cpu_Running:
+        return "Running";
+    case cpu_Sleeping:
+        return "Sleeping";
+    case cpu_Step:
+        return "Step";
+    case cpu_StepDone:
+        return "Step Done";
+    case cpu_Done:
+        return "Done";
+    case cpu_Crashed:
+        return "Crashed";
+    default:
+        return "Unknown";
+    }
+}
+
+const char *GetSimCommandName(int type)
+{
+    switch (type) {
+    case CMD_SET_PIN:
+        return "pin";
+    case CMD_POKE_DATA:
+        return "poke";
+    case CMD_WRITE_FLASH:
+        return "flash";
+    case CMD_SPINNER_RPM:
+        return "rpm";
+    case CMD_RESET:
+        return "reset";
+    case CMD_SET_RUN:
+        return "run";
+    case CMD_SET_ANIMATE:
+        return "animate";
+    case CMD_ANIMATE_RATE:
+        return "animate rate";
+    case CMD_STEP:
+        return "step";
+    case CMD_STEP_OVER:
+        return "step over";
+    case CMD_STEP_OUT:
+        return "step out";
+    case CMD_RUN_TO:
+        return "run to";
+    case CMD_RUN_CYCLES:
+        return "run cycles";
+    case CMD_RESTART:
+        return "restart";
+    case CMD_RESTORE:
+        return "restore";
+    case CMD_SEEK:
+        return "seek";
+    case CMD_REVERSE_STEP:
+        return "reverse step";
+    case CMD_REVERSE_CONTINUE:
+        return "reverse continue";
+    case CMD_BREAKPOINT:
+        return "breakpoint";
+    case CMD_BREAKPOINT_POSTED:
+        return "breakpoint posted";
+    case CMD_PROFILE:
+        return "profile";
+    case CMD_PROFILE_CLEAR:
+        return "profile clear";
+    case CMD_CALLGRAPH:
+        return "call graph";
+    case CMD_CALLGRAPH_CLEAR:
+        return "call graph clear";
+    case CMD_DIFF_CHECKPOINTS:
+        return "diff checkpoints";
+    case CMD_WATCHPOINT:
+        return "watchpoint";
+    case CMD_WATCHPOINT_REMOVE:
+        return "watchpoint remove";
+    default:
+        return "unknown";
+    }
+}
+
+void AvrSimulator::ApplyInput(const SimCommand &cmd)
+{
+    switch (cmd.type) {
+    case CMD_SET_PIN: {
+        avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(cmd.port), cmd.bit);
+        if (irq) {
+            avr_raise_irq(irq, cmd.value ? 1 : 0);
+        }
+        break;
+    }
+    case CMD_POKE_DATA:
+        if (cmd.addr <= avr->ramend) {
+            avr->data[cmd.addr] = (avr->data[cmd.addr] & ~cmd.mask) | (cmd.value & cmd.mask);
+        }
+        break;
+    case CMD_WRITE_FLASH:
+        if (cmd.addr <= avr->flashend) {
+            avr->flash[cmd.addr] = cmd.value;
+            watch.Invalidate(cmd.addr);
+            callGraph.Invalidate(cmd.addr);
+            MarkFlash(writtenFlash, cmd.addr, cmd.addr + 1);
+        }
+        break;
+    case CMD_SPINNER_RPM:
+        if (rotor) {
+            rotor->SetRpm(avr, cmd.target / 1000.0);
+        }
+        break;
+    }
+}
+
+bool AvrSimulator::ApplyCommands()
+{
+    // keeps enough history to show and replay recent input
+    const size_t maxLog = 4096;
+
+    bool control = false;
+    SimCommand cmd;
+
+    while (commands.Pop(cmd)) {
+
+        cmd.cycle = avr->cycle;
+
+        switch (cmd.type) {
+        case CMD_SET_PIN:
+        case CMD_POKE_DATA:
+        case CMD_WRITE_FLASH:
+        case CMD_SPINNER_RPM:
+            if (timelineEnd > avr->cycle) {
+                TruncateFuture();
+            }
+            ApplyInput(cmd);
+            // only worth keeping while there are checkpoints to replay it from
+            if (checkpointEvery) {
+                inputLog.push_back(cmd);
+                replayNext = inputLog.size();
+            }
+            break;
+        case CMD_RESET:
+            avr_reset(avr);
+            if (stimulus) {
+                stimulus->Arm(avr);
+            }
+            if (rotor) {
+                rotor->Arm(avr);
+            }
+            if (pov) {
+                pov->Resync();
+            }
+            profile.Arm(avr);
+            callGraph.Unwind();
+            ForgetHistory();
+            step = false;
+            control = true;
+            break;
+        case CMD_SET_RUN:
+            run = cmd.value != 0;
+            step = false;
+            control = true;
+            break;
+        case CMD_SET_ANIMATE:
+            if (cmd.value && !animate) {
+                StartAnimate();
+            }
+            animate = cmd.value != 0;
+            step = false;
+            control = true;
+            break;
+        case CMD_ANIMATE_RATE:
+            animateUnit = cmd.value == ANIMATE_SIM_USEC ? ANIMATE_SIM_USEC : ANIMATE_INSTRUCTIONS;
+            animateRate = cmd.target / 1000.0;
+            StartAnimate();
+            break;
+        case CMD_STEP:
+        case CMD_STEP_OVER:
+        case CMD_STEP_OUT:
+        case CMD_RUN_TO:
+        case CMD_RUN_CYCLES:
+            SetRunTarget(cmd);
+            run = false;
+            animate = false;
+            control = true;
+            break;
+        case CMD_RESTART:
+            Restart();
+            step = false;
+            control = true;
+            break;
+        case CMD_RESTORE:
+        case CMD_SEEK:
+        case CMD_REVERSE_STEP:
+        case CMD_REVERSE_CONTINUE:
+            if (cmd.type == CMD_RESTORE) {
+                // by cycle, the ring may have dropped entries since the UI picked this one
+                const int index = checkpoints.Find(cmd.target);
+                if (index >= 0 && checkpoints.Cycle(index) == cmd.target) {
+                    Seek(cmd.target);
+                }
+            } else if (cmd.type == CMD_SEEK) {
+                Seek(cmd.target);
+            } else if (cmd.type == CMD_REVERSE_STEP) {
+                ReverseStep();
+            } else if (cmd.type == CMD_REVERSE_CONTINUE) {
+                ReverseContinue();
+            }
+            // wherever it landed, running on resumes from there
+            breakOnEntry = false;
+            run = false;
+            animate = false;
+            control = true;
+            break;
+        case CMD_BREAKPOINT:
+            breakpoints.Toggle(cmd.addr, cmd.value != 0);
+            break;
+        case CMD_BREAKPOINT_POSTED:
+            breakpoints.Accept();
+            break;
+        case CMD_PROFILE:
+            if (cmd.value) {
+                profile.Start(avr, cmd.addr);
+            } else {
+                profile.Stop(avr);
+            }
+            break;
+        case CMD_PROFILE_CLEAR:
+            profile.Clear();
+            break;
+        case CMD_CALLGRAPH:
+            if (cmd.value) {
+                callGraph.Start();
+            } else {
+                callGraph.Stop();
+            }
+            break;
+        case CMD_CALLGRAPH_CLEAR:
+            callGraph.Clear();
+            break;
+        case CMD_DIFF_CHECKPOINTS:
+            DiffCheckpoints(cmd.base, cmd.target);
+            break;
+        case CMD_WATCHPOINT:
+            watch.SetWatchpoint(cmd.addr, (uint16_t)cmd.target, cmd.bit, cmd.value, cmd.mask);
+            break;
+        case CMD_WATCHPOINT_REMOVE:
+            watch.RemoveWatchpoint(cmd.addr);
+            break;
+        default:
+            continue;
+        }
+
+        commandLog.push_back(cmd);
+        if (commandLog.size() > maxLog) {
+            commandLog.pop_front();
+        }
+    }
+
+    return control;
+}
+
+void AvrSimulator::MarkFlash(FlashRange &range, uint32_t start, uint32_t end)
+{
+    if (start >= end) {
+        return;
+    }
+    if (range.start == range.end) {
+        range.start = start;
+        range.end = end;
+    } else {
+        range.start = std::min(range.start, start);
+        range.end = std::max(range.end, end);
+    }
+}
+
+void AvrSimulator::PublishSnapshot()
+{
+    SimSnapshot &snap = snapshot.Back();
+    const size_t size = avr->ramend + 1;
+    const uint16_t ioend = std::min<uint16_t>(avr->ioend + 1, size);
+
+    snap.sequence = ++published;
+    snap.cycle = avr->cycle;
+    snap.pc = avr->pc;
+    memcpy(snap.sreg, avr->sreg, sizeof(snap.sreg));
+    snap.sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+    snap.state = avr->state;
+    snap.instructions = instructions;
+    snap.running = run;
+    snap.animating = animate;
+    snap.animateUnit = animateUnit;
+    snap.animateRate = animateRate;
+    snap.animateAchieved = animate ? animateAchieved : 0;
+    snap.stepping = step;
+    if (rotor) {
+        snap.rotorRpm = rotor->Rpm();
+        snap.rotorAngle = rotor->Angle(avr->cycle);
+        snap.rotorTurns = (uint64_t)std::max(0.0, rotor->Turns(avr->cycle));
+    }
 
+    snap.checkpoints = checkpoints.Size();
+    snap.checkpointBytes = checkpoints.Bytes();
+    snap.checkpointFirst = snap.checkpoints ? checkpoints.Cycle(0) : 0;
+    snap.checkpointLast = snap.checkpoints ? checkpoints.Cycle(snap.checkpoints - 1) : 0;
+    snap.checkpointCycles.resize(snap.checkpoints);
+    for (size_t i = 0; i < snap.checkpoints; i++) {
+        snap.checkpointCycles[i] = checkpoints.Cycle(i);
+    }
+    snap.timelineEnd = timelineEnd;
+
+    // conditions and their strings only when the table changed, the counters every time
+    const std::vector<Breakpoint> &list = breakpoints.List();
+    if (snap.breakpointGeneration != breakpoints.Generation()) {
+        snap.breakpoints = list;
+        snap.breakpointGeneration = breakpoints.Generation();
+    } else {
+        for (size_t i = 0; i < list.size(); i++) {
+            snap.breakpoints[i].count = list[i].count;
+            snap.breakpoints[i].hits = list[i].hits;
+        }
+    }
+    snap.tracepointCount = breakpoints.logged;
+    const size_t lastLog = std::min<size_t>(breakpoints.log.size(), 16);
+    snap.tracepointHits.assign(breakpoints.log.end() - lastLog, breakpoints.log.end());
+
+    snap.watchChanges.resize(watch.Signals().size());
+    for (size_t i = 0; i < snap.watchChanges.size(); i++) {
+        snap.watchChanges[i] = watch.Signals()[i].changes;
+    }
+    snap.watchpoints = watch.Watchpoints();
+    snap.watchHitCount = watch.hitCount;
+    const size_t lastHits = std::min<size_t>(watch.hits.size(), 16);
+    snap.watchHits.assign(watch.hits.end() - lastHits, watch.hits.end());
+    snap.profile = profile.Publish();
+    snap.profiling = profile.Active();
+    snap.callGraph = callGraph.Publish();
+    snap.callGraphing = callGraph.enabled;
+    snap.checkpointDiff = checkpointDiff;
+
+    const size_t recent = std::min<size_t>(commandLog.size(), 8);
+    snap.recentCommands.assign(commandLog.end() - recent, commandLog.end());
+
+    snap.data.resize(size);
+    memcpy(snap.data.data(), avr->data, size);
+
+    // io and flash that changed since the last snapshot the UI took. one it never picked
+    // up is dropped by the triple buffer, so its changes carry over into this one
+    const bool taken = snapshot.Taken();
+    if (taken) {
+        unseenFlash = FlashRange();
+    }
+    MarkFlash(unseenFlash, writtenFlash.start, writtenFlash.end);
+    writtenFlash = FlashRange();
+    snap.dirtyFlash = unseenFlash;
+
+    publishedIo.resize(ioend, 0);
+    unseenIo.resize(ioend, 0);
+    if (taken) {
+        std::fill(unseenIo.begin(), unseenIo.end(), 0);
+    }
+    snap.dirtyIo.clear();
+    for (uint16_t a = 32; a < ioend; a++) {
+        if (publishedIo[a] != avr->data[a]) {
+            unseenIo[a] = 1;
+            publishedIo[a] = avr->data[a];
+        }
+        if (!unseenIo[a]) {
+            continue;
+        }
+        if (!snap.dirtyIo.empty() && snap.dirtyIo.back().end == a) {
+            snap.dirtyIo.back().end = a + 1;
+        } else {
+            snap.dirtyIo.push_back({ a, (uint16_t)(a + 1) });
+        }
+    }
+
+    snapshot.Publish();
+}
+
+RunStats AvrSimulator::RunHeadless(const HeadlessLimits &limits)
+{
+    RunStats stats;
+
+    if (!avr) {
+        std::cerr << "AVR Simulator not initialised." << std::endl;
+        stats.reason = "error";
+        return stats;
+    }
+
+    const avr_cycle_count_t startCycle = avr->cycle;
+    avr_cycle_count_t stopCycle = UINT64_MAX;
+
+    if (limits.cycles) {
+        stopCycle = startCycle + limits.cycles;
+    }
+
+    avr_cycle_count_t timeCycle = UINT64_MAX;
+    if (limits.usec) {
+        timeCycle = startCycle + (avr_cycle_count_t)((double)limits.usec * avr->frequency / 1000000.0);
+    }
+
+    stats.reason = "cycles";
+    if (timeCycle < stopCycle) {
+        stopCycle = timeCycle;
+        stats.reason = "time";
+    }
+
+    // checks the stop flag between quanta rather than per instruction
+    const avr_cycle_count_t quantum = 100000;
+    const uint64_t startInstructions = instructions;
+
+    auto start = std::chrono::steady_clock::now();
+
+    state = avr->state;
+    while (avr->cycle < stopCycle) {
+
+        state = RunQuantum(std::min(quantum, stopCycle - avr->cycle));
+
+        if (state == cpu_Done) {
+            stats.reason = "done";
+            break;
+        }
+        if (state == cpu_Crashed) {
+            stats.reason = "crashed";
+            break;
+        }
+        if (watch.triggered) {
+            stats.reason = "watch";
+            break;
+        }
+        if (breakpoints.triggered) {
+            stats.reason = "breakpoint";
+            break;
+        }
+        if (limits.stop && *limits.stop) {
+            stats.reason = "signal";
+            break;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    stats.instructions = instructions - startInstructions;
+    stats.cycles = avr->cycle - startCycle;
+    stats.wallSeconds = std::chrono::duration<double>(end - start).count();
+    stats.mhz = stats.wallSeconds > 0 ? stats.cycles / stats.wallSeconds / 1000000.0 : 0;
+    stats.state = state;
+
+    return stats;
+}
 
 ///////avrdisasm
 void Display_Registers() {
@@ -299,7 +1525,8 @@ int Match_Opcode(char *Bitmask, char *Bitstream) {
 	return 1;
 }
 
-int Get_Next_Opcode(char *Bitstream) {
+/* Reference matcher, walks every bitmask string. Kept for Benchmark_Opcode_Decode() */
+int Get_Next_Opcode_Linear(char *Bitstream) {
 	int i;
 	for (i = 0; i < Number_Opcodes; i++) {
 		if (Match_Opcode(Opcodes[i].Opcode_String, Bitstream) == 1) {
@@ -309,6 +1536,150 @@ int Get_Next_Opcode(char *Bitstream) {
 	return -1;
 }
 
+static int Compile_Opcode(const char *Bitmask, struct Compiled_Opcode *Compiled) {
+	int Bit = 31;
+	int i;
+
+	memset(Compiled, 0, sizeof(*Compiled));
+
+	for (; *Bitmask; Bitmask++) {
+		if (*Bitmask == ' ') continue;
+		if (Bit < 0) return 0;
+
+		if ((*Bitmask == '0') || (*Bitmask == '1')) {
+			Compiled->Mask |= 1u << Bit;
+			if (*Bitmask == '1') Compiled->Value |= 1u << Bit;
+		} else {
+			/* Register bit, extend the current run of this field or start a new one */
+			struct Compiled_Field *Field = NULL;
+			for (i = 0; i < Compiled->Field_Count; i++) {
+				if (Compiled->Fields[i].Name == (unsigned char)*Bitmask) Field = &Compiled->Fields[i];
+			}
+			if (Field == NULL) {
+				if (Compiled->Field_Count == 8) return 0;
+				Field = &Compiled->Fields[Compiled->Field_Count++];
+				Field->Name = (unsigned char)*Bitmask;
+			}
+			if ((Field->Runs > 0) && (Field->Shift[Field->Runs - 1] == Bit + 1)) {
+				Field->Shift[Field->Runs - 1] = Bit;
+				Field->Width[Field->Runs - 1]++;
+			} else {
+				if (Field->Runs == 16) return 0;
+				Field->Shift[Field->Runs] = Bit;
+				Field->Width[Field->Runs] = 1;
+				Field->Runs++;
+			}
+		}
+		Bit--;
+	}
+	Compiled->Length = (31 - Bit) / 8;
+	return 1;
+}
+
+static void Build_Opcode_Table() {
+	int i;
+	for (i = 0; i < 65536; i++) Opcode_Table[i] = -1;
+
+	/* Walk backwards so the most specific opcode ends up owning each word */
+	for (i = Number_Opcodes - 1; i >= 0; i--) {
+		unsigned int Mask = Compiled_Opcodes[i].Mask >> 16;
+		unsigned int Value = Compiled_Opcodes[i].Value >> 16;
+		unsigned int Free = ~Mask & 0xffff;
+		unsigned int Sub = 0;
+		do {
+			Opcode_Table[Value | Sub] = i;
+			Sub = (Sub - Free) & Free;
+		} while (Sub);
+	}
+}
+
+static void Extract_Registers(const struct Compiled_Opcode *Compiled, uint32_t Word) {
+	int i, j;
+	Clear_Registers();
+	for (i = 0; i < Compiled->Field_Count; i++) {
+		const struct Compiled_Field *Field = &Compiled->Fields[i];
+		int Value = 0;
+		for (j = 0; j < Field->Runs; j++) {
+			Value = (Value << Field->Width[j]) | ((Word >> Field->Shift[j]) & ((1u << Field->Width[j]) - 1));
+		}
+		Registers[Field->Name] = Value;
+	}
+}
+
+int Get_Next_Opcode(char *Bitstream) {
+	const unsigned char *Bytes = (const unsigned char*)Bitstream;
+	uint32_t Word = ((uint32_t)Bytes[1] << 24) | ((uint32_t)Bytes[0] << 16);
+	int i = Opcode_Table[Word >> 16];
+
+	if (i == -1) return -1;
+	if (Compiled_Opcodes[i].Length == 2) {
+		Extract_Registers(&Compiled_Opcodes[i], Word);
+		return i;
+	}
+
+	/* Two word opcode, the second word may still hold identification bits */
+	Word |= ((uint32_t)Bytes[3] << 8) | Bytes[2];
+	for (; i < Number_Opcodes; i++) {
+		if ((Word & Compiled_Opcodes[i].Mask) == Compiled_Opcodes[i].Value) {
+			Extract_Registers(&Compiled_Opcodes[i], Word);
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Decode every possible first opcode word with both matchers, check they agree and time them */
+int Benchmark_Opcode_Decode() {
+	static int Linear_Registers[256];
+	unsigned char Bitstream[4] = { 0, 0, 0x34, 0x12 };
+	const int Passes = 16;
+	int Mismatches = 0;
+	long Checksum = 0;
+	int Word, Pass;
+
+	for (Word = 0; Word < 65536; Word++) {
+		int Linear, Table;
+		Bitstream[0] = Word & 0xff;
+		Bitstream[1] = Word >> 8;
+
+		Linear = Get_Next_Opcode_Linear((char*)Bitstream);
+		memcpy(Linear_Registers, Registers, sizeof(Registers));
+		Table = Get_Next_Opcode((char*)Bitstream);
+
+		if ((Linear != Table) || ((Linear != -1) && memcmp(Linear_Registers, Registers, sizeof(Registers)))) {
+			if (Mismatches++ < 16) {
+				fprintf(stderr, "Decode mismatch for 0x%04x: linear %d, table %d\n", Word, Linear, Table);
+			}
+		}
+	}
+
+	auto Start = std::chrono::steady_clock::now();
+	for (Pass = 0; Pass < Passes; Pass++) {
+		for (Word = 0; Word < 65536; Word++) {
+			Bitstream[0] = Word & 0xff;
+			Bitstream[1] = Word >> 8;
+			Checksum += Get_Next_Opcode_Linear((char*)Bitstream);
+		}
+	}
+	auto Middle = std::chrono::steady_clock::now();
+	for (Pass = 0; Pass < Passes; Pass++) {
+		for (Word = 0; Word < 65536; Word++) {
+			Bitstream[0] = Word & 0xff;
+			Bitstream[1] = Word >> 8;
+			Checksum -= Get_Next_Opcode((char*)Bitstream);
+		}
+	}
+	auto End = std::chrono::steady_clock::now();
+
+	double Linear_ns = std::chrono::duration<double, std::nano>(Middle - Start).count() / (Passes * 65536.0);
+	double Table_ns = std::chrono::duration<double, std::nano>(End - Middle).count() / (Passes * 65536.0);
+
+	printf("opcode decode: %d patterns, linear %.1f ns/word, table %.1f ns/word, speedup %.1fx, %d mismatches (checksum %ld)\n",
+		Number_Opcodes, Linear_ns, Table_ns, Linear_ns / Table_ns, Mismatches, Checksum);
+
+	return Mismatches;
+}
+
 int Get_Specifity(char *Opcode) {
 	size_t i;
 	int Specifity = 0;
@@ -544,130 +1915,341 @@ int setupAVRDisasm()
 
 	qsort(Opcodes, Number_Opcodes, sizeof(struct Opcode), Comparison);
 
+	for (int i = 0; i < Number_Opcodes; i++) {
+		if (!Compile_Opcode(Opcodes[i].Opcode_String, &Compiled_Opcodes[i])) {
+			fprintf(stderr, "Error: Cannot compile bitmask '%s'.\n", Opcodes[i].Opcode_String);
+			return 0;
+		}
+	}
+	Build_Opcode_Table();
+
     return 1;
 }
 
 extern "C" int Get_JumpCall_Count();
 extern "C" struct JumpCall *Get_JumpCall();
 
-/* Show all references which refer to "Position" as destination */
-void Print_JumpCallsIM(int Position) {
-	int i;
-	int Match = 0;
-	
-    struct JumpCall *JumpCalls = Get_JumpCall();
+const char *Get_MNemonic_Name(int Type) {
+	return MNemonic[Type];
+}
 
-	for (i = 0; i < Get_JumpCall_Count(); i++) {
-		if ((JumpCalls[i].To) == Position) {
-			if (Match == 0) {
-				Match = 1;
-			}
-			ImGui::Text("; Referenced from offset 0x%02x by %s", JumpCalls[i].From, MNemonic[JumpCalls[i].Type]);
-            break;
-		}
-	}
-	if (Match == 1) {
-		char *LabelName;
-		char *LabelComment = NULL;
-		LabelName = Get_Label_Name(Position, &LabelComment);
-		if (LabelComment == NULL) {
-			 ImGui::Text("%s:", LabelName);
-		} else {
-			 ImGui::Text("%s:     ; %s", LabelName, LabelComment);
+void XRefIndex::Build(const std::vector<DisasmLine> &lines)
+{
+	/* avrdisas keeps every record it ever registered, overwritten instructions included,
+	   so only what the current lines decoded to counts */
+	byTarget.clear();
+	for (const DisasmLine &Line : lines) {
+		if (Line.target >= 0) {
+			byTarget.push_back({ Line.address, (uint32_t)Line.target, Line.targetType });
 		}
 	}
-}
 
+	std::sort(byTarget.begin(), byTarget.end(), [](const XRef &a, const XRef &b) {
+		return a.to != b.to ? a.to < b.to : a.from < b.from;
+	});
 
+	bySource = byTarget;
+	std::sort(bySource.begin(), bySource.end(), [](const XRef &a, const XRef &b) {
+		return a.from != b.from ? a.from < b.from : a.to < b.to;
+	});
+}
+
+XRefRange XRefIndex::To(uint32_t addr) const
+{
+	auto Range = std::equal_range(byTarget.begin(), byTarget.end(), XRef{ 0, addr, 0 },
+		[](const XRef &a, const XRef &b) { return a.to < b.to; });
+	return { byTarget.data() + (Range.first - byTarget.begin()), byTarget.data() + (Range.second - byTarget.begin()) };
+}
 
-void Disasm(char *Bitstream, int Pos, int Read)
+XRefRange XRefIndex::From(uint32_t addr) const
 {
-   	int Opcode;
+	auto Range = std::equal_range(bySource.begin(), bySource.end(), XRef{ addr, 0, 0 },
+		[](const XRef &a, const XRef &b) { return a.from < b.from; });
+	return { bySource.data() + (Range.first - bySource.begin()), bySource.data() + (Range.second - bySource.begin()) };
+}
 
-    for(int j=0; j < 5 ; j++)
-    {
-		int Added;
+/* Show all references which refer to "Position" as destination, followed by its label */
+static void Get_JumpCalls(const XRefIndex &XRefs, int Position, std::vector<DisasmNote> &Notes) {
+	char Buffer[256];
+	XRefRange Refs = XRefs.To(Position);
 
+	if (Refs.empty()) {
+		return;
+	}
 
+	for (const XRef &Ref : Refs) {
+		snprintf(Buffer, sizeof(Buffer), "; Referenced from offset 0x%02x by %s", Ref.from, MNemonic[Ref.type]);
+		Notes.push_back({ Buffer, (int32_t)Ref.from });
+	}
 
-		/* Check if this is actually code or maybe only data from tagfile */
+	char *LabelName;
+	char *LabelComment = NULL;
+	LabelName = Get_Label_Name(Position, &LabelComment);
+	if (LabelComment == NULL) {
+		snprintf(Buffer, sizeof(Buffer), "%s:", LabelName);
+	} else {
+		snprintf(Buffer, sizeof(Buffer), "%s:     ; %s", LabelName, LabelComment);
+	}
+	Notes.push_back({ Buffer, -1 });
+}
+
+/* Decode one instruction at Pos of the cached image into Line, returns its length */
+uint32_t DisasmCache::DecodeLine(uint32_t Pos, DisasmLine &Line) {
+	char *Bitstream = (char*)image.data();
+	char Buffer[512];
+	int Opcode, Added;
+	size_t Used = 0;
+
+	Line.address = Pos;
+	Line.cycles = NULL;
+	Line.text.clear();
+	Line.notes.clear();
+	Line.target = -1;
+	Line.targetType = 0;
+	Line.dataContinued = Pos < dataEnd;
+
+	/* Check if this is actually code or maybe only data from tagfile. A region goes out
+	   16 bytes a line, the lines after its first don't ask the tagfile again */
+	if (Pos >= dataEnd) {
 		Added = Tagfile_Process_Data(Bitstream, Pos);
 		if (Added != 0) {
-			/* Data was added */
-			Pos += Added;
-			return;
+			dataEnd = Pos + Added;
 		}
-		if( j == 0 ){
-		    ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 1.0f, 0.0f, 1.0f));
+	}
+	if (Pos < dataEnd) {
+		uint32_t Count = std::min(std::min(dataEnd, size) - Pos, (uint32_t)16);
+		char Ascii[17];
+		Used = snprintf(Buffer, sizeof(Buffer), ".db ");
+		for (uint32_t i = 0; i < Count; i++) {
+			unsigned char Byte = Bitstream[Pos + i];
+			Used += snprintf(Buffer + Used, sizeof(Buffer) - Used, i ? ", 0x%02x" : "0x%02x", Byte);
+			Ascii[i] = isprint(Byte) ? Byte : '.';
 		}
+		Ascii[Count] = 0;
+		snprintf(Buffer + Used, sizeof(Buffer) - Used, "    ; %s", Ascii);
+		Line.length = Count;
+		Line.text = Buffer;
+		return Count;
+	}
 
-		Opcode = Get_Next_Opcode(Bitstream + Pos);
-		if (Opcode != -1) {
-			Code_Line[0] = 0;
-			Comment_Line[0] = 0;
-			After_Code_Line[0] = 0;
-			Opcodes[Opcode].Callback(Bitstream + Pos, Pos, Opcodes[Opcode].MNemonic);
-			
-			if (Options.Process_Labels) {
-				Print_JumpCallsIM(Pos);
-			}
-				
-			if (Options.Show_Addresses) {
-                ImGui::Text("0x%04x:   ", Pos);
-                ImGui::SameLine();
-            }
+	Opcode = Get_Next_Opcode(Bitstream + Pos);
+	if (Opcode == -1) {
+		snprintf(Buffer, sizeof(Buffer), ".word 0x%02x%02x    ; Invalid opcode at 0x%04x (%d). Disassembler skipped two bytes.",
+			(unsigned char)Bitstream[Pos + 1], (unsigned char)Bitstream[Pos], Pos, Pos);
+		Line.length = 2;
+		Line.text = Buffer;
+		return 2;
+	}
 
-			if (Options.Show_Cycles) {
-				const char *Cycle = Cycles[Opcodes[Opcode].MNemonic];
-                if (!Cycle) {
-                    ImGui::Text("      ");
-                } else {
-                    ImGui::Text("[%-3s] ", Cycle);
-                }
-			}
+	Code_Line[0] = 0;
+	Comment_Line[0] = 0;
+	After_Code_Line[0] = 0;
+	int Registered = Get_JumpCall_Count();
+	Opcodes[Opcode].Callback(Bitstream + Pos, Pos, Opcodes[Opcode].MNemonic);
+
+	/* the jump/call this decode registered, the array may have moved */
+	struct JumpCall *JumpCalls = Get_JumpCall();
+	for (int i = Get_JumpCall_Count() - 1; i >= Registered; i--) {
+		if ((uint32_t)JumpCalls[i].From == Pos) {
+			Line.target = JumpCalls[i].To;
+			Line.targetType = JumpCalls[i].Type;
+			break;
+		}
+	}
 
-	        if (Options.Show_Opcodes) {
-                ImGui::Text(" "); // Start with a space
-                for (int i = 0; i < (Get_Bitmask_Length(Opcodes[Opcode].Opcode_String)) / 8; i++) {
-                    ImGui::SameLine();
-                    ImGui::Text("%02x ", (unsigned char)(Bitstream[Pos+i]));
-                }
-                for (int i = 0; i < 5 - ((Get_Bitmask_Length(Opcodes[Opcode].Opcode_String)) / 8); i++) {
-                    ImGui::SameLine();
-                    ImGui::Text("   ");
-                }
-            }
-				
-			if (Code_Line[0] == 0) {
-				/* No code was generated? */
-                ImGui::Text("; - Not implemented opcode: %d -", Opcodes[Opcode].MNemonic);
+	Line.length = Compiled_Opcodes[Opcode].Length;
+	if (Options.Show_Cycles) {
+		Line.cycles = Cycles[Opcodes[Opcode].MNemonic];
+	}
+
+	if (Options.Show_Opcodes) {
+		Buffer[Used++] = ' ';
+		for (int i = 0; i < 5; i++) {
+			if (i < Compiled_Opcodes[Opcode].Length) {
+				Used += snprintf(Buffer + Used, sizeof(Buffer) - Used, "%02x ", (unsigned char)(Bitstream[Pos + i]));
 			} else {
-				if ((Comment_Line[0] == 0) || (!Options.Show_Comments)) {
-					/* No comment */
-                    ImGui::Text("%s", Code_Line);
-
-				} else {
-					/* Comment available */
-					if (!Options.Show_PseudoCode) {
-                        ImGui::SameLine();
-                        ImGui::Text("%-35s ; %s", Code_Line, Comment_Line);
-					} else {
-                        ImGui::SameLine();
-                        ImGui::Text("%-35s ; %s", Code_Line, Comment_Line);
-					}
-				}
+				Used += snprintf(Buffer + Used, sizeof(Buffer) - Used, "   ");
 			}
-            ImGui::SameLine();
-            ImGui::Text("%s", After_Code_Line);
+		}
+	}
 
-			Pos += Get_Bitmask_Length(Opcodes[Opcode].Opcode_String) / 8;
+	if (Code_Line[0] == 0) {
+		/* No code was generated? */
+		Used += snprintf(Buffer + Used, sizeof(Buffer) - Used, "; - Not implemented opcode: %d -", Opcodes[Opcode].MNemonic);
+	} else if ((Comment_Line[0] == 0) || (!Options.Show_Comments)) {
+		/* No comment */
+		Used += snprintf(Buffer + Used, sizeof(Buffer) - Used, "%s", Code_Line);
+	} else {
+		/* Comment available */
+		Used += snprintf(Buffer + Used, sizeof(Buffer) - Used, "%-35s ; %s", Code_Line, Comment_Line);
+	}
+	if ((After_Code_Line[0] != 0) && (Used < sizeof(Buffer))) {
+		snprintf(Buffer + Used, sizeof(Buffer) - Used, " %s", After_Code_Line);
+	}
+
+	Line.text = Buffer;
+	return Line.length;
+}
+
+void DisasmCache::Build(const uint8_t *flash, uint32_t flashSize)
+{
+	std::lock_guard<std::mutex> Guard(Disasm_Lock);
+
+	lines.clear();
+	size = flashSize;
+
+	/* padded so a two word opcode at the very end does not read past the copy */
+	image.assign(size + 4, 0);
+	memcpy(image.data(), flash, size);
+
+	if (Number_Opcodes == 0) {
+		UpdateRows();
+		return;
+	}
+
+	dataEnd = 0;
+	for (uint32_t Pos = 0; Pos < size; ) {
+		DisasmLine Line;
+		Pos += DecodeLine(Pos, Line);
+		lines.push_back(std::move(Line));
+	}
+
+	xrefs.Build(lines);
+	for (auto &Line : lines) {
+		UpdateNotes(Line);
+	}
+	UpdateRows();
+}
+
+void DisasmCache::UpdateNotes(DisasmLine &Line)
+{
+	Line.notes.clear();
+	if (Options.Process_Labels) {
+		Get_JumpCalls(xrefs, Line.address, Line.notes);
+	}
+
+	/* an elf symbol starting here names the line instead of the generated label */
+	const Symbol *Sym = symbols ? symbols->At(SYMBOL_FLASH, Line.address) : NULL;
+	if (Sym) {
+		std::string Label = Sym->name + ":";
+		if (!Line.notes.empty() && Line.notes.back().jump < 0) {
+			Line.notes.back().text = Label;
 		} else {
-            ImGui::Text(".word 0x%02x%02x    ; Invalid opcode at 0x%04x (%d). Disassembler skipped two bytes.",
-                        Bitstream[Pos + 1], Bitstream[Pos], Pos, Pos);
-			Pos += 2;
+			Line.notes.push_back({ Label, -1 });
+		}
+	}
+}
+
+void DisasmCache::UpdateRows()
+{
+	rows.clear();
+	rowIndex.assign((size + 1) / 2, -1);
+
+	for (size_t i = 0; i < lines.size(); i++) {
+		for (size_t n = 0; n < lines[i].notes.size(); n++) {
+			rows.push_back({ (int)i, (int)n });
 		}
-		if( j == 0 ){
-    		ImGui::PopStyleColor();
+		for (uint32_t a = lines[i].address; a < lines[i].address + lines[i].length && a < size; a += 2) {
+			rowIndex[a / 2] = rows.size();
 		}
+		rows.push_back({ (int)i, -1 });
 	}
-}
\ No newline at end of file
+}
+
+bool DisasmCache::Refresh(const uint8_t *flash, uint32_t addr, uint32_t len)
+{
+	if (!flash || image.empty() || addr >= size) {
+		return false;
+	}
+
+	uint32_t First = addr, Last = std::min(addr + len, size);
+	if (memcmp(image.data() + First, flash + First, Last - First) == 0) {
+		return false;
+	}
+
+	/* narrow down to the bytes that actually differ */
+	while (image[First] == flash[First]) First++;
+	while (image[Last - 1] == flash[Last - 1]) Last--;
+
+	memcpy(image.data() + First, flash + First, Last - First);
+	Invalidate(First, Last - First);
+	return true;
+}
+
+void DisasmCache::Invalidate(uint32_t addr, uint32_t len)
+{
+	if (lines.empty() || addr >= size) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> Guard(Disasm_Lock);
+
+	uint32_t End = std::min(addr + len, size);
+
+	/* first line covering the change */
+	auto First = std::upper_bound(lines.begin(), lines.end(), addr,
+		[](uint32_t a, const DisasmLine &l) { return a < l.address; });
+	if (First != lines.begin()) {
+		--First;
+	}
+	size_t FirstIndex = First - lines.begin();
+	while (FirstIndex > 0 && lines[FirstIndex].dataContinued) {
+		FirstIndex--;
+	}
+
+	/* re-decode until we are past the change and back on an old instruction boundary */
+	std::vector<DisasmLine> Fresh;
+	size_t LastIndex = FirstIndex;
+	uint32_t Pos = lines[FirstIndex].address;
+	dataEnd = 0;
+	while (Pos < size) {
+		DisasmLine Line;
+		Pos += DecodeLine(Pos, Line);
+		Fresh.push_back(std::move(Line));
+
+		while (LastIndex < lines.size() && lines[LastIndex].address < Pos) {
+			LastIndex++;
+		}
+		if (Pos >= End && (LastIndex == lines.size() || lines[LastIndex].address == Pos)) {
+			break;
+		}
+	}
+
+	/* notes change on the new lines and wherever an old or a new reference points */
+	std::vector<uint32_t> Targets;
+	for (size_t i = FirstIndex; i < LastIndex; i++) {
+		if (lines[i].target >= 0) {
+			Targets.push_back(lines[i].target);
+		}
+	}
+	for (const DisasmLine &Line : Fresh) {
+		if (Line.target >= 0) {
+			Targets.push_back(Line.target);
+		}
+	}
+
+	size_t FreshCount = Fresh.size();
+	lines.erase(lines.begin() + FirstIndex, lines.begin() + LastIndex);
+	lines.insert(lines.begin() + FirstIndex, std::make_move_iterator(Fresh.begin()), std::make_move_iterator(Fresh.end()));
+
+	xrefs.Build(lines);
+	for (size_t i = FirstIndex; i < FirstIndex + FreshCount; i++) {
+		UpdateNotes(lines[i]);
+	}
+	for (uint32_t Target : Targets) {
+		auto Line = std::lower_bound(lines.begin(), lines.end(), Target,
+			[](const DisasmLine &l, uint32_t a) { return l.address < a; });
+		if (Line != lines.end() && Line->address == Target) {
+			UpdateNotes(*Line);
+		}
+	}
+	UpdateRows();
+}
+
+int DisasmCache::RowForAddress(uint32_t addr) const
+{
+	if (addr / 2 >= rowIndex.size()) {
+		return -1;
+	}
+	return rowIndex[addr / 2];
+}
@@ -2,39 +2,261 @@
 #define AVRSIMULATOR_H
 
 #include <string>
-#include <GLFW/glfw3.h>
 
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <vector>
+#include <signal.h>
 
 
 #include "sim_avr.h"
 #include "sim_elf.h"
 #include "sim_gdb.h"
 
+#include "simgetsnapshot.h"
+#include "simgetcommand.h"
+#include "simgetcheckpoint.h"
+#include "simgetspinner.h"
+#include "simgetpov.h"
+#include "simgetvcd.h"
+#include "simgettrace.h"
+#include "simgetwatch.h"
+#include "simgetprofile.h"
+#include "simgetcallgraph.h"
+#include "simgetsymbols.h"
+#include "simgetbreak.h"
+
+#include <deque>
+
+// a jump/call/branch record from the disassembler
+struct XRef {
+    uint32_t from;                      // byte address of the referring instruction
+    uint32_t to;                        // byte address of the destination
+    int type;                           // avrdisas mnemonic of the referring instruction
+};
+
+struct XRefRange {
+    const XRef *first = nullptr, *last = nullptr;
+    const XRef *begin() const { return first; }
+    const XRef *end() const { return last; }
+    bool empty() const { return first == last; }
+    size_t size() const { return last - first; }
+};
+
+struct DisasmLine;
+
+// jump/call cross references, sorted by destination with a reverse index by source
+class XRefIndex {
+public:
+    void Build(const std::vector<DisasmLine> &lines);   // from each line's decoded target
+    XRefRange To(uint32_t addr) const;  // everything referring to addr
+    XRefRange From(uint32_t addr) const;// everything the instruction at addr refers to
+    size_t Size() const { return byTarget.size(); }
+
+private:
+    std::vector<XRef> byTarget;
+    std::vector<XRef> bySource;
+};
+
+// label or reference line shown above an instruction
+struct DisasmNote {
+    std::string text;
+    int32_t jump;                       // address to go to when selected, -1 if none
+};
+
+// one decoded instruction (or data/invalid word) of the disassembly
+struct DisasmLine {
+    uint32_t address;                   // byte address in flash
+    uint8_t length;                     // in bytes
+    const char *cycles;                 // avrdisas cycle string, may be null
+    std::string text;                   // preformatted opcode bytes, code and comment
+    std::vector<DisasmNote> notes;      // label/reference lines shown above the instruction
+    int32_t target = -1;                // jump/call destination, -1 if none
+    int targetType = 0;                 // avrdisas mnemonic of the jump/call
+    bool dataContinued = false;         // a tagfile data region's later bytes, decoding starts before it
+};
+
+// a display row, either the instruction of a line or one of its notes
+struct DisasmRow {
+    int line;
+    int note;                           // -1 for the instruction itself
+};
+
+// whole image disassembly, built once at firmware load and patched when flash changes
+class DisasmCache {
+public:
+    void Build(const uint8_t *flash, uint32_t size);
+
+    // copy a written range of flash (SimSnapshot::dirtyFlash) over the one the cache was
+    // decoded from and re-decode what changed. returns true if anything did
+    bool Refresh(const uint8_t *flash, uint32_t addr, uint32_t len);
+    void Invalidate(uint32_t addr, uint32_t len);
+
+    // row of the instruction covering a flash byte address, -1 if none
+    int RowForAddress(uint32_t addr) const;
+
+    const std::vector<DisasmLine> &Lines() const { return lines; }
+    const std::vector<DisasmRow> &Rows() const { return rows; }
+    const XRefIndex &XRefs() const { return xrefs; }
+
+    // elf symbols label their lines in place of the avrdisas guesses, set before Build
+    const SymbolIndex *symbols = nullptr;
+
+private:
+    uint32_t DecodeLine(uint32_t pos, DisasmLine &line);
+    void UpdateNotes(DisasmLine &line);
+    void UpdateRows();
+
+    std::vector<DisasmLine> lines;
+    std::vector<DisasmRow> rows;
+    std::vector<int32_t> rowIndex;      // per flash word, row of the covering instruction
+    std::vector<uint8_t> image;         // flash contents the cache was decoded from
+    XRefIndex xrefs;
+    uint32_t size = 0;
+    uint32_t dataEnd = 0;               // end of the tagfile data region being decoded
+};
+
+// stop conditions for a headless run, 0 means no limit
+struct HeadlessLimits {
+    uint64_t cycles = 0;                            // simulated cycles
+    uint64_t usec = 0;                              // simulated time
+    const volatile sig_atomic_t *stop = nullptr;    // set from a signal handler to stop early
+};
+
+// what a headless run did
+struct RunStats {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    double wallSeconds = 0;
+    double mhz = 0;                                 // simulated cycles per wall clock microsecond
+    int state = 0;
+    const char *reason = "";                        // cycles, time, done, crashed, watch or signal
+};
+
+const char *GetAvrStateName(int state);
+
 class AvrSimulator {
 public:
     AvrSimulator();
     ~AvrSimulator();
 
     bool Initialize(const std::string& mcu_type, const std::string& firmware_file, uint32_t frequency, int gdb_port = 0);
+    // raw flash image at address 0, for generated firmware
+    bool Initialize(const std::string& mcu_type, const std::vector<uint8_t>& image, uint32_t frequency);
     int Run();
     void Cleanup();
+    // as many instructions as animateRate owes since the last call, none if less than one
     int RunAnimate();
+    // wall time until the next instruction is owed
+    double AnimateDueUsec() const;
+
+    // run avr_run in a tight loop on the calling thread until a limit or done/crashed
+    RunStats RunHeadless(const HeadlessLimits &limits);
+
+    // execute instructions until at least 'cycles' have passed or the cpu is done/crashed
+    int RunQuantum(avr_cycle_count_t cycles);
+
+    uint64_t instructions = 0;  // instructions executed since Initialize
+
+    // sim thread only, copy the machine state out for the UI
+    void PublishSnapshot();
+    TripleBuffer<SimSnapshot> snapshot;
 
     void Reset(){
         avr_reset(avr);
+        if (stimulus) {
+            stimulus->Arm(avr);
+        }
+        if (rotor) {
+            rotor->Arm(avr);
+        }
+        profile.Arm(avr);
+        callGraph.Unwind();
     }
+
+    // whole machine as one flat blob: cpu, sram/io, flash, eeprom, pending cycle
+    // timers and interrupts, pin levels and what the timers, uarts and adcs keep outside
+    // their registers. only valid for this instance, it holds pointers into the avr_t.
+    void SaveState(std::vector<uint8_t> &blob) const;
+    bool LoadState(const std::vector<uint8_t> &blob);
+
+    // back to the state captured at the end of Initialize, without reloading firmware
+    bool Restart();
+
+    // sim thread keeps a checkpoint every checkpointEvery cycles (0 = off)
+    avr_cycle_count_t checkpointEvery = 0;
+    CheckpointRing checkpoints;
+    void TakeCheckpoint();
+    bool RestoreCheckpoint(size_t index);
+
+    // sram/io of the checkpoints taken on two cycles compared, the result goes out with the snapshots
+    bool DiffCheckpoints(avr_cycle_count_t cycleA, avr_cycle_count_t cycleB);
+    std::shared_ptr<const DataDiff> checkpointDiff;
+
+    // time travel over the checkpoint ring. restore the newest checkpoint before the
+    // target and re-execute forward, re-applying logged input at the cycles it hit.
+    // history after the current cycle is kept until new input diverges from it.
+    bool Seek(avr_cycle_count_t target);
+    bool ReverseStep();
+    bool ReverseContinue();
+    avr_cycle_count_t timelineEnd = 0;      // furthest cycle reached in this timeline
+
+    // flash byte addresses, checked after every instruction while any is set
+    BreakpointTable breakpoints;
+
     int state;                  // state of avr
 
     avr_t* avr;                 // pointer to the AVR simulator instance
     
+    // owned by the sim thread, the UI changes them through commands
     bool animate = false;
     bool run = false;
-    bool step = false;
+    bool step = false;          // a run control target is pending, see runTo
+
+    // step/over/out/run to/run cycles, run flat out on the sim thread until met
+    enum {
+        UNTIL_STEP,             // the next instruction boundary
+        UNTIL_PC,               // pc reached with SP at or above sp
+        UNTIL_RETURN,           // a ret/reti left SP above sp
+        UNTIL_CYCLE,
+    };
+    struct RunTarget {
+        int until = UNTIL_STEP;
+        avr_flashaddr_t pc = 0;
+        uint16_t sp = 0;
+        avr_cycle_count_t cycle = 0;
+    } runTo;
+    void SetRunTarget(const SimCommand &cmd);
+    // at most 'cycles' towards runTo, true once met or stopped by a breakpoint, watchpoint or the cpu
+    bool RunTowards(avr_cycle_count_t cycles);
+
+    // UI -> sim thread, drained between instructions
+    SpscQueue<SimCommand, 1024> commands;
+    std::deque<SimCommand> commandLog;     // applied commands with the cycle they took effect
+
+    // sim thread only, returns true if run/animate/step/reset changed
+    bool ApplyCommands();
     
-    uint32_t animateDelay = 1;
+    // animate pace, sim thread, CMD_ANIMATE_RATE from the UI
+    enum {
+        ANIMATE_INSTRUCTIONS,   // instructions per wall second
+        ANIMATE_SIM_USEC,       // simulated microseconds per wall second
+    };
+    int animateUnit = ANIMATE_INSTRUCTIONS;
+    double animateRate = 1000;
+    double animateAchieved = 0;         // measured over the last half second, in animateUnit
+
+    DisasmCache disasm;         // disassembly of the loaded firmware
+    bool disassemble = true;    // build disasm on Initialize, sweeps turn it off
+    VcdStimulus *stimulus = nullptr;    // --input, attached on Initialize
+    SpinnerRotor *rotor = nullptr;      // --rpm, attached on Initialize
+    PovImage *pov = nullptr;            // led capture, resynced when the state jumps
+    InstructionTrace *trace = nullptr;  // --trace, fed every instruction
+    DataWatch watch;                    // data space watches, reset on Initialize
+    Profiler profile;                   // per flash word counters, off until started
+    CallGraph callGraph;                // shadow call stack, off until started
+    SymbolIndex symbols;                // from the elf on Initialize, read only after that
 private:
     std::string mcu_type;       // type of AVR microcontroller to simulate
     std::string firmware_file;  // path to the firmware file
@@ -45,6 +267,43 @@ private:
     uint32_t loadBase = AVR_SEGMENT_OFFSET_FLASH;
     elf_firmware_t f = {{0}};
 
+    std::chrono::steady_clock::time_point lastAnimate;  // per instance, several simulators can animate
+    std::chrono::steady_clock::time_point animateWindow;
+    double animateBudget = 0;           // units owed, the fraction carries between calls
+    double animateCount = 0;            // units run in the current measuring window
+    void StartAnimate();
+
+    void FinishInitialize();
+
+    std::vector<uint8_t> powerOn;           // SaveState right after Initialize
+    std::vector<avr_irq_t *> pinIrqs;       // every ioport pin, their levels are part of the state
+    avr_cycle_count_t nextCheckpoint = 0;
+    std::vector<uint8_t> checkpointBlob;
+
+    // pin/poke/flash commands in timeline order, replayed when re-executing
+    std::deque<SimCommand> inputLog;
+    size_t replayNext = 0;                  // first input not applied yet
+    avr_cycle_count_t replayCycle = UINT64_MAX;
+    void ApplyInput(const SimCommand &cmd);
+    void ApplyReplay();
+    void SetReplayFrom(avr_cycle_count_t cycle);
+    void ForgetHistory();
+    void TruncateFuture();
+    avr_cycle_count_t Replay(avr_cycle_count_t target, bool atBreakpoint);
+    int StepInstruction();
+
+    // runs test breakpoints after each instruction. the instruction a run starts on is only
+    // tested after a reset or restart, anywhere else the run resumes from where it stopped
+    bool breakOnEntry = true;
+    bool BreakOnEntry();
+
+    uint64_t published = 0;             // snapshots so far, each slot of the triple buffer has its own copy
+    std::vector<uint8_t> publishedIo;   // io space as of the last snapshot, for dirty ranges
+    std::vector<uint8_t> unseenIo;      // io bytes changed since the last snapshot the UI took
+    FlashRange writtenFlash;            // flash changed since the last snapshot
+    FlashRange unseenFlash;             // and since the last snapshot the UI took
+    static void MarkFlash(FlashRange &range, uint32_t start, uint32_t end);
+
     static void sig_int(int sign); // signal handler for SIGINT/SIGTERM
 };
 
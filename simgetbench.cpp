@@ -0,0 +1,611 @@
+#include <argparse/argparse.hpp>
+#include "imgui.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "simgetavr.h"
+#include "simgetpov.h"
+#include "simgetsched.h"
+#include "simgetui.h"
+
+extern "C"
+{
+#include "simavr/sim/sim_avr.h"
+#include "simavr/sim/sim_cycle_timers.h"
+}
+
+// simulator throughput and hot path timings, printed as one JSON document
+
+int setupAVRDisasm();
+int Get_Next_Opcode(char *Bitstream);
+
+typedef std::chrono::steady_clock bench_clock;
+
+// results land here so the timed loops are not optimised away
+static volatile uint64_t bench_sink;
+
+static double SecondsSince(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// little endian words, what avr_loadcode wants
+static std::vector<uint8_t> Assemble(const std::vector<std::pair<int, uint16_t>> &code)
+{
+    std::vector<uint8_t> image;
+    for (const auto &op : code)
+    {
+        size_t at = op.first * 2;
+        if (image.size() < at + 2)
+            image.resize(at + 2, 0);
+        image[at] = op.second & 0xff;
+        image[at + 1] = op.second >> 8;
+    }
+    return image;
+}
+
+// attiny4313 images. word address, opcode
+//
+// add/eor/inc in a loop, no peripherals
+static std::vector<uint8_t> AluLoopImage()
+{
+    return Assemble({
+        {0x00, 0xE001}, // ldi r16, 1
+        {0x01, 0xE013}, // ldi r17, 3
+        {0x02, 0x0F20}, // loop: add r18, r16
+        {0x03, 0x2731}, // eor r19, r17
+        {0x04, 0x9543}, // inc r20
+        {0x05, 0xCFFC}, // rjmp loop
+    });
+}
+
+// timer0 CTC, compare match A every 16 cycles
+static std::vector<uint8_t> TimerIrqImage()
+{
+    return Assemble({
+        {0x00, 0xC01F}, // rjmp main
+        {0x0D, 0x9518}, // TIMER0 COMPA: reti
+        {0x20, 0xE002}, // main: ldi r16, WGM01
+        {0x21, 0xBF00}, // out TCCR0A, r16
+        {0x22, 0xE00F}, // ldi r16, 15
+        {0x23, 0xBF06}, // out OCR0A, r16
+        {0x24, 0xE001}, // ldi r16, OCIE0A
+        {0x25, 0xBF09}, // out TIMSK, r16
+        {0x26, 0xE001}, // ldi r16, CS00
+        {0x27, 0xBF03}, // out TCCR0B, r16
+        {0x28, 0x9478}, // sei
+        {0x29, 0x9543}, // loop: inc r20
+        {0x2A, 0xCFFE}, // rjmp loop
+    });
+}
+
+// idle sleep, woken by timer0 overflow at clk/1024
+static std::vector<uint8_t> SleepImage()
+{
+    return Assemble({
+        {0x00, 0xC01F}, // rjmp main
+        {0x06, 0x9518}, // TIMER0 OVF: reti
+        {0x20, 0xE005}, // main: ldi r16, CS02 | CS00
+        {0x21, 0xBF03}, // out TCCR0B, r16
+        {0x22, 0xE002}, // ldi r16, TOIE0
+        {0x23, 0xBF09}, // out TIMSK, r16
+        {0x24, 0xE200}, // ldi r16, SE
+        {0x25, 0xBF05}, // out MCUCR, r16
+        {0x26, 0x9478}, // sei
+        {0x27, 0x9588}, // loop: sleep
+        {0x28, 0x9543}, // inc r20
+        {0x29, 0xCFFD}, // rjmp loop
+    });
+}
+
+// cost of the per instruction cycle timer check, nothing due
+static double TimerCheckNs(avr_t *avr)
+{
+    const int calls = 1000000;
+    avr_cycle_count_t sum = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < calls; i++)
+        sum += avr_cycle_timer_process(avr);
+    double seconds = SecondsSince(start);
+
+    bench_sink = sum;
+    return seconds * 1e9 / calls;
+}
+
+static int CountTimers(avr_t *avr)
+{
+    int count = 0;
+    for (avr_cycle_timer_slot_p t = avr->cycle_timers.timer; t; t = t->next)
+        count++;
+    return count;
+}
+
+static void RunWorkload(const char *name, AvrSimulator &avrSim, uint64_t cycles, bool &first)
+{
+    HeadlessLimits limits;
+    limits.cycles = cycles;
+
+    RunStats stats = avrSim.RunHeadless(limits);
+
+    double insnPerSec = stats.wallSeconds > 0 ? stats.instructions / stats.wallSeconds : 0;
+    double nsPerInsn = stats.instructions ? stats.wallSeconds * 1e9 / stats.instructions : 0;
+    double timerNs = TimerCheckNs(avrSim.avr);
+
+    printf("%s\n    {\"name\":\"%s\",\"cycles\":%llu,\"instructions\":%llu,\"wall_seconds\":%.6f,"
+           "\"instructions_per_sec\":%.0f,\"ns_per_instruction\":%.3f,\"effective_mhz\":%.3f,"
+           "\"cycle_timers\":%d,\"timer_check_ns\":%.3f,\"timer_share\":%.4f,\"state\":\"%s\"}",
+           first ? "" : ",", name,
+           (unsigned long long)stats.cycles, (unsigned long long)stats.instructions, stats.wallSeconds,
+           insnPerSec, nsPerInsn, stats.mhz,
+           CountTimers(avrSim.avr), timerNs, nsPerInsn > 0 ? timerNs / nsPerInsn : 0.0,
+           GetAvrStateName(stats.state));
+    first = false;
+}
+
+static void PrintMicro(const char *name, double nsPerOp, uint64_t ops, bool &first)
+{
+    printf("%s\n    {\"name\":\"%s\",\"ns_per_op\":%.3f,\"ops\":%llu}", first ? "" : ",", name, nsPerOp, (unsigned long long)ops);
+    first = false;
+}
+
+// 'cycles' headless like RunWorkload, but a stop for 'reason' is counted and the run
+// resumes, the way the UI would carry on after a watch or breakpoint stop
+static void RunStopping(const char *name, AvrSimulator &avrSim, uint64_t cycles, const char *reason, bool &first)
+{
+    HeadlessLimits limits;
+    uint64_t instructions = 0, stops = 0;
+    double seconds = 0;
+    for (uint64_t done = 0; done < cycles;)
+    {
+        limits.cycles = cycles - done;
+        RunStats stats = avrSim.RunHeadless(limits);
+        done += stats.cycles;
+        instructions += stats.instructions;
+        seconds += stats.wallSeconds;
+        if (std::string(stats.reason) != reason)
+            break;
+        stops++;
+    }
+
+    printf("%s\n    {\"name\":\"%s\",\"ns_per_instruction\":%.3f,\"instructions\":%llu,\"stops\":%llu}",
+           first ? "" : ",", name, instructions ? seconds * 1e9 / instructions : 0,
+           (unsigned long long)instructions, (unsigned long long)stops);
+    first = false;
+}
+
+// every first opcode word, then the firmware's own instruction stream
+static void BenchDecode(AvrSimulator &avrSim, bool &first)
+{
+    const int passes = 16;
+    unsigned char bitstream[4] = {0, 0, 0, 0};
+    long checksum = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int word = 0; word < 65536; word++)
+        {
+            bitstream[0] = word & 0xff;
+            bitstream[1] = word >> 8;
+            checksum += Get_Next_Opcode((char *)bitstream);
+        }
+    }
+    PrintMicro("decode_all_words", SecondsSince(start) * 1e9 / (passes * 65536.0), passes * 65536ull, first);
+
+    uint32_t size = avrSim.avr->flashend + 1;
+    uint64_t ops = 0;
+    start = bench_clock::now();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (uint32_t pos = 0; pos + 4 <= size; pos += 2, ops++)
+            checksum += Get_Next_Opcode((char *)avrSim.avr->flash + pos);
+    }
+    PrintMicro("decode_firmware", ops ? SecondsSince(start) * 1e9 / ops : 0, ops, first);
+
+    const int builds = 20;
+    start = bench_clock::now();
+    for (int i = 0; i < builds; i++)
+        avrSim.disasm.Build(avrSim.avr->flash, size);
+    PrintMicro("disasm_build", SecondsSince(start) * 1e9 / builds, builds, first);
+
+    bench_sink = checksum;
+}
+
+static avr_cycle_count_t BenchTimerFire(struct avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    (*(uint64_t *)param)++;
+    return when + 1;
+}
+
+// the firmware with 0, 1 and 100 value watchpoints spread over io and sram. a watch
+// stops the run like it would in the UI, the loop resumes it and counts the stops
+static void BenchWatchpoints(AvrSimulator &avrSim, uint64_t cycles, bool &first)
+{
+    avr_t *avr = avrSim.avr;
+
+    for (int count : {0, 1, 100})
+    {
+        const uint32_t stride = std::max<uint32_t>(1, (avr->ramend - 32) / std::max(count, 1));
+        for (int i = 0; i < count; i++)
+            avrSim.watch.SetWatchpoint((uint16_t)(avr->ramend - i * stride), 1, WATCH_VALUE, 0xa5);
+
+        char name[32];
+        snprintf(name, sizeof(name), "watchpoints_%d", count);
+        RunStopping(name, avrSim, cycles, "watch", first);
+
+        for (int i = 0; i < count; i++)
+            avrSim.watch.RemoveWatchpoint((uint16_t)(avr->ramend - i * stride));
+    }
+}
+
+// the firmware with 0, 1 and 32 --add-trace signals spread over io and sram, what each
+// instruction pays for the watch path and how many changes it turned up
+static void BenchSignals(AvrSimulator &avrSim, uint64_t cycles, bool &first)
+{
+    avr_t *avr = avrSim.avr;
+
+    for (int count : {0, 1, 32})
+    {
+        const uint32_t stride = std::max<uint32_t>(1, (avr->ramend - 32) / std::max(count, 1));
+        for (int i = 0; i < count; i++)
+        {
+            char spec[32];
+            snprintf(spec, sizeof(spec), "s%d=trace@0x%x", i, (unsigned)(32 + i * stride));
+            avrSim.watch.AddSignal(spec);
+        }
+
+        HeadlessLimits limits;
+        limits.cycles = cycles;
+        RunStats stats = avrSim.RunHeadless(limits);
+
+        uint64_t changes = 0;
+        for (const WatchSignal &s : avrSim.watch.Signals())
+            changes += s.changes;
+        // forgets the signals, nothing else is armed here
+        avrSim.watch.Attach(avr);
+
+        char name[32];
+        snprintf(name, sizeof(name), "signals_%d", count);
+        printf("%s\n    {\"name\":\"%s\",\"ns_per_instruction\":%.3f,\"instructions\":%llu,\"changes\":%llu}",
+               first ? "" : ",", name, stats.instructions ? stats.wallSeconds * 1e9 / stats.instructions : 0,
+               (unsigned long long)stats.instructions, (unsigned long long)changes);
+        first = false;
+    }
+}
+
+// free running with no breakpoints against 64 conditional ones armed at the end of flash,
+// where the firmware should never get to. any that is reached stops the run, gets counted
+// and the run resumes
+static void BenchBreakpoints(AvrSimulator &avrSim, uint64_t cycles, bool &first)
+{
+    avr_t *avr = avrSim.avr;
+
+    for (int count : {0, 64})
+    {
+        for (int i = 0; i < count; i++)
+        {
+            Breakpoint bp;
+            std::string error;
+            char spec[64];
+            snprintf(spec, sizeof(spec), "0x%x if r24 == 0x10 && SREG & 2", (unsigned)(avr->flashend + 1 - 2 * (i + 1)));
+            if (avrSim.breakpoints.Parse(spec, false, avrSim.symbols, bp, error))
+                avrSim.breakpoints.Set(std::move(bp));
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "breakpoints_%d", count);
+        RunStopping(name, avrSim, cycles, "breakpoint", first);
+
+        for (int i = 0; i < count; i++)
+            avrSim.breakpoints.Remove(avr->flashend + 1 - 2 * (i + 1));
+    }
+}
+
+// register/fire/re-arm round trip with a handful of live timers
+static void BenchCycleTimers(AvrSimulator &avrSim, bool &first)
+{
+    avr_t *avr = avrSim.avr;
+    const int timers = 8;
+    const uint64_t steps = 2000000;
+    uint64_t fires = 0;
+
+    for (int i = 0; i < timers; i++)
+        avr_cycle_timer_register(avr, i + 1, BenchTimerFire, &fires);
+
+    bench_clock::time_point start = bench_clock::now();
+    for (uint64_t i = 0; i < steps; i++)
+    {
+        avr->cycle++;
+        avr_cycle_timer_process(avr);
+    }
+    double seconds = SecondsSince(start);
+
+    for (int i = 0; i < timers; i++)
+        avr_cycle_timer_cancel(avr, BenchTimerFire, &fires);
+
+    PrintMicro("cycle_timer_fire", fires ? seconds * 1e9 / fires : 0, fires, first);
+}
+
+// fast reset against a full re-initialize, and what a ring checkpoint costs
+static void BenchCheckpoint(AvrSimulator &avrSim, const std::string &mcu, const std::string &firmware_file, int frequency, bool &first)
+{
+    std::vector<uint8_t> blob;
+    const int rounds = 10000;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < rounds; i++)
+        avrSim.SaveState(blob);
+    PrintMicro("state_save", SecondsSince(start) * 1e9 / rounds, rounds, first);
+
+    start = bench_clock::now();
+    for (int i = 0; i < rounds; i++)
+        avrSim.LoadState(blob);
+    PrintMicro("state_restore", SecondsSince(start) * 1e9 / rounds, rounds, first);
+
+    // a ring of its own, the simulator may run with checkpoints off
+    CheckpointRing ring;
+    const int pushes = 1000;
+    start = bench_clock::now();
+    for (int i = 0; i < pushes; i++)
+    {
+        avrSim.RunQuantum(10000);
+        avrSim.SaveState(blob);
+        ring.Push(blob, avrSim.avr->cycle);
+    }
+    double seconds = SecondsSince(start);
+    PrintMicro("checkpoint_run_and_push", seconds * 1e9 / pushes, pushes, first);
+    printf(",\n    {\"name\":\"checkpoint_ring\",\"blob_bytes\":%zu,\"packed_bytes_per_entry\":%.1f}",
+           blob.size(), (double)ring.Bytes() / ring.Size());
+
+    const int inits = 20;
+    start = bench_clock::now();
+    for (int i = 0; i < inits; i++)
+    {
+        AvrSimulator fresh;
+        fresh.disassemble = false;
+        fresh.Initialize(mcu, firmware_file, frequency);
+    }
+    PrintMicro("initialize", SecondsSince(start) * 1e9 / inits, inits, first);
+}
+
+// pc and cycle of every instruction over a stretch, hashed, and the data space after it
+struct RunPrint {
+    uint64_t hash = 14695981039346656037ull;
+    uint64_t instructions = 0;
+    avr_flashaddr_t lastPc = 0;
+    avr_cycle_count_t lastCycle = 0;
+    std::vector<uint8_t> data;
+};
+
+static RunPrint Fingerprint(AvrSimulator &avrSim, uint64_t cycles)
+{
+    avr_t *avr = avrSim.avr;
+    const avr_cycle_count_t until = avr->cycle + cycles;
+    RunPrint print;
+
+    while (avr->cycle < until && avr->state != cpu_Done && avr->state != cpu_Crashed)
+    {
+        print.lastPc = avr->pc;
+        print.lastCycle = avr->cycle;
+        for (uint64_t v : {(uint64_t)avr->pc, (uint64_t)avr->cycle})
+            print.hash = (print.hash ^ v) * 1099511628211ull;
+        avrSim.RunQuantum(1);
+        print.instructions++;
+    }
+    print.data.assign(avr->data, avr->data + avr->ramend + 1);
+    return print;
+}
+
+static bool SamePrint(const RunPrint &a, const RunPrint &b)
+{
+    return a.hash == b.hash && a.instructions == b.instructions && a.data == b.data;
+}
+
+static void PrintCheck(const char *name, bool match, uint64_t instructions, bool &first)
+{
+    printf("%s\n    {\"name\":\"%s\",\"match\":%s,\"instructions\":%llu}", first ? "" : ",", name,
+           match ? "true" : "false", (unsigned long long)instructions);
+    first = false;
+}
+
+// a stretch re-executed from a checkpoint against the same stretch run live, then a reverse
+// step from its end, which has to land on the last instruction's start
+static bool CheckReplay(const std::string &mcu, const std::string &firmware_file, int frequency, uint64_t cycles, bool &first)
+{
+    AvrSimulator avrSim;
+    avrSim.disassemble = false;
+    avrSim.checkpointEvery = std::max<uint64_t>(cycles / 8, 1);
+    if (!avrSim.Initialize(mcu, firmware_file, frequency))
+        return false;
+    avrSim.Restart();
+
+    avrSim.RunQuantum(cycles / 2);
+    const avr_cycle_count_t from = avrSim.avr->cycle;
+    RunPrint live = Fingerprint(avrSim, cycles);
+
+    const bool seeked = avrSim.Seek(from) && avrSim.avr->cycle == from;
+    RunPrint replayed = Fingerprint(avrSim, cycles);
+    const bool replayMatch = seeked && SamePrint(live, replayed);
+    PrintCheck("replay_matches_live", replayMatch, replayed.instructions, first);
+
+    const bool stepMatch = avrSim.ReverseStep() && avrSim.avr->cycle == live.lastCycle && avrSim.avr->pc == live.lastPc;
+    PrintCheck("reverse_step_lands", stepMatch, 1, first);
+
+    return replayMatch && stepMatch;
+}
+
+// Restart() after a run against a fresh Initialize, both run the same stretch
+static bool CheckRestart(const std::string &mcu, const std::string &firmware_file, int frequency, uint64_t cycles, bool &first)
+{
+    AvrSimulator fresh, reused;
+    fresh.disassemble = reused.disassemble = false;
+    if (!fresh.Initialize(mcu, firmware_file, frequency) || !reused.Initialize(mcu, firmware_file, frequency))
+        return false;
+
+    HeadlessLimits limits;
+    limits.cycles = cycles;
+    reused.RunHeadless(limits);
+    reused.Restart();
+
+    RunPrint a = Fingerprint(fresh, cycles);
+    RunPrint b = Fingerprint(reused, cycles);
+    const bool match = SamePrint(a, b);
+    PrintCheck("restart_matches_initialize", match, b.instructions, first);
+    return match;
+}
+
+// the firmware under a spinning rotor with every led change captured, against the same
+// stretch with nothing hooked. the worker folds the events into the image meanwhile
+static void BenchPovCapture(AvrSimulator &avrSim, uint64_t cycles, bool &first)
+{
+    SpinnerRotor rotor(1200);
+    rotor.Attach(avrSim.avr);
+
+    HeadlessLimits limits;
+    limits.cycles = cycles;
+    RunStats bare = avrSim.RunHeadless(limits);
+
+    PovImage pov;
+    pov.Attach(avrSim.avr, &rotor);
+    pov.Start();
+    RunStats captured = avrSim.RunHeadless(limits);
+    pov.Stop();
+
+    // the rotor's timer points at this frame
+    rotor.SetRpm(avrSim.avr, 0);
+
+    printf("%s\n    {\"name\":\"pov_capture\",\"ns_per_instruction\":%.3f,\"bare_ns_per_instruction\":%.3f,"
+           "\"led_changes\":%llu,\"dropped\":%llu}",
+           first ? "" : ",", captured.instructions ? captured.wallSeconds * 1e9 / captured.instructions : 0,
+           bare.instructions ? bare.wallSeconds * 1e9 / bare.instructions : 0,
+           (unsigned long long)pov.Recorded(), (unsigned long long)pov.Dropped());
+    first = false;
+}
+
+// sim side copy out, then the UI side build of every window from it
+static void BenchUiFrame(AvrSimulator &avrSim, bool &first)
+{
+    const int publishes = 10000;
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < publishes; i++)
+        avrSim.PublishSnapshot();
+    PrintMicro("publish_snapshot", SecondsSince(start) * 1e9 / publishes, publishes, first);
+
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = ImVec2(1280, 1024);
+    io.DeltaTime = 1.0f / 60.0f;
+
+    // no renderer, the atlas only has to exist
+    unsigned char *pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    SimScheduler scheduler(avrSim);
+    avrSim.snapshot.Update();
+
+    // first frames create windows and settle layout
+    const int warmup = 10;
+    const int frames = 2000;
+    for (int i = 0; i < warmup + frames; i++)
+    {
+        if (i == warmup)
+            start = bench_clock::now();
+
+        ImGui::NewFrame();
+        ShowAvrWindows(avrSim, scheduler);
+        ImGui::Render();
+    }
+    PrintMicro("ui_frame", SecondsSince(start) * 1e9 / frames, frames, first);
+
+    ImGui::DestroyContext();
+}
+
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("simget-bench");
+
+    program.add_argument("--firmware")
+        .default_value(std::string("elliePOV.hex"))
+        .help("Firmware for the real world workload (ELF or hex)");
+
+    program.add_argument("--mcu", "-m")
+        .default_value(std::string("attiny4313"))
+        .help("Sets the MCU type, the generated workloads assume an attiny4313");
+
+    program.add_argument("--freq", "-f")
+        .scan<'i', int>()
+        .default_value(8000000)
+        .help("Sets the frequency");
+
+    program.add_argument("--cycles")
+        .scan<'u', uint64_t>()
+        .default_value(static_cast<uint64_t>(50000000))
+        .help("Simulated cycles per workload");
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+
+    std::string mcu = program.get<std::string>("--mcu");
+    std::string firmware_file = program.get<std::string>("--firmware");
+    int frequency = program.get<int>("--freq");
+    uint64_t cycles = program.get<uint64_t>("--cycles");
+
+    setupAVRDisasm();
+
+    AvrSimulator pov, alu, irq, sleeper;
+    if (!pov.Initialize(mcu, firmware_file, frequency) ||
+        !alu.Initialize(mcu, AluLoopImage(), frequency) ||
+        !irq.Initialize(mcu, TimerIrqImage(), frequency) ||
+        !sleeper.Initialize(mcu, SleepImage(), frequency))
+        return 1;
+
+    bool first = true;
+
+    printf("{\"mcu\":\"%s\",\"frequency\":%d,\"cycles\":%llu,\"workloads\":[",
+           mcu.c_str(), frequency, (unsigned long long)cycles);
+
+    RunWorkload(firmware_file.c_str(), pov, cycles, first);
+    RunWorkload("alu_loop", alu, cycles, first);
+    RunWorkload("timer_irq", irq, cycles, first);
+    RunWorkload("sleep", sleeper, cycles, first);
+
+    printf("\n  ],\"micro\":[");
+    first = true;
+
+    BenchDecode(pov, first);
+    BenchCycleTimers(alu, first);
+    BenchWatchpoints(pov, cycles / 10, first);
+    BenchSignals(pov, cycles / 10, first);
+    BenchBreakpoints(pov, cycles / 10, first);
+    BenchCheckpoint(pov, mcu, firmware_file, frequency, first);
+    BenchPovCapture(pov, cycles / 10, first);
+    BenchUiFrame(pov, first);
+
+    // time travel and fast restart have to reproduce the run they stand in for
+    printf("\n  ],\"checks\":[");
+    first = true;
+
+    bool ok = CheckReplay(mcu, firmware_file, frequency, cycles / 100, first);
+    ok &= CheckRestart(mcu, firmware_file, frequency, cycles / 100, first);
+
+    printf("\n  ]}\n");
+    fflush(stdout);
+
+    return ok ? 0 : 1;
+}
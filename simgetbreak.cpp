@@ -0,0 +1,533 @@
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "simgetbreak.h"
+
+extern "C" {
+    #include "simavr/sim/avr_ioport.h"
+}
+
+enum {
+    OP_CONST,       // push arg
+    OP_DATA,        // push data[arg]
+    OP_WORD,        // push data[arg] | data[arg + 1] << 8
+    OP_LOAD,        // top = data[top]
+    OP_SREG,        // simavr keeps the flags apart from data[R_SREG]
+    OP_PC,
+    OP_COUNT,
+    OP_NOT,
+    OP_INV,
+    OP_NEG,
+    OP_ADD,
+    OP_SUB,
+    OP_SHL,
+    OP_SHR,
+    OP_AND,
+    OP_XOR,
+    OP_OR,
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_LAND,
+    OP_LOR,
+};
+
+// deep enough for anything typed on one line
+static const int maxStack = 16;
+
+// most recent tracepoint hits kept for the UI
+static const size_t maxLog = 256;
+
+// recursive descent over one condition, emitting postfix ops as it goes
+class ConditionParser {
+public:
+    ConditionParser(const std::string &text, const avr_t *avr, const SymbolIndex &symbols, std::vector<BreakOp> &code)
+        : p(text.c_str()), avr(avr), symbols(symbols), code(code)
+    {
+    }
+
+    bool Parse(std::string &error)
+    {
+        Binary(1);
+        Skip();
+        if (!failed && *p)
+            Fail(std::string("unexpected '") + *p + "'");
+        if (!failed && maxDepth > maxStack)
+            Fail("expression too deep");
+        error = message;
+        return !failed;
+    }
+
+private:
+    struct Operator {
+        const char *text;
+        int precedence;
+        uint8_t op;
+    };
+
+    // longest spelling first so "<=" doesn't read as "<"
+    static const Operator *Binaries()
+    {
+        static const Operator ops[] = {
+            { "||", 1, OP_LOR }, { "&&", 2, OP_LAND }, { "==", 6, OP_EQ }, { "!=", 6, OP_NE },
+            { "<=", 7, OP_LE },  { ">=", 7, OP_GE },   { "<<", 8, OP_SHL }, { ">>", 8, OP_SHR },
+            { "|", 3, OP_OR },   { "^", 4, OP_XOR },   { "&", 5, OP_AND },  { "<", 7, OP_LT },
+            { ">", 7, OP_GT },   { "+", 9, OP_ADD },   { "-", 9, OP_SUB },  { nullptr, 0, 0 },
+        };
+        return ops;
+    }
+
+    void Skip()
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+    }
+
+    void Fail(const std::string &text)
+    {
+        if (!failed)
+            message = text;
+        failed = true;
+    }
+
+    void Emit(uint8_t op, uint32_t arg = 0)
+    {
+        code.push_back({ op, arg });
+        if (op <= OP_COUNT && op != OP_LOAD)
+            depth++;
+        else if (op >= OP_ADD)
+            depth--;
+        maxDepth = std::max(maxDepth, depth);
+    }
+
+    void Binary(int precedence)
+    {
+        Unary();
+        while (!failed)
+        {
+            Skip();
+            const Operator *match = nullptr;
+            for (const Operator *o = Binaries(); o->text; o++)
+            {
+                if (!strncmp(p, o->text, strlen(o->text)))
+                {
+                    match = o;
+                    break;
+                }
+            }
+            if (!match || match->precedence < precedence)
+                return;
+
+            p += strlen(match->text);
+            Binary(match->precedence + 1);
+            Emit(match->op);
+        }
+    }
+
+    void Unary()
+    {
+        Skip();
+        if (*p == '!' || *p == '~' || *p == '-')
+        {
+            const char c = *p++;
+            Unary();
+            Emit(c == '!' ? OP_NOT : c == '~' ? OP_INV : OP_NEG);
+            return;
+        }
+        Primary();
+    }
+
+    void Primary()
+    {
+        Skip();
+        if (*p == '(' || *p == '[')
+        {
+            const char close = *p == '(' ? ')' : ']';
+            const bool load = *p == '[';
+            p++;
+            Binary(1);
+            Skip();
+            if (*p != close)
+                return Fail(std::string("missing '") + close + "'");
+            p++;
+            if (load)
+                Emit(OP_LOAD);
+            return;
+        }
+
+        if (isdigit((unsigned char)*p))
+        {
+            char *end;
+            unsigned long value = *p == '0' && (p[1] == 'b' || p[1] == 'B') ? strtoul(p + 2, &end, 2)
+                                                                             : strtoul(p, &end, 0);
+            p = end;
+            Emit(OP_CONST, (uint32_t)value);
+            return;
+        }
+
+        const char *start = p;
+        while (isalnum((unsigned char)*p) || *p == '_' || *p == '.')
+            p++;
+        if (p == start)
+            return Fail(*p ? std::string("unexpected '") + *p + "'" : "expression ends early");
+        Name(std::string(start, p - start));
+    }
+
+    void Name(const std::string &name)
+    {
+        const char *n = name.c_str();
+
+        if ((n[0] == 'r' || n[0] == 'R') && isdigit((unsigned char)n[1]))
+        {
+            char *end;
+            unsigned long reg = strtoul(n + 1, &end, 10);
+            if (!*end && reg < 32)
+                return Emit(OP_DATA, (uint32_t)reg);
+        }
+
+        static const struct {
+            const char *name;
+            uint8_t op;
+            uint32_t arg;
+        } fixed[] = {
+            { "X", OP_WORD, R_XL },     { "Y", OP_WORD, R_YL },     { "Z", OP_WORD, R_ZL },
+            { "SP", OP_WORD, R_SPL },   { "SPL", OP_DATA, R_SPL },  { "SPH", OP_DATA, R_SPH },
+            { "SREG", OP_SREG, 0 },     { "pc", OP_PC, 0 },         { "count", OP_COUNT, 0 },
+        };
+        for (const auto &f : fixed)
+        {
+            if (!strcasecmp(n, f.name))
+                return Emit(f.op, f.arg);
+        }
+
+        // PORTB, DDRD, PINA ... from the port modules this core registered
+        for (avr_io_t *io = avr->io_port; io; io = io->next)
+        {
+            if (!io->kind || strcmp(io->kind, "port"))
+                continue;
+
+            const avr_ioport_t *port = (const avr_ioport_t *)io;
+            const std::string letter(1, port->name);
+            if (name == "PORT" + letter)
+                return Emit(OP_DATA, port->r_port);
+            if (name == "DDR" + letter)
+                return Emit(OP_DATA, port->r_ddr);
+            if (name == "PIN" + letter)
+                return Emit(OP_DATA, port->r_pin);
+        }
+
+        const Symbol *s = symbols.Lookup(name, SYMBOL_DATA);
+        if (s && s->addr <= avr->ramend)
+            return Emit(OP_DATA, s->addr);
+
+        Fail("unknown name '" + name + "'");
+    }
+
+    const char *p;
+    const avr_t *avr;
+    const SymbolIndex &symbols;
+    std::vector<BreakOp> &code;
+
+    int depth = 0;
+    int maxDepth = 0;
+    bool failed = false;
+    std::string message;
+};
+
+bool BreakCondition::Compile(const std::string &text, const avr_t *avr, const SymbolIndex &symbols,
+                             std::string &error)
+{
+    source = text;
+    code.clear();
+    usesCount = false;
+
+    if (text.find_first_not_of(" \t") == std::string::npos)
+    {
+        source.clear();
+        return true;
+    }
+
+    ConditionParser parser(text, avr, symbols, code);
+    if (!parser.Parse(error))
+    {
+        code.clear();
+        return false;
+    }
+    for (const BreakOp &op : code)
+        usesCount |= op.code == OP_COUNT;
+    return true;
+}
+
+int32_t BreakCondition::Evaluate(const avr_t *avr, uint64_t count) const
+{
+    int32_t stack[maxStack];
+    int top = -1;
+
+    for (const BreakOp &op : code)
+    {
+        switch (op.code)
+        {
+        case OP_CONST:
+            stack[++top] = (int32_t)op.arg;
+            break;
+        case OP_DATA:
+            stack[++top] = avr->data[op.arg];
+            break;
+        case OP_WORD:
+            stack[++top] = avr->data[op.arg] | (avr->data[op.arg + 1] << 8);
+            break;
+        case OP_LOAD:
+            stack[top] = (uint32_t)stack[top] <= avr->ramend ? avr->data[stack[top]] : 0;
+            break;
+        case OP_SREG:
+        {
+            uint8_t sreg = 0;
+            for (int i = 0; i < 8; i++)
+                sreg |= avr->sreg[i] ? 1 << i : 0;
+            stack[++top] = sreg;
+            break;
+        }
+        case OP_PC:
+            stack[++top] = (int32_t)avr->pc;
+            break;
+        case OP_COUNT:
+            stack[++top] = (int32_t)count;
+            break;
+        case OP_NOT:
+            stack[top] = !stack[top];
+            break;
+        case OP_INV:
+            stack[top] = ~stack[top];
+            break;
+        case OP_NEG:
+            stack[top] = -stack[top];
+            break;
+        default:
+        {
+            const int32_t b = stack[top--];
+            int32_t &a = stack[top];
+            switch (op.code)
+            {
+            case OP_ADD: a = a + b; break;
+            case OP_SUB: a = a - b; break;
+            case OP_SHL: a = (int32_t)((uint32_t)a << (b & 31)); break;
+            case OP_SHR: a = (int32_t)((uint32_t)a >> (b & 31)); break;
+            case OP_AND: a = a & b; break;
+            case OP_XOR: a = a ^ b; break;
+            case OP_OR: a = a | b; break;
+            case OP_EQ: a = a == b; break;
+            case OP_NE: a = a != b; break;
+            case OP_LT: a = a < b; break;
+            case OP_LE: a = a <= b; break;
+            case OP_GT: a = a > b; break;
+            case OP_GE: a = a >= b; break;
+            case OP_LAND: a = a && b; break;
+            case OP_LOR: a = a || b; break;
+            }
+            break;
+        }
+        }
+    }
+    return top >= 0 ? stack[top] : 1;
+}
+
+void BreakpointTable::Attach(avr_t *avr)
+{
+    this->avr = avr;
+    words = (avr->flashend + 1) / 2;
+    bits.assign((words + 63) / 64, 0);
+    list.clear();
+    generation++;
+    log.clear();
+    logged = 0;
+    triggered = false;
+
+    std::lock_guard<std::mutex> guard(postLock);
+    posted.clear();
+}
+
+bool BreakpointTable::Parse(const std::string &spec, bool tracepoint, const SymbolIndex &symbols, Breakpoint &out,
+                            std::string &error) const
+{
+    // the clauses in either order after the location
+    std::string location = spec, condition, value;
+    const size_t ifAt = spec.find(" if ");
+    const size_t logAt = spec.find(" log ");
+    const size_t end = std::min(ifAt, logAt);
+    if (end != std::string::npos)
+    {
+        location = spec.substr(0, end);
+        if (ifAt != std::string::npos)
+            condition = spec.substr(ifAt + 4, logAt > ifAt ? logAt - ifAt - 4 : std::string::npos);
+        if (logAt != std::string::npos)
+            value = spec.substr(logAt + 5, ifAt > logAt ? ifAt - logAt - 5 : std::string::npos);
+    }
+    location.erase(location.find_last_not_of(" \t") + 1);
+
+    // a number, or a function with an optional +offset
+    char *rest;
+    unsigned long addr = strtoul(location.c_str(), &rest, 0);
+    if (location.empty() || *rest)
+    {
+        const size_t plus = location.find('+');
+        const Symbol *s = symbols.Lookup(location.substr(0, plus), SYMBOL_FLASH);
+        if (!s)
+        {
+            error = "no function '" + location.substr(0, plus) + "'";
+            return false;
+        }
+        addr = s->addr;
+        if (plus != std::string::npos)
+        {
+            addr += strtoul(location.c_str() + plus + 1, &rest, 0);
+            if (*rest)
+            {
+                error = "bad offset in '" + location + "'";
+                return false;
+            }
+        }
+    }
+
+    if (addr > avr->flashend || (addr & 1))
+    {
+        error = "'" + location + "' is not an instruction address";
+        return false;
+    }
+
+    out.addr = (uint32_t)addr;
+    out.tracepoint = tracepoint;
+    out.count = out.hits = 0;
+
+    if (!out.condition.Compile(condition, avr, symbols, error))
+    {
+        error = "if: " + error;
+        return false;
+    }
+    if (!out.log.Compile(value, avr, symbols, error))
+    {
+        error = "log: " + error;
+        return false;
+    }
+    return true;
+}
+
+void BreakpointTable::Mark(uint32_t addr, bool on)
+{
+    const size_t word = addr >> 1;
+    if (on)
+        bits[word >> 6] |= 1ull << (word & 63);
+    else
+        bits[word >> 6] &= ~(1ull << (word & 63));
+}
+
+Breakpoint *BreakpointTable::Find(uint32_t addr)
+{
+    auto it = std::lower_bound(list.begin(), list.end(), addr,
+                               [](const Breakpoint &bp, uint32_t a) { return bp.addr < a; });
+    return it != list.end() && it->addr == addr ? &*it : nullptr;
+}
+
+void BreakpointTable::Set(Breakpoint &&bp)
+{
+    if ((bp.addr >> 1) >= words)
+        return;
+
+    generation++;
+    Breakpoint *existing = Find(bp.addr);
+    if (existing)
+    {
+        *existing = std::move(bp);
+        return;
+    }
+
+    Mark(bp.addr, true);
+    auto it = std::lower_bound(list.begin(), list.end(), bp.addr,
+                               [](const Breakpoint &b, uint32_t a) { return b.addr < a; });
+    list.insert(it, std::move(bp));
+}
+
+bool BreakpointTable::Remove(uint32_t addr)
+{
+    Breakpoint *bp = Find(addr);
+    if (!bp)
+        return false;
+
+    Mark(addr, false);
+    generation++;
+    list.erase(list.begin() + (bp - list.data()));
+    return true;
+}
+
+void BreakpointTable::Toggle(uint32_t addr, bool on)
+{
+    if (!on)
+    {
+        Remove(addr);
+        return;
+    }
+    if (Find(addr))
+        return;
+
+    Breakpoint bp;
+    bp.addr = addr;
+    Set(std::move(bp));
+}
+
+void BreakpointTable::Post(Breakpoint &&bp)
+{
+    std::lock_guard<std::mutex> guard(postLock);
+    posted.push_back(std::move(bp));
+}
+
+void BreakpointTable::Accept()
+{
+    std::vector<Breakpoint> incoming;
+    {
+        std::lock_guard<std::mutex> guard(postLock);
+        incoming.swap(posted);
+    }
+    for (Breakpoint &bp : incoming)
+        Set(std::move(bp));
+}
+
+bool BreakpointTable::Stop(const avr_t *avr, bool record)
+{
+    Breakpoint *bp = Find(avr->pc);
+    if (!bp)
+        return false;
+
+    // bp->count is the live tally, not the pass a replay is on
+    if (!record && bp->condition.UsesCount())
+        return false;
+
+    const uint64_t count = bp->count + 1;
+    if (record)
+        bp->count = count;
+
+    if (!bp->condition.Empty() && !bp->condition.Evaluate(avr, count))
+        return false;
+    if (!record)
+        return !bp->tracepoint;
+
+    bp->hits++;
+    if (!bp->tracepoint)
+    {
+        triggered = true;
+        return true;
+    }
+
+    TracepointHit hit = { avr->cycle, bp->addr, bp->log.Empty() ? 0 : bp->log.Evaluate(avr, count) };
+    log.push_back(hit);
+    if (log.size() > maxLog)
+        log.pop_front();
+    logged++;
+    if (onLog)
+        onLog(*bp, hit);
+    return false;
+}
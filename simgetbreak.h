@@ -0,0 +1,117 @@
+#ifndef SIMGETBREAK_H
+#define SIMGETBREAK_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "sim_avr.h"
+#include "simgetsymbols.h"
+
+// one step of a compiled condition, a small stack machine
+struct BreakOp {
+    uint8_t code;
+    uint32_t arg;
+};
+
+// "r24 == 0x10 && PORTB & 4" with C precedence. names are r0..r31, X Y Z SP (words),
+// SPL SPH SREG, PORTx DDRx PINx of the core's io ports, pc, count (times the breakpoint
+// was reached, this time included) and elf data symbols (their first byte). [expr]
+// reads a data address. compiled once against one core, evaluated without allocating
+class BreakCondition {
+public:
+    // false with a message in error
+    bool Compile(const std::string &source, const avr_t *avr, const SymbolIndex &symbols, std::string &error);
+    int32_t Evaluate(const avr_t *avr, uint64_t count) const;
+
+    bool Empty() const { return code.empty(); }
+    // reads count, which only the live pass knows
+    bool UsesCount() const { return usesCount; }
+    const std::string &Source() const { return source; }
+
+private:
+    std::string source;
+    std::vector<BreakOp> code;
+    bool usesCount = false;
+};
+
+struct Breakpoint {
+    uint32_t addr;                  // flash byte address
+    BreakCondition condition;       // stops every time when empty
+    BreakCondition log;             // tracepoints record its value, 0 when empty
+    bool tracepoint = false;        // logs and runs on instead of stopping
+    uint64_t count = 0;             // times reached
+    uint64_t hits = 0;              // times the condition held
+};
+
+struct TracepointHit {
+    avr_cycle_count_t cycle;
+    uint32_t addr;
+    int32_t value;
+};
+
+// pc breakpoints as one bit per flash word. the sim thread tests the bit after every
+// instruction and only looks up and runs the breakpoint's condition when it is set, so
+// breakpoints elsewhere cost a load, a shift and a branch.
+class BreakpointTable {
+public:
+    // sizes the bitmap for this core, forgets every breakpoint
+    void Attach(avr_t *avr);
+
+    // "location [if condition] [log expression]", location a flash byte address or a
+    // function, optionally +offset. any thread, the core's io ports and the symbols are
+    // only read. false with a message in error
+    bool Parse(const std::string &spec, bool tracepoint, const SymbolIndex &symbols, Breakpoint &out,
+               std::string &error) const;
+
+    // sim thread, replaces a breakpoint at the same address
+    void Set(Breakpoint &&bp);
+    bool Remove(uint32_t addr);
+    // a plain breakpoint on or off
+    void Toggle(uint32_t addr, bool on);
+
+    // UI thread hands a parsed breakpoint over, the sim thread Accepts on CMD_BREAKPOINT_POSTED
+    void Post(Breakpoint &&bp);
+    void Accept();
+
+    bool Armed(avr_flashaddr_t pc) const
+    {
+        const size_t word = pc >> 1;
+        return word < words && (bits[word >> 6] >> (word & 63)) & 1;
+    }
+
+    // the breakpoint at avr->pc, true if the sim should stop. record counts the pass and
+    // logs tracepoints, replays through known history only ask. a replay can't tell which
+    // pass it is on, so a condition on count never holds there
+    bool Stop(const avr_t *avr, bool record);
+
+    size_t Count() const { return list.size(); }
+    const std::vector<Breakpoint> &List() const { return list; }
+    // moves on whenever a breakpoint is set or removed, not when its counters do
+    uint64_t Generation() const { return generation; }
+
+    std::deque<TracepointHit> log;  // most recent last, capped
+    uint64_t logged = 0;
+    bool triggered = false;         // a breakpoint stopped the sim since the owner last cleared it
+
+    // sim thread, every tracepoint hit as it happens
+    std::function<void(const Breakpoint &bp, const TracepointHit &hit)> onLog;
+
+private:
+    void Mark(uint32_t addr, bool on);
+    Breakpoint *Find(uint32_t addr);
+
+    avr_t *avr = nullptr;
+    std::vector<uint64_t> bits;
+    size_t words = 0;
+    std::vector<Breakpoint> list;   // ascending by address
+    uint64_t generation = 1;
+
+    std::mutex postLock;
+    std::vector<Breakpoint> posted;
+};
+
+#endif // SIMGETBREAK_H
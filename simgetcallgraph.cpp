@@ -0,0 +1,246 @@
+#include <map>
+#include <stdio.h>
+
+#include "simgetcallgraph.h"
+
+enum {
+    KIND_NONE,
+    KIND_CALL,          // call, rcall, icall, eicall
+    KIND_RET,           // ret, reti
+};
+
+// deeper than any sane avr stack, runaway recursion stops growing the tree here
+static const size_t maxDepth = 512;
+
+static const uint32_t publishEvery = 16;
+
+uint8_t CallGraph::Classify(uint16_t o)
+{
+    if ((o & 0xfe0e) == 0x940e || (o & 0xf000) == 0xd000 || o == 0x9509 || o == 0x9519)
+        return KIND_CALL;
+    if (o == 0x9508 || o == 0x9518)
+        return KIND_RET;
+    return KIND_NONE;
+}
+
+void CallGraph::Attach(avr_t *avr)
+{
+    this->avr = avr;
+    enabled = false;
+
+    kinds.resize((avr->flashend + 1) / 2);
+    for (size_t i = 0; i < kinds.size(); i++)
+        kinds[i] = Classify(avr->flash[i * 2] | (avr->flash[i * 2 + 1] << 8));
+
+    Clear();
+}
+
+void CallGraph::Invalidate(uint32_t addr)
+{
+    size_t word = addr / 2;
+    if (word < kinds.size())
+        kinds[word] = Classify(avr->flash[word * 2] | (avr->flash[word * 2 + 1] << 8));
+}
+
+void CallGraph::Start()
+{
+    enabled = true;
+    lastCycle = avr->cycle;
+}
+
+void CallGraph::Stop()
+{
+    if (!enabled)
+        return;
+
+    // one last copy so the UI keeps showing what was recorded
+    published.reset();
+    Publish();
+    enabled = false;
+}
+
+void CallGraph::Clear()
+{
+    nodes.clear();
+    children.clear();
+    nodes.push_back({ 0, -1, -1, -1, false, 1, 0, 0 });
+    overflows = 0;
+    published.reset();
+    Unwind();
+}
+
+void CallGraph::Unwind()
+{
+    stack.clear();
+    stack.push_back({ 0, UINT32_MAX });
+    lastCycle = avr ? avr->cycle : 0;
+}
+
+int CallGraph::Child(int parent, uint32_t addr, bool isr)
+{
+    const uint64_t key = (uint64_t)(parent + 1) << 32 | addr;
+    auto it = children.find(key);
+    if (it != children.end())
+        return it->second;
+
+    const int node = (int)nodes.size();
+    if (parent >= 0)
+    {
+        nodes.push_back({ addr, parent, -1, nodes[parent].child, isr, 0, 0, 0 });
+        nodes[parent].child = node;
+    }
+    else
+    {
+        // roots chain off the reset root
+        nodes.push_back({ addr, -1, -1, nodes[0].sibling, isr, 0, 0, 0 });
+        nodes[0].sibling = node;
+    }
+    children.emplace(key, node);
+    return node;
+}
+
+// simavr pushes the word address low byte first, downwards from the old SP
+uint32_t CallGraph::PushedAddress(const avr_t *avr, uint16_t sp) const
+{
+    uint32_t addr = 0;
+    for (int i = 0; i < avr->address_size; i++)
+        addr |= (uint32_t)avr->data[sp + avr->address_size - i] << (8 * i);
+    return addr << 1;
+}
+
+void CallGraph::Control(avr_t *avr)
+{
+    const uint16_t now = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+
+    // reti drops the running count before a back to back interrupt puts it up again
+    const uint8_t expected = kind == KIND_RET && interrupts ? interrupts - 1 : interrupts;
+    const bool entered = avr->interrupts.running_ptr > expected;
+
+    // SP as the instruction itself left it
+    const uint16_t after = entered ? now + avr->address_size : now;
+
+    if (kind == KIND_CALL)
+    {
+        // the interrupt pushed the call target as its return address
+        const uint32_t target = entered ? PushedAddress(avr, now) : avr->pc;
+        if (stack.size() < maxDepth)
+        {
+            const int node = Child(stack.back().node, target, false);
+            nodes[node].calls++;
+            stack.push_back({ node, sp });
+        }
+        else
+        {
+            overflows++;
+        }
+    }
+    else if (kind == KIND_RET)
+    {
+        while (stack.size() > 1 && stack.back().sp <= after)
+            stack.pop_back();
+    }
+
+    if (entered)
+    {
+        if (stack.size() < maxDepth)
+        {
+            const int node = Child(-1, avr->pc, true);
+            nodes[node].calls++;
+            stack.push_back({ node, after });
+        }
+        else
+        {
+            overflows++;
+        }
+    }
+}
+
+std::shared_ptr<const CallGraphCounts> CallGraph::Totals() const
+{
+    std::shared_ptr<CallGraphCounts> counts = std::make_shared<CallGraphCounts>();
+    counts->nodes = nodes;
+
+    // children are always created after their parent
+    std::vector<CallNode> &n = counts->nodes;
+    for (size_t i = n.size(); i-- > 0;)
+    {
+        n[i].inclusive += n[i].exclusive;
+        if (n[i].parent >= 0)
+            n[n[i].parent].inclusive += n[i].inclusive;
+        else
+            counts->totalCycles += n[i].inclusive;
+    }
+    return counts;
+}
+
+const std::shared_ptr<const CallGraphCounts> &CallGraph::Publish()
+{
+    if (!enabled || (published && ++publishes % publishEvery))
+        return published;
+
+    published = Totals();
+    return published;
+}
+
+bool CallGraph::WriteCallgrind(const std::string &path, const std::string &object,
+                               const std::function<std::string(uint32_t addr)> &name) const
+{
+    std::shared_ptr<const CallGraphCounts> counts = Totals();
+
+    struct Edge {
+        uint64_t calls = 0;
+        uint64_t inclusive = 0;
+    };
+    struct Function {
+        uint64_t exclusive = 0;
+        std::map<uint32_t, Edge> callees;
+    };
+
+    // contexts merged per function, ordered by address
+    std::map<uint32_t, Function> functions;
+    for (const CallNode &n : counts->nodes)
+    {
+        functions[n.addr].exclusive += n.exclusive;
+        if (n.parent >= 0)
+        {
+            Edge &e = functions[counts->nodes[n.parent].addr].callees[n.addr];
+            e.calls += n.calls;
+            e.inclusive += n.inclusive;
+        }
+    }
+
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out)
+        return false;
+
+    fprintf(out, "# callgrind format\nversion: 1\ncreator: simget\n");
+    fprintf(out, "cmd: %s\npositions: instr\nevents: Cycles\nsummary: %llu\n\n", object.c_str(),
+            (unsigned long long)counts->totalCycles);
+    fprintf(out, "ob=%s\n", object.c_str());
+
+    // name compression, "(id) name" the first time and "(id)" after that
+    std::map<uint32_t, int> ids;
+    auto fn = [&](uint32_t addr) {
+        auto it = ids.find(addr);
+        if (it != ids.end())
+            return "(" + std::to_string(it->second) + ")";
+        int id = (int)ids.size() + 1;
+        ids[addr] = id;
+        return "(" + std::to_string(id) + ") " + name(addr);
+    };
+
+    for (const auto &f : functions)
+    {
+        fprintf(out, "\nfn=%s\n", fn(f.first).c_str());
+        fprintf(out, "0x%x %llu\n", f.first, (unsigned long long)f.second.exclusive);
+        for (const auto &c : f.second.callees)
+        {
+            fprintf(out, "cfn=%s\n", fn(c.first).c_str());
+            fprintf(out, "calls=%llu 0x%x\n", (unsigned long long)c.second.calls, c.first);
+            fprintf(out, "0x%x %llu\n", f.first, (unsigned long long)c.second.inclusive);
+        }
+    }
+
+    fclose(out);
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef SIMGETCALLGRAPH_H
+#define SIMGETCALLGRAPH_H
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sim_avr.h"
+
+// one calling context: a function as reached through its chain of callers
+struct CallNode {
+    uint32_t addr;          // function entry, flash byte address
+    int parent;             // -1 for a root
+    int child;              // first callee, -1
+    int sibling;            // next callee of the same parent, or next root
+    bool isr;               // entered by an interrupt
+    uint64_t calls;
+    uint64_t exclusive;     // cycles with this context on top of the stack
+    uint64_t inclusive;     // exclusive plus everything below, see Totals
+};
+
+// the tree as of one publish, inclusive filled in
+struct CallGraphCounts {
+    std::vector<CallNode> nodes;    // node 0 is the reset root, the other roots hang off its sibling chain
+    uint64_t totalCycles = 0;
+};
+
+// shadow call stack fed from the sim thread's step loop. every flash word is classified once
+// as call (call/rcall/icall/eicall), ret or reti, so an instruction costs a table lookup and an
+// add. frames remember the stack pointer they return to and a ret pops every frame at or below
+// the new SP, which keeps the shadow stack honest through setjmp/longjmp and hand made stack
+// switches. an interrupt entry starts a frame on a root of its own, whatever it interrupted.
+//
+// a reset or state load can't be followed, the stack starts again from the reset root.
+class CallGraph {
+public:
+    // sizes the table for this core, forgets the tree and stops recording
+    void Attach(avr_t *avr);
+
+    void Start();
+    void Stop();
+    void Clear();
+
+    // the stack no longer matches the machine, after a reset or state load
+    void Unwind();
+
+    // flash was written, reclassify the word at this byte address
+    void Invalidate(uint32_t addr);
+
+    bool enabled = false;       // the step loop calls Before/After
+    bool quiet = false;         // re-executing known history, the step loop leaves us out
+
+    // sim thread, around avr_run while enabled
+    void Before(avr_t *avr)
+    {
+        const size_t word = avr->pc >> 1;
+        kind = avr->state == cpu_Running && word < kinds.size() ? kinds[word] : 0;
+        sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+        interrupts = avr->interrupts.running_ptr;
+    }
+    void After(avr_t *avr, avr_cycle_count_t cycle)
+    {
+        if (cycle != lastCycle) {
+            Unwind();
+        }
+        nodes[stack.back().node].exclusive += avr->cycle - cycle;
+        lastCycle = avr->cycle;
+
+        if (kind || avr->interrupts.running_ptr != interrupts) {
+            Control(avr);
+        }
+    }
+
+    // sim thread, a copy for the UI, refreshed every few calls
+    const std::shared_ptr<const CallGraphCounts> &Publish();
+
+    // the whole tree with inclusive cycles
+    std::shared_ptr<const CallGraphCounts> Totals() const;
+
+    // callgrind format for kcachegrind/qcachegrind. contexts are merged per function, edges keep
+    // their call counts and inclusive cycles. name turns an entry address into a function name
+    bool WriteCallgrind(const std::string &path, const std::string &object,
+                        const std::function<std::string(uint32_t addr)> &name) const;
+
+    size_t Depth() const { return stack.size() - 1; }
+    uint64_t Overflows() const { return overflows; }
+
+private:
+    struct Frame {
+        int node;
+        uint32_t sp;            // SP the matching ret leaves behind
+    };
+
+    static uint8_t Classify(uint16_t opcode);
+    void Control(avr_t *avr);
+    int Child(int parent, uint32_t addr, bool isr);
+    uint32_t PushedAddress(const avr_t *avr, uint16_t sp) const;
+
+    avr_t *avr = nullptr;
+    std::vector<uint8_t> kinds;     // per flash word
+    std::vector<CallNode> nodes;
+    std::unordered_map<uint64_t, int> children;     // parent + 1 << 32 | addr -> node
+    std::vector<Frame> stack;
+
+    // Before -> After
+    uint8_t kind = 0;
+    uint16_t sp = 0;
+    uint8_t interrupts = 0;
+
+    avr_cycle_count_t lastCycle = 0;
+    uint64_t overflows = 0;         // calls past the depth limit, charged to their caller
+
+    std::shared_ptr<const CallGraphCounts> published;
+    uint32_t publishes = 0;
+};
+
+#endif // SIMGETCALLGRAPH_H
@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "simgetcheckpoint.h"
+
+// literal runs end at this many zero bytes, shorter gaps are cheaper to copy through
+static const size_t MIN_ZERO_RUN = 4;
+
+static void PutVarint(std::vector<uint8_t> &out, size_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+static bool GetVarint(const std::vector<uint8_t> &in, size_t &pos, size_t &v)
+{
+    v = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7)
+    {
+        uint8_t b = in[pos++];
+        v |= (size_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+void PackDelta(const uint8_t *prev, const uint8_t *cur, size_t size, std::vector<uint8_t> &out)
+{
+    out.clear();
+
+    auto diff = [&](size_t i) -> uint8_t { return prev ? prev[i] ^ cur[i] : cur[i]; };
+
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t zeros = 0;
+        while (i + zeros < size && !diff(i + zeros))
+            zeros++;
+        i += zeros;
+
+        // literal run until a long enough stretch of zeros or the end
+        size_t literal = 0, gap = 0;
+        while (i + literal + gap < size && gap < MIN_ZERO_RUN)
+        {
+            if (diff(i + literal + gap))
+            {
+                literal += gap + 1;
+                gap = 0;
+            }
+            else
+            {
+                gap++;
+            }
+        }
+
+        if (!literal)
+            break;
+
+        PutVarint(out, zeros);
+        PutVarint(out, literal);
+        for (size_t k = 0; k < literal; k++)
+            out.push_back(diff(i + k));
+        i += literal;
+    }
+}
+
+bool UnpackDelta(const std::vector<uint8_t> &packed, uint8_t *blob, size_t size)
+{
+    size_t pos = 0, at = 0;
+
+    while (pos < packed.size())
+    {
+        size_t zeros, literal;
+        if (!GetVarint(packed, pos, zeros) || !GetVarint(packed, pos, literal))
+            return false;
+
+        at += zeros;
+        if (at + literal > size || pos + literal > packed.size())
+            return false;
+
+        for (size_t k = 0; k < literal; k++)
+            blob[at + k] ^= packed[pos + k];
+        at += literal;
+        pos += literal;
+    }
+    return true;
+}
+
+void CheckpointRing::Push(const std::vector<uint8_t> &blob, avr_cycle_count_t cycle)
+{
+    // a different machine layout can't be a delta of the old one
+    if (!entries.empty() && blob.size() != last.size())
+        Clear();
+
+    Entry entry;
+    entry.cycle = cycle;
+    entry.key = entries.empty() || sinceKey + 1 >= keyInterval;
+
+    PackDelta(entry.key ? nullptr : last.data(), blob.data(), blob.size(), entry.packed);
+    sinceKey = entry.key ? 0 : sinceKey + 1;
+
+    bytes += entry.packed.size();
+    entries.push_back(std::move(entry));
+    last = blob;
+
+    while (bytes > budget && entries.size() > 1)
+        DropOldest();
+}
+
+void CheckpointRing::DropOldest()
+{
+    // the next entry becomes the key frame its followers are based on
+    if (!entries[1].key)
+    {
+        std::vector<uint8_t> blob;
+        Get(1, blob);
+
+        Entry &next = entries[1];
+        bytes -= next.packed.size();
+        PackDelta(nullptr, blob.data(), blob.size(), next.packed);
+        next.key = true;
+        bytes += next.packed.size();
+    }
+
+    bytes -= entries.front().packed.size();
+    entries.pop_front();
+}
+
+bool CheckpointRing::Get(size_t index, std::vector<uint8_t> &blob) const
+{
+    if (index >= entries.size())
+        return false;
+
+    size_t key = index;
+    while (!entries[key].key)
+        key--;
+
+    blob.assign(last.size(), 0);
+    for (size_t i = key; i <= index; i++)
+    {
+        if (!UnpackDelta(entries[i].packed, blob.data(), blob.size()))
+            return false;
+    }
+    return true;
+}
+
+int CheckpointRing::Find(avr_cycle_count_t cycle) const
+{
+    for (size_t i = entries.size(); i-- > 0;)
+    {
+        if (entries[i].cycle <= cycle)
+            return i;
+    }
+    return -1;
+}
+
+void CheckpointRing::Truncate(avr_cycle_count_t cycle)
+{
+    while (!entries.empty() && entries.back().cycle > cycle)
+    {
+        bytes -= entries.back().packed.size();
+        entries.pop_back();
+    }
+
+    if (entries.empty())
+    {
+        Clear();
+        return;
+    }
+
+    // the next delta is based on the new newest entry
+    Get(entries.size() - 1, last);
+    sinceKey = 0;
+    for (size_t i = entries.size() - 1; !entries[i].key; i--)
+        sinceKey++;
+}
+
+void CheckpointRing::Clear()
+{
+    entries.clear();
+    last.clear();
+    bytes = 0;
+    sinceKey = 0;
+}
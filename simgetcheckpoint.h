@@ -0,0 +1,58 @@
+#ifndef SIMGETCHECKPOINT_H
+#define SIMGETCHECKPOINT_H
+
+#include <deque>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "sim_avr.h"
+
+// bounded history of machine state blobs (see AvrSimulator::SaveState).
+// every entry is xor'ed against the one before it and run length coded, with a
+// key frame (coded against zeros) every keyInterval entries so a restore never
+// walks more than that many deltas. the oldest entries are dropped to stay
+// within budget bytes.
+class CheckpointRing {
+public:
+    size_t budget = 16 << 20;       // bytes of packed entries
+    uint32_t keyInterval = 32;
+
+    void Push(const std::vector<uint8_t> &blob, avr_cycle_count_t cycle);
+
+    // unpack entry 'index', 0 is the oldest
+    bool Get(size_t index, std::vector<uint8_t> &blob) const;
+
+    // newest entry taken at or before 'cycle', -1 if none
+    int Find(avr_cycle_count_t cycle) const;
+
+    // drop every entry taken after 'cycle', the timeline diverged from there
+    void Truncate(avr_cycle_count_t cycle);
+
+    size_t Size() const { return entries.size(); }
+    avr_cycle_count_t Cycle(size_t index) const { return entries[index].cycle; }
+    size_t Bytes() const { return bytes; }
+    void Clear();
+
+private:
+    struct Entry {
+        avr_cycle_count_t cycle;
+        bool key;
+        std::vector<uint8_t> packed;
+    };
+
+    void DropOldest();
+
+    std::deque<Entry> entries;
+    std::vector<uint8_t> last;      // unpacked newest entry, the base for the next delta
+    size_t bytes = 0;
+    uint32_t sinceKey = 0;
+};
+
+// xor 'cur' against 'prev' (zeros if null) into runs of <zero count, literal count, literals>
+void PackDelta(const uint8_t *prev, const uint8_t *cur, size_t size, std::vector<uint8_t> &out);
+
+// apply a packed delta in place, false if it is corrupt
+bool UnpackDelta(const std::vector<uint8_t> &packed, uint8_t *blob, size_t size);
+
+#endif // SIMGETCHECKPOINT_H
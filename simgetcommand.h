@@ -0,0 +1,140 @@
+#ifndef SIMGETCOMMAND_H
+#define SIMGETCOMMAND_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim_avr.h"
+
+// UI side mutations of the machine, applied by the sim thread between instructions
+enum SimCommandType {
+    CMD_SET_PIN = 0,    // port/bit driven to value through the ioport pin irq
+    CMD_POKE_DATA,      // data[addr] = (data[addr] & ~mask) | (value & mask)
+    CMD_WRITE_FLASH,    // flash[addr] = value
+    CMD_SPINNER_RPM,    // rotor speed, target is the rpm in thousandths
+    CMD_RESET,
+    CMD_SET_RUN,        // value 0/1
+    CMD_SET_ANIMATE,    // value 0/1
+    CMD_ANIMATE_RATE,   // value is the AvrSimulator::ANIMATE_ unit, target the rate per wall second in thousandths
+    CMD_STEP,           // one instruction
+    CMD_STEP_OVER,      // one instruction, a call runs until it returns
+    CMD_STEP_OUT,       // until the running function returns
+    CMD_RUN_TO,         // until the pc reaches flash byte address addr
+    CMD_RUN_CYCLES,     // 'target' cycles
+    CMD_RESTART,        // back to the state right after Initialize
+    CMD_RESTORE,        // the checkpoint taken on cycle 'target'
+    CMD_SEEK,           // re-execute to the first instruction boundary at or after 'target'
+    CMD_REVERSE_STEP,   // back to the previous instruction boundary
+    CMD_REVERSE_CONTINUE,   // back to the last breakpoint hit, or the oldest checkpoint
+    CMD_BREAKPOINT,     // value 0/1 at flash byte address addr
+    CMD_BREAKPOINT_POSTED,  // take the conditional breakpoints handed over with BreakpointTable::Post
+    CMD_PROFILE,        // value 0/1, addr is the sample period in cycles, 0 counts every instruction
+    CMD_PROFILE_CLEAR,
+    CMD_CALLGRAPH,      // value 0/1
+    CMD_CALLGRAPH_CLEAR,
+    CMD_DIFF_CHECKPOINTS,   // the checkpoints taken on cycles 'base' and 'target'
+    CMD_WATCHPOINT,     // target bytes from data address addr, bit is WATCH_READ/WRITE/VALUE, value/mask to match
+    CMD_WATCHPOINT_REMOVE,  // the watchpoints starting at addr
+    CMD_COUNT
+};
+
+struct SimCommand {
+    uint8_t type = CMD_COUNT;
+    char port = 0;
+    uint8_t bit = 0;
+    uint8_t mask = 0xff;
+    uint32_t addr = 0;
+    uint32_t value = 0;
+    uint64_t target = 0;
+    uint64_t base = 0;
+    avr_cycle_count_t cycle = 0;    // stamped by the sim thread when it took effect
+};
+
+const char *GetSimCommandName(int type);
+
+// single producer, single consumer ring. no locks, one side each.
+template <class T, size_t N>
+class SpscQueue {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // producer side, false if full
+    bool Push(const T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tailCache == N)
+        {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h - tailCache == N)
+                return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false if empty
+    bool Pop(T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == headCache)
+        {
+            headCache = head.load(std::memory_order_acquire);
+            if (t == headCache)
+                return false;
+        }
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, one relaxed load in the common empty case
+    bool Empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_relaxed);
+    }
+
+private:
+    T items[N];
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tailCache = 0;                   // producer's view of tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t headCache = 0;                   // consumer's view of head
+};
+
+// lets a queue's consumer block instead of polling. the producer pays a fence and a load
+// per Notify, the lock and the syscall only when the consumer is actually asleep
+class Wakeup {
+public:
+    // any thread, after pushing or otherwise making the consumer's ready() true
+    void Notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping.load(std::memory_order_relaxed))
+            return;
+        { std::lock_guard<std::mutex> hold(lock); }
+        wake.notify_one();
+    }
+
+    // consumer side, returns once ready() holds
+    template <class Ready>
+    void Wait(Ready ready)
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        sleeping.store(true, std::memory_order_relaxed);
+        // pairs with the fence in Notify, either ready() sees the push or Notify sees us
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake.wait(hold, ready);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> sleeping{false};
+    std::mutex lock;
+    std::condition_variable wake;
+};
+
+#endif // SIMGETCOMMAND_H
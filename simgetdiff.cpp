@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <string.h>
+
+#include "simgetdiff.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static inline void Mark(std::vector<DiffRange> &out, uint32_t start, uint32_t end)
+{
+    if (!out.empty() && out.back().end == start)
+        out.back().end = end;
+    else
+        out.push_back({ start, end });
+}
+
+static void DiffScalar(const uint8_t *a, const uint8_t *b, size_t from, size_t to, std::vector<DiffRange> &out)
+{
+    for (size_t i = from; i < to; i++)
+    {
+        if (a[i] != b[i])
+            Mark(out, (uint32_t)i, (uint32_t)i + 1);
+    }
+}
+
+#if defined(__SSE2__)
+
+// one bit per differing byte of a 16 byte block
+static inline uint32_t DiffMask(const uint8_t *a, const uint8_t *b)
+{
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+    return ~(uint32_t)_mm_movemask_epi8(eq) & 0xffff;
+}
+
+static inline bool Same64(const uint8_t *a, const uint8_t *b)
+{
+    __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b));
+    __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + 16)), _mm_loadu_si128((const __m128i *)(b + 16)));
+    __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + 32)), _mm_loadu_si128((const __m128i *)(b + 32)));
+    __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + 48)), _mm_loadu_si128((const __m128i *)(b + 48)));
+    return _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3))) == 0xffff;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+static inline uint32_t DiffMask(const uint8_t *a, const uint8_t *b)
+{
+    // no movemask on neon, weigh each lane by its bit and add the halves up
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t ne = vmvnq_u8(vceqq_u8(vld1q_u8(a), vld1q_u8(b)));
+    uint8x16_t bits = vandq_u8(ne, vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(bits)) | (vaddv_u8(vget_high_u8(bits)) << 8);
+}
+
+static inline bool Same64(const uint8_t *a, const uint8_t *b)
+{
+    uint8x16_t e0 = vceqq_u8(vld1q_u8(a), vld1q_u8(b));
+    uint8x16_t e1 = vceqq_u8(vld1q_u8(a + 16), vld1q_u8(b + 16));
+    uint8x16_t e2 = vceqq_u8(vld1q_u8(a + 32), vld1q_u8(b + 32));
+    uint8x16_t e3 = vceqq_u8(vld1q_u8(a + 48), vld1q_u8(b + 48));
+    return vminvq_u8(vandq_u8(vandq_u8(e0, e1), vandq_u8(e2, e3))) == 0xff;
+}
+
+#else
+
+static inline uint32_t DiffMask(const uint8_t *a, const uint8_t *b)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < 16; i++)
+        mask |= (uint32_t)(a[i] != b[i]) << i;
+    return mask;
+}
+
+static inline bool Same64(const uint8_t *a, const uint8_t *b)
+{
+    return memcmp(a, b, 64) == 0;
+}
+
+#endif
+
+void DiffBytes(const uint8_t *a, const uint8_t *b, size_t size, std::vector<DiffRange> &out)
+{
+    out.clear();
+
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        if (Same64(a + i, b + i))
+            continue;
+
+        for (size_t block = i; block < i + 64; block += 16)
+        {
+            // runs of set bits become ranges
+            uint32_t mask = DiffMask(a + block, b + block);
+            while (mask)
+            {
+                int first = __builtin_ctz(mask);
+                int length = __builtin_ctz(~(mask >> first));
+                Mark(out, (uint32_t)(block + first), (uint32_t)(block + first + length));
+                mask &= ~(((1u << length) - 1) << first);
+            }
+        }
+    }
+
+    DiffScalar(a, b, i, size, out);
+}
+
+bool InDiff(const std::vector<DiffRange> &ranges, uint32_t offset)
+{
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), offset,
+                               [](uint32_t o, const DiffRange &r) { return o < r.start; });
+    return it != ranges.begin() && offset < (it - 1)->end;
+}
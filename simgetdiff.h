@@ -0,0 +1,31 @@
+#ifndef SIMGETDIFF_H
+#define SIMGETDIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// [start, end) byte offsets that differ
+struct DiffRange {
+    uint32_t start;
+    uint32_t end;
+};
+
+// compares 64 bytes a step with SSE2 or NEON where there is one, the unchanged bulk of
+// sram costs a few instructions per cache line. adjacent differing bytes come out as one
+// range, ascending
+void DiffBytes(const uint8_t *a, const uint8_t *b, size_t size, std::vector<DiffRange> &out);
+
+// true if offset falls in one of the ranges, binary search
+bool InDiff(const std::vector<DiffRange> &ranges, uint32_t offset);
+
+// data space of two checkpoints side by side
+struct DataDiff {
+    uint64_t cycleA = 0;
+    uint64_t cycleB = 0;
+    std::vector<uint8_t> a;
+    std::vector<uint8_t> b;
+    std::vector<DiffRange> ranges;
+};
+
+#endif // SIMGETDIFF_H
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <thread>
+
+#include "simgetpool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+    : threads(threads)
+{
+    if (!this->threads)
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool WorkStealingPool::Next(unsigned self, std::function<void()> *&job)
+{
+    {
+        Queue &own = queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned i = 1; i < queues.size(); i++)
+    {
+        Queue &victim = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+
+    // nothing gets queued once Run started, so empty everywhere means done
+    return false;
+}
+
+void WorkStealingPool::Run(std::vector<std::function<void()>> &jobs)
+{
+    unsigned workers = std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1));
+
+    queues = std::vector<Queue>(workers);
+    for (size_t i = 0; i < jobs.size(); i++)
+        queues[i % workers].jobs.push_back(&jobs[i]);
+
+    auto work = [this](unsigned self)
+    {
+        std::function<void()> *job;
+        while (Next(self, job))
+            (*job)();
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < workers; i++)
+        pool.emplace_back(work, i);
+
+    // the calling thread is worker 0
+    work(0);
+
+    for (std::thread &t : pool)
+        t.join();
+
+    queues.clear();
+}
@@ -0,0 +1,34 @@
+#ifndef SIMGETPOOL_H
+#define SIMGETPOOL_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// fixed set of jobs spread over one deque per worker. a worker pops from the
+// back of its own deque and steals from the front of the others when it runs dry,
+// so long scenarios don't leave the other cores idle at the end of a sweep.
+class WorkStealingPool {
+public:
+    // 0 threads = one per core
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    // runs every job, returns when all are done. jobs must not throw.
+    void Run(std::vector<std::function<void()>> &jobs);
+
+    unsigned Threads() const { return threads; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()> *> jobs;
+    };
+
+    bool Next(unsigned self, std::function<void()> *&job);
+
+    unsigned threads;
+    std::vector<Queue> queues;
+};
+
+#endif // SIMGETPOOL_H
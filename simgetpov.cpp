@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+#include "simgetpov.h"
+
+extern "C" {
+    #include "simavr/sim/avr_ioport.h"
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// leds sit on rings OFFSET units out, one unit apart, as the spinner window draws them
+static const int OFFSET = 3;
+
+// the port bits in led order, see POV_LEDS
+static inline uint16_t PackLanes(const uint8_t ports[3])
+{
+    const uint8_t a = ports[0], b = ports[1], d = ports[2];
+    return (d & 0x03) | ((d >> 2) & 0x1c) | ((b & 0x1f) << 5) | ((a & 0x03) << 10);
+}
+
+#if defined(__SSE2__)
+
+// weight added to the leds that are on, each lane's bit turned into a full width mask
+static inline void AddLanes(float *out, uint16_t lanes, float weight)
+{
+    const __m128i v = _mm_set1_epi32(lanes);
+    const __m128 w = _mm_set1_ps(weight);
+    const __m128i bits[3] = { _mm_setr_epi32(1, 2, 4, 8), _mm_setr_epi32(16, 32, 64, 128),
+                              _mm_setr_epi32(256, 512, 1024, 2048) };
+    for (int i = 0; i < 3; i++)
+    {
+        __m128i on = _mm_cmpeq_epi32(_mm_and_si128(v, bits[i]), bits[i]);
+        _mm_storeu_ps(out + 4 * i, _mm_add_ps(_mm_loadu_ps(out + 4 * i), _mm_and_ps(w, _mm_castsi128_ps(on))));
+    }
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+static inline void AddLanes(float *out, uint16_t lanes, float weight)
+{
+    static const uint32_t bits[POV_LEDS] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048 };
+    const uint32x4_t v = vdupq_n_u32(lanes);
+    const uint32x4_t w = vreinterpretq_u32_f32(vdupq_n_f32(weight));
+    for (int i = 0; i < 3; i++)
+    {
+        uint32x4_t on = vtstq_u32(v, vld1q_u32(bits + 4 * i));
+        vst1q_f32(out + 4 * i, vaddq_f32(vld1q_f32(out + 4 * i), vreinterpretq_f32_u32(vandq_u32(w, on))));
+    }
+}
+
+#else
+
+static inline void AddLanes(float *out, uint16_t lanes, float weight)
+{
+    for (int i = 0; i < POV_LEDS; i++)
+    {
+        if ((lanes >> i) & 1)
+            out[i] += weight;
+    }
+}
+
+#endif
+
+PovImage::PovImage()
+    : ring(new SpscQueue<PovEvent, 1 << 16>())
+{
+}
+
+PovImage::~PovImage()
+{
+    Stop();
+}
+
+const char PovImage::NAMES[3] = { 'A', 'B', 'D' };
+
+void PovImage::Attach(avr_t *avr, const SpinnerRotor *rotor)
+{
+    this->avr = avr;
+    this->rotor = rotor;
+
+    for (int port = 0; port < 3; port++)
+    {
+        avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(NAMES[port]), IOPORT_IRQ_REG_PORT);
+        if (!irq)
+            continue;
+        ports[port] = (uint8_t)irq->value;
+        probes.emplace_back(new Probe{ this, irq, port });
+    }
+    lanes = PackLanes(ports);
+
+    // the sensor fires once a turn, so leds that stay put still get swept
+    if (rotor && rotor->Sensor())
+        probes.emplace_back(new Probe{ this, rotor->Sensor(), -1 });
+
+    for (auto &p : probes)
+        avr_irq_register_notify(p->irq, OnIrq, p.get());
+}
+
+void PovImage::Resync()
+{
+    if (probes.empty())
+        return;
+
+    for (auto &p : probes)
+    {
+        avr_ioport_state_t state;
+        if (p->port >= 0 && avr_ioctl(avr, AVR_IOCTL_IOPORT_GETSTATE(NAMES[p->port]), &state) == 0)
+            ports[p->port] = state.port;
+    }
+    lanes = PackLanes(ports);
+
+    // even with the leds unchanged, the worker starts the next stretch from here
+    Record();
+}
+
+void PovImage::OnIrq(avr_irq_t *irq, uint32_t value, void *param)
+{
+    Probe *p = (Probe *)param;
+    PovImage *pov = p->pov;
+
+    if (p->port >= 0)
+    {
+        pov->ports[p->port] = (uint8_t)value;
+        uint16_t lanes = PackLanes(pov->ports);
+        if (lanes == pov->lanes)
+            return;
+        pov->lanes = lanes;
+    }
+
+    pov->Record();
+}
+
+void PovImage::Record()
+{
+    const PovEvent ev = { avr->cycle, rotor ? rotor->Turns(avr->cycle) : 0.0, lanes };
+    if (ring->Push(ev))
+    {
+        recorded.fetch_add(1, std::memory_order_relaxed);
+        wakeup.Notify();
+    }
+    else
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PovImage::Start(int size)
+{
+    this->size = size;
+    exposure.assign(BINS * POV_LEDS, 0.0f);
+    swept.assign(BINS, 0.0f);
+
+    // each pixel's bin and led, worked out once. y grows downwards like the spinner's angle
+    lookup.assign(size * size, -1);
+    const double scale = (size / 2.0) / (POV_LEDS + OFFSET - 0.5);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            const double dx = x + 0.5 - size / 2.0, dy = y + 0.5 - size / 2.0;
+            const int led = (int)floor(sqrt(dx * dx + dy * dy) / scale - (OFFSET - 0.5));
+            if (led < 0 || led >= POV_LEDS)
+                continue;
+            double turn = atan2(dy, dx) / (2 * M_PI);
+            turn -= floor(turn);
+            lookup[y * size + x] = std::min((int)(turn * BINS), BINS - 1) * POV_LEDS + led;
+        }
+    }
+
+    running = true;
+    thread = std::thread(&PovImage::WorkerThread, this);
+}
+
+void PovImage::Stop()
+{
+    for (auto &p : probes)
+        avr_irq_unregister_notify(p->irq, OnIrq, p.get());
+    probes.clear();
+
+    if (!running)
+        return;
+
+    running = false;
+    wakeup.Notify();
+    if (thread.joinable())
+        thread.join();
+}
+
+void PovImage::Clear()
+{
+    clear = true;
+    wakeup.Notify();
+}
+
+void PovImage::Accumulate(double from, double to, uint16_t lanes)
+{
+    // longer than a turn lights every angle the same, one turn of it says as much
+    if (to - from > 1)
+        from = to - 1;
+
+    double at = (from - floor(from)) * BINS;
+    double left = (to - from) * BINS;
+    while (left > 0)
+    {
+        const int bin = std::min((int)at, BINS - 1);
+        const double step = std::min(bin + 1 - at, left);
+        AddLanes(&exposure[bin * POV_LEDS], lanes, (float)step);
+        swept[bin] += (float)step;
+        at += step;
+        left -= step;
+        if (at >= BINS)
+            at -= BINS;
+    }
+}
+
+void PovImage::Decay(float factor)
+{
+    for (float &e : exposure)
+        e *= factor;
+    for (float &s : swept)
+        s *= factor;
+}
+
+void PovImage::Render(PovFrame &frame)
+{
+    frame.size = size;
+    frame.rgba.resize(size * size);
+    frame.events = recorded.load(std::memory_order_relaxed);
+    frame.turns = last.turns;
+
+    // how long each led was on while its bin went past, a dim track where it never was
+    for (size_t i = 0; i < lookup.size(); i++)
+    {
+        const int32_t index = lookup[i];
+        if (index < 0)
+        {
+            frame.rgba[i] = 0xff000000;
+            continue;
+        }
+        const float sweep = swept[index / POV_LEDS];
+        const float on = sweep > 0 ? std::min(exposure[index] / sweep, 1.0f) : 0.0f;
+        frame.rgba[i] = 0xff000000 | (uint32_t)(24 + 231 * on);
+    }
+}
+
+void PovImage::WorkerThread()
+{
+    auto lastRender = std::chrono::steady_clock::now();
+    bool dirty = true;
+    PovEvent ev;
+
+    for (;;)
+    {
+        // read the flag first so nothing pushed before Stop is left behind
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        if (clear.exchange(false))
+        {
+            std::fill(exposure.begin(), exposure.end(), 0.0f);
+            std::fill(swept.begin(), swept.end(), 0.0f);
+            dirty = true;
+        }
+
+        while (ring->Pop(ev))
+        {
+            // a reset, restore or reverse seek goes back in time, pick up from there
+            const bool forward = started && ev.cycle >= last.cycle;
+            if (forward)
+                Accumulate(last.turns, ev.turns, last.lanes);
+
+            // what the eye keeps of earlier turns
+            const int64_t turn = (int64_t)floor(ev.turns);
+            if (forward && turn > lastTurn)
+                Decay(powf(persistence.load(std::memory_order_relaxed), (float)std::min<int64_t>(turn - lastTurn, 64)));
+
+            lastTurn = turn;
+            last = ev;
+            started = true;
+            dirty = true;
+        }
+
+        if (stopping)
+            break;
+
+        // about a display frame apart, the UI uploads whatever is newest. until then keep
+        // draining the ring so a burst of changes doesn't overflow it
+        if (dirty)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (now - lastRender < std::chrono::milliseconds(16))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            Render(frames.Back());
+            frames.Publish();
+            lastRender = now;
+            dirty = false;
+        }
+
+        // nothing to show, asleep until Record, Clear or Stop
+        wakeup.Wait([this] { return !ring->Empty() || clear.load() || !running.load(std::memory_order_acquire); });
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef SIMGETPOV_H
+#define SIMGETPOV_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "sim_avr.h"
+#include "simgetcommand.h"
+#include "simgetsnapshot.h"
+#include "simgetspinner.h"
+
+// the 12 spinner leds, centre out: PD0 PD1 PD4 PD5 PD6 PB0..PB4 PA0 PA1
+const int POV_LEDS = 12;
+
+// one change of the led outputs, stamped on the sim thread with the cycle and the rotor
+// position it happened at
+struct PovEvent {
+    uint64_t cycle;
+    double turns;
+    uint16_t lanes;         // bit n is led n
+};
+
+// the image a persistence of vision display leaves, as many angle columns per led
+// as pixels, square rgba for a texture
+struct PovFrame {
+    std::vector<uint32_t> rgba;     // 0xaabbggrr
+    int size = 0;
+    uint64_t events = 0;
+    double turns = 0;
+};
+
+// rebuilds what the spinning leds draw. PORTA/B/D writes are hooked on the sim thread and
+// every led change goes into a lock free ring with its rotor angle, so nothing is lost to
+// the UI's frame rate. a worker thread spreads each stretch between changes over the angle
+// bins it swept, decays the exposure once a turn and publishes the image.
+class PovImage {
+public:
+    PovImage();
+    ~PovImage();
+
+    // hooks the port registers and the rotor's sensor pin. the sim thread must not be running
+    void Attach(avr_t *avr, const SpinnerRotor *rotor);
+    // sim thread, after a reset or restored state changed the ports without their irqs firing.
+    // reads the port registers back and records where the capture picks up from
+    void Resync();
+
+    // worker thread, size is the square image's side in pixels
+    void Start(int size = 256);
+    // unhooks and joins the worker. the sim thread must be stopped
+    void Stop();
+
+    // UI side, Update() then Front()
+    TripleBuffer<PovFrame> frames;
+
+    std::atomic<float> persistence{0.8f};  // exposure kept from one turn to the next
+    // any thread, the worker drops the exposure so far
+    void Clear();
+
+    uint64_t Recorded() const { return recorded.load(std::memory_order_relaxed); }
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Probe {
+        PovImage *pov;
+        avr_irq_t *irq;
+        int port;           // 0 PORTA, 1 PORTB, 2 PORTD, -1 the sensor
+    };
+    static const char NAMES[3];
+
+    static void OnIrq(avr_irq_t *irq, uint32_t value, void *param);
+    void Record();
+
+    void WorkerThread();
+    void Accumulate(double from, double to, uint16_t lanes);
+    void Decay(float factor);
+    void Render(PovFrame &frame);
+
+    // sim thread
+    avr_t *avr = nullptr;
+    const SpinnerRotor *rotor = nullptr;
+    std::vector<std::unique_ptr<Probe>> probes;
+    uint8_t ports[3] = {};
+    uint16_t lanes = 0;
+
+    // 64k events, 1.5MB
+    std::unique_ptr<SpscQueue<PovEvent, 1 << 16>> ring;
+    std::atomic<uint64_t> recorded{0};
+    std::atomic<uint64_t> dropped{0};
+    Wakeup wakeup;                  // the worker sleeps on the ring while there's nothing to draw
+    std::atomic<bool> clear{false};
+
+    // worker thread only. per angle bin the led exposure and the time the bin was swept
+    static const int BINS = 512;
+    std::vector<float> exposure;    // BINS x POV_LEDS
+    std::vector<float> swept;       // BINS
+    std::vector<int32_t> lookup;    // pixel to bin * POV_LEDS + led, -1 off the leds
+    int size = 0;
+    bool started = false;
+    PovEvent last = {};
+    int64_t lastTurn = 0;
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+};
+
+#endif // SIMGETPOV_H
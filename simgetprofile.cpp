@@ -0,0 +1,114 @@
+#include <algorithm>
+
+#include "simgetprofile.h"
+
+extern "C" {
+    #include "simavr/sim/sim_cycle_timers.h"
+}
+
+// snapshots go out every few ms, the counters are copied for every 16th of them
+static const uint32_t publishEvery = 16;
+
+void Profiler::Attach(avr_t *avr)
+{
+    exact = false;
+    every = 0;
+    period = 0;
+    hits.assign((avr->flashend + 1) / 2, 0);
+    cycles.assign(hits.size(), 0);
+    published.reset();
+    publishes = 0;
+}
+
+void Profiler::Start(avr_t *avr, uint32_t every)
+{
+    exact = every == 0;
+    this->every = every;
+    period = every;
+    Arm(avr);
+}
+
+void Profiler::Stop(avr_t *avr)
+{
+    if (!Active())
+        return;
+
+    // one last copy so the UI keeps showing what was counted
+    published.reset();
+    Publish();
+
+    exact = false;
+    every = 0;
+    avr_cycle_timer_cancel(avr, Sample, this);
+}
+
+void Profiler::Clear()
+{
+    std::fill(hits.begin(), hits.end(), 0);
+    std::fill(cycles.begin(), cycles.end(), 0);
+    published.reset();
+}
+
+void Profiler::Arm(avr_t *avr)
+{
+    avr_cycle_timer_cancel(avr, Sample, this);
+    if (every)
+        avr_cycle_timer_register(avr, every, Sample, this);
+}
+
+avr_cycle_count_t Profiler::Sample(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    Profiler *p = (Profiler *)param;
+
+    const size_t word = avr->pc >> 1;
+    if (!p->quiet && word < p->hits.size())
+    {
+        p->hits[word]++;
+        p->cycles[word] += p->every;
+    }
+    return when + p->every;
+}
+
+const std::shared_ptr<const ProfileCounts> &Profiler::Publish()
+{
+    if (!Active() || (published && ++publishes % publishEvery))
+        return published;
+
+    std::shared_ptr<ProfileCounts> counts = std::make_shared<ProfileCounts>();
+    counts->hits = hits;
+    counts->cycles = cycles;
+    counts->sampled = every != 0;
+    for (uint64_t c : cycles)
+    {
+        counts->totalCycles += c;
+        counts->maxCycles = std::max(counts->maxCycles, c);
+    }
+
+    published = counts;
+    return published;
+}
+
+std::vector<Hotspot> Profiler::Hotspots(size_t count) const
+{
+    std::vector<Hotspot> spots;
+    for (size_t i = 0; i < cycles.size(); i++)
+    {
+        if (hits[i])
+            spots.push_back({ (uint32_t)(i * 2), hits[i], cycles[i] });
+    }
+
+    count = std::min(count, spots.size());
+    std::partial_sort(spots.begin(), spots.begin() + count, spots.end(), [](const Hotspot &a, const Hotspot &b) {
+        return a.cycles != b.cycles ? a.cycles > b.cycles : a.addr < b.addr;
+    });
+    spots.resize(count);
+    return spots;
+}
+
+uint64_t Profiler::TotalCycles() const
+{
+    uint64_t total = 0;
+    for (uint64_t c : cycles)
+        total += c;
+    return total;
+}
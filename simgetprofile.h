@@ -0,0 +1,79 @@
+#ifndef SIMGETPROFILE_H
+#define SIMGETPROFILE_H
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "sim_avr.h"
+
+// counters as of one publish, shared by every snapshot that carries them
+struct ProfileCounts {
+    std::vector<uint64_t> hits;     // per flash word
+    std::vector<uint64_t> cycles;
+    uint64_t totalCycles = 0;
+    uint64_t maxCycles = 0;         // hottest word, scales the heat
+    bool sampled = false;           // hits are samples, cycles the sample period times that
+};
+
+// one line of a hotspot report
+struct Hotspot {
+    uint32_t addr;                  // flash byte address
+    uint64_t hits;
+    uint64_t cycles;
+};
+
+// where the cpu spends its time, per flash word. exact mode counts every instruction
+// from the sim thread's step loop with the cycles it took, sleep and interrupt entry
+// included. sampling mode leaves the step loop alone and reads the pc from a cycle
+// timer every N cycles, for long runs where exact counting costs too much.
+class Profiler {
+public:
+    // sizes the counters for this core and stops profiling
+    void Attach(avr_t *avr);
+
+    // 0 cycles is exact mode
+    void Start(avr_t *avr, uint32_t every);
+    void Stop(avr_t *avr);
+    void Clear();
+
+    // puts the sampling timer back after a reset or a state load dropped or duplicated it
+    void Arm(avr_t *avr);
+
+    bool Active() const { return exact || every; }
+
+    // sim thread, exact mode, the instruction at pc took 'cycles'
+    void Count(uint32_t pc, avr_cycle_count_t cycles)
+    {
+        const size_t word = pc >> 1;
+        if (word < hits.size()) {
+            hits[word]++;
+            this->cycles[word] += cycles;
+        }
+    }
+
+    bool exact = false;             // the step loop calls Count
+    bool quiet = false;             // re-executing known history, it was counted the first time
+
+    // sim thread, a copy for the UI, refreshed every few calls
+    const std::shared_ptr<const ProfileCounts> &Publish();
+
+    // the top 'count' words by cycles, most expensive first
+    std::vector<Hotspot> Hotspots(size_t count) const;
+    uint64_t TotalCycles() const;
+    // of the last Start, still set after Stop
+    uint32_t SampleEvery() const { return period; }
+
+private:
+    static avr_cycle_count_t Sample(avr_t *avr, avr_cycle_count_t when, void *param);
+
+    std::vector<uint64_t> hits;
+    std::vector<uint64_t> cycles;
+    uint32_t every = 0;
+    uint32_t period = 0;
+
+    std::shared_ptr<const ProfileCounts> published;
+    uint32_t publishes = 0;
+};
+
+#endif // SIMGETPROFILE_H
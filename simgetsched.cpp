@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+
+#include "simgetavr.h"
+#include "simgetsched.h"
+
+// fall this far behind wall time and pacing re-bases instead of bursting to catch up
+static const double MAX_LAG_USEC = 250000;
+
+const char *GetPaceModeName(int mode)
+{
+    switch (mode)
+    {
+    case PACE_MAX:
+        return "max speed";
+    case PACE_REALTIME:
+        return "real time";
+    case PACE_MULTIPLIER:
+        return "multiplier";
+    default:
+        return "unknown";
+    }
+}
+
+SimScheduler::SimScheduler(AvrSimulator &sim)
+    : sim(sim)
+{
+}
+
+SimScheduler::~SimScheduler()
+{
+    Stop();
+}
+
+void SimScheduler::Start()
+{
+    if (thread.joinable())
+        return;
+
+    quit = false;
+    thread = std::thread([this]() { Loop(); });
+}
+
+void SimScheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+bool SimScheduler::Post(const SimCommand &cmd)
+{
+    if (!sim.commands.Push(cmd))
+    {
+        std::cerr << "sim command queue full, dropped " << GetSimCommandName(cmd.type) << std::endl;
+        return false;
+    }
+    Wake();
+    return true;
+}
+
+void SimScheduler::Wake()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wakeups++;
+    }
+    wake.notify_all();
+}
+
+void SimScheduler::ResetPacing()
+{
+    paced = true;
+    pacedMode = mode;
+    pacedMultiplier = multiplier;
+    origin = std::chrono::steady_clock::now();
+    simUsec = 0;
+    speedStart = origin;
+    speedSimUsec = 0;
+    driftUsec = 0;
+}
+
+void SimScheduler::Loop()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+
+            if (!quit && !sim.run && !sim.animate && !sim.step)
+            {
+                sim.PublishSnapshot();
+
+                parked = true;
+                paced = false;
+                speed = 0;
+                uint32_t seen = wakeups;
+                wake.wait(guard, [this, seen]() { return quit || sim.run || sim.animate || sim.step || wakeups != seen; });
+            }
+            if (quit)
+                break;
+        }
+        parked = false;
+
+        // input posted while parked, between animate steps or while pacing
+        if (!sim.commands.Empty())
+            sim.ApplyCommands();
+
+        if (sim.step)
+        {
+            // run control goes flat out and the snapshot published on parking is the first the
+            // UI hears of it, unless the target is far enough off to want a stop button
+            const uint32_t frequency = sim.avr->frequency ? sim.avr->frequency : 1000000;
+            if (!sim.RunTowards(std::max<avr_cycle_count_t>(1, (avr_cycle_count_t)frequency * quantumUsec / 1000000)))
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (now - lastPublish >= std::chrono::milliseconds(250))
+                {
+                    sim.PublishSnapshot();
+                    lastPublish = now;
+                }
+            }
+            continue;
+        }
+
+        if (sim.animate)
+        {
+            // animate owes instructions by wall time, sleep until the next one is due. high
+            // rates come round every millisecond and run a batch, low ones wake for each
+            const avr_cycle_count_t before = sim.avr->cycle;
+            sim.RunAnimate();
+            if (sim.avr->cycle != before || !sim.animate)
+                sim.PublishSnapshot();
+            const double due = std::min(std::max(sim.AnimateDueUsec(), 1000.0), 100000.0);
+            std::unique_lock<std::mutex> guard(lock);
+            uint32_t seen = wakeups;
+            wake.wait_for(guard, std::chrono::microseconds((int64_t)due), [this, seen]() { return quit || wakeups != seen; });
+            paced = false;
+            continue;
+        }
+
+        if (!sim.run)
+            continue;
+
+        if (!paced || pacedMode != mode || pacedMultiplier != multiplier)
+            ResetPacing();
+
+        // frequency can change under a clock prescaler, so size and account each quantum with the current one
+        const uint32_t frequency = sim.avr->frequency ? sim.avr->frequency : 1000000;
+        const avr_cycle_count_t quantum = std::max<avr_cycle_count_t>(1, (avr_cycle_count_t)frequency * quantumUsec / 1000000);
+        const avr_cycle_count_t before = sim.avr->cycle;
+
+        int state = sim.RunQuantum(quantum);
+
+        simUsec += (double)(sim.avr->cycle - before) * 1000000.0 / frequency;
+        speedSimUsec += (double)(sim.avr->cycle - before) * 1000000.0 / frequency;
+
+        if (state == cpu_Done || state == cpu_Crashed)
+        {
+            sim.run = false;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (now - lastPublish >= std::chrono::milliseconds(4))
+        {
+            sim.PublishSnapshot();
+            lastPublish = now;
+        }
+
+        double elapsed = std::chrono::duration<double, std::micro>(now - speedStart).count();
+        if (elapsed >= 500000)
+        {
+            speed = speedSimUsec / elapsed;
+            speedStart = now;
+            speedSimUsec = 0;
+        }
+
+        if (pacedMode == PACE_MAX)
+        {
+            driftUsec = 0;
+            continue;
+        }
+
+        const double scale = pacedMode == PACE_REALTIME ? 1.0 : std::max(pacedMultiplier, 1e-6);
+        const double wallUsec = std::chrono::duration<double, std::micro>(now - origin).count();
+        const double dueUsec = simUsec / scale;
+        const double drift = wallUsec - dueUsec;
+
+        driftUsec = drift;
+        if (std::abs(drift) > maxDriftUsec)
+            maxDriftUsec = std::abs(drift);
+
+        if (drift > MAX_LAG_USEC)
+        {
+            // the host can't keep up with this rate, stop owing time
+            slips++;
+            ResetPacing();
+            continue;
+        }
+
+        if (drift < 0)
+        {
+            // ahead of wall time, sleep it off unless someone needs us
+            std::unique_lock<std::mutex> guard(lock);
+            uint32_t seen = wakeups;
+            wake.wait_until(guard, origin + std::chrono::microseconds((int64_t)dueUsec),
+                            [this, seen]() { return quit || wakeups != seen; });
+        }
+    }
+
+    parked = true;
+}
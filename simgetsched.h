@@ -0,0 +1,78 @@
+#ifndef SIMGETSCHED_H
+#define SIMGETSCHED_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "simgetcommand.h"
+
+class AvrSimulator;
+
+// how fast the sim thread runs relative to wall time
+enum PaceMode {
+    PACE_MAX = 0,       // as fast as the host allows
+    PACE_REALTIME,      // 1x of avr->frequency
+    PACE_MULTIPLIER,    // fixed multiple of avr->frequency
+    PACE_COUNT
+};
+
+const char *GetPaceModeName(int mode);
+
+// runs the simulator on its own thread in cycle quanta, paced against wall time,
+// and parks on a condition variable while neither run nor animate is set
+class SimScheduler {
+public:
+    explicit SimScheduler(AvrSimulator &sim);
+    ~SimScheduler();
+
+    void Start();
+    void Stop();
+
+    // queue a command for the sim thread and wake it if parked. UI thread only.
+    bool Post(const SimCommand &cmd);
+
+    // a parked thread re-checks its flags and publishes a fresh snapshot
+    void Wake();
+
+    std::atomic<int> mode{PACE_REALTIME};
+    std::atomic<double> multiplier{1.0};
+
+    // simulated time per quantum, the cycle count follows avr->frequency
+    uint32_t quantumUsec = 1000;
+
+    // measured by the sim thread
+    std::atomic<double> driftUsec{0};       // wall time minus paced simulated time, > 0 is behind
+    std::atomic<double> maxDriftUsec{0};
+    std::atomic<double> speed{0};           // simulated seconds per wall second over the last interval
+    std::atomic<uint32_t> slips{0};         // times pacing gave up catching up and re-based
+    std::atomic<bool> parked{true};
+
+private:
+    void Loop();
+    void ResetPacing();
+
+    AvrSimulator &sim;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool quit = false;
+    uint32_t wakeups = 0;
+
+    // pacing origin, re-based whenever the thread parks or the mode changes
+    bool paced = false;
+    int pacedMode = PACE_MAX;
+    double pacedMultiplier = 1.0;
+    std::chrono::steady_clock::time_point origin;
+    double simUsec = 0;
+
+    std::chrono::steady_clock::time_point speedStart;
+    double speedSimUsec = 0;
+
+    // snapshots are throttled to about the display rate while running flat out
+    std::chrono::steady_clock::time_point lastPublish;
+};
+
+#endif // SIMGETSCHED_H
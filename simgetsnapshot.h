@@ -0,0 +1,106 @@
+#ifndef SIMGETSNAPSHOT_H
+#define SIMGETSNAPSHOT_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "sim_avr.h"
+#include "simgetcommand.h"
+#include "simgetprofile.h"
+#include "simgetcallgraph.h"
+#include "simgetdiff.h"
+#include "simgetwatch.h"
+#include "simgetbreak.h"
+
+// [start, end) of io data addresses
+struct IoRange {
+    uint16_t start;
+    uint16_t end;
+};
+
+// [start, end) of flash byte addresses, empty when start == end
+struct FlashRange {
+    uint32_t start = 0;
+    uint32_t end = 0;
+};
+
+// what the UI thread gets to see of the machine, copied out by the sim thread
+struct SimSnapshot {
+    uint64_t sequence = 0;          // increments with every publish
+    avr_cycle_count_t cycle = 0;
+    avr_flashaddr_t pc = 0;
+    uint8_t sreg[8] = {0};
+    uint16_t sp = 0;
+    int state = 0;
+    uint64_t instructions = 0;
+    std::vector<uint8_t> data;      // data space up to ramend: registers, io and sram
+    std::vector<IoRange> dirtyIo;   // io ranges that changed since the previous snapshot the UI took
+    FlashRange dirtyFlash;          // flash written or restored since the previous snapshot the UI took
+    bool running = false;
+    bool animating = false;
+    int animateUnit = 0;            // AvrSimulator::ANIMATE_
+    double animateRate = 0;         // asked for, per wall second
+    double animateAchieved = 0;     // measured
+    bool stepping = false;          // a run control target is still ahead
+    double rotorRpm = 0;            // spinner, 0 without one
+    double rotorAngle = 0;          // radians from top dead centre at 'cycle'
+    uint64_t rotorTurns = 0;
+    std::vector<SimCommand> recentCommands;     // last few applied, oldest first
+    size_t checkpoints = 0;                     // entries in the checkpoint ring
+    size_t checkpointBytes = 0;
+    avr_cycle_count_t checkpointFirst = 0;      // cycle of the oldest and newest entry
+    avr_cycle_count_t checkpointLast = 0;
+    std::vector<avr_cycle_count_t> checkpointCycles;  // every entry, oldest first
+    avr_cycle_count_t timelineEnd = 0;          // furthest cycle a seek can go forward to
+    std::vector<Breakpoint> breakpoints;        // ascending by address
+    uint64_t breakpointGeneration = 0;          // BreakpointTable::Generation of the copy above
+    std::vector<TracepointHit> tracepointHits;  // last few, oldest first
+    uint64_t tracepointCount = 0;
+    std::vector<uint64_t> watchChanges;         // per --add-trace signal
+    std::vector<Watchpoint> watchpoints;
+    std::vector<WatchHit> watchHits;            // last few, oldest first
+    uint64_t watchHitCount = 0;
+    std::shared_ptr<const ProfileCounts> profile;   // null until profiling starts
+    bool profiling = false;                     // counters still moving
+    std::shared_ptr<const CallGraphCounts> callGraph;   // null until the call graph is started
+    bool callGraphing = false;
+    std::shared_ptr<const DataDiff> checkpointDiff; // last CMD_DIFF_CHECKPOINTS
+};
+
+// single writer, single reader. the writer fills Back() and publishes it, the reader
+// picks up the most recent publish with Update() and reads Front(). neither side blocks.
+template <class T>
+class TripleBuffer {
+public:
+    // writer side
+    T &Back() { return buffers[back]; }
+    void Publish()
+    {
+        back = present.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+    // the reader has picked up the last publish. if not, the next one replaces it unseen
+    bool Taken() const { return !(present.load(std::memory_order_acquire) & FRESH); }
+
+    // reader side, returns true if Front() changed
+    bool Update()
+    {
+        if (!(present.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = present.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T &Front() const { return buffers[front]; }
+
+private:
+    static const uint8_t INDEX = 3;
+    static const uint8_t FRESH = 4;
+
+    T buffers[3];
+    std::atomic<uint8_t> present{1};
+    uint8_t back = 0;
+    uint8_t front = 2;
+};
+
+#endif // SIMGETSNAPSHOT_H
@@ -0,0 +1,87 @@
+#include <math.h>
+
+#include "simgetspinner.h"
+
+extern "C" {
+    #include "simavr/sim/avr_ioport.h"
+    #include "simavr/sim/sim_cycle_timers.h"
+}
+
+SpinnerRotor::SpinnerRotor(double rpm, char port, int bit) : port(port), bit(bit)
+{
+    state.rpm = rpm;
+}
+
+void SpinnerRotor::Attach(avr_t *avr)
+{
+    irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit);
+
+    state.anchor = avr->cycle;
+    state.turns = 0;
+    SetRpm(avr, state.rpm);
+}
+
+void SpinnerRotor::Arm(avr_t *avr)
+{
+    avr_cycle_timer_cancel(avr, Fire, this);
+
+    if (state.period > 0)
+        avr_cycle_timer_register(avr, TdcCycle(NextTurn(avr->cycle)) - (int64_t)avr->cycle, Fire, this);
+}
+
+void SpinnerRotor::SetRpm(avr_t *avr, double rpm)
+{
+    // the clock can change under a prescaler, a revolution is sized with the current one
+    const uint32_t frequency = avr->frequency ? avr->frequency : 1000000;
+
+    state.turns = Turns(avr->cycle);
+    state.anchor = avr->cycle;
+    state.rpm = rpm > 0 ? rpm : 0;
+    state.period = rpm > 0 ? frequency * 60.0 / rpm : 0;
+
+    Arm(avr);
+}
+
+double SpinnerRotor::Turns(avr_cycle_count_t cycle) const
+{
+    if (state.period <= 0)
+        return state.turns;
+    return state.turns + (double)((int64_t)cycle - (int64_t)state.anchor) / state.period;
+}
+
+double SpinnerRotor::Angle(avr_cycle_count_t cycle) const
+{
+    const double turns = Turns(cycle);
+    return (turns - floor(turns)) * 2 * M_PI;
+}
+
+int64_t SpinnerRotor::TdcCycle(int64_t n) const
+{
+    return (int64_t)state.anchor + (int64_t)ceil((n - state.turns) * state.period);
+}
+
+int64_t SpinnerRotor::NextTurn(avr_cycle_count_t cycle) const
+{
+    // the float guess can be one out either way right on a boundary
+    int64_t n = (int64_t)floor(Turns(cycle)) + 1;
+    while (TdcCycle(n) <= (int64_t)cycle)
+        n++;
+    while (TdcCycle(n - 1) > (int64_t)cycle)
+        n--;
+    return n;
+}
+
+avr_cycle_count_t SpinnerRotor::Fire(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    SpinnerRotor *r = (SpinnerRotor *)param;
+    if (r->state.period <= 0)
+        return 0;
+
+    // the revolution that came round on 'when', even after a restored checkpoint brought
+    // this timer back. the sensor toggles once a revolution
+    const int64_t next = r->NextTurn(when);
+    if (r->irq)
+        avr_raise_irq(r->irq, (next - 1) & 1);
+
+    return r->TdcCycle(next);
+}
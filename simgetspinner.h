@@ -0,0 +1,56 @@
+#ifndef SIMGETSPINNER_H
+#define SIMGETSPINNER_H
+
+#include <stdint.h>
+
+#include "sim_avr.h"
+
+// the spinner's rotor in simulated time. a cycle timer toggles the top dead centre sensor
+// pin on the exact cycle each revolution comes round, the angle in between is worked out
+// from avr->cycle. what the firmware sees depends on the rpm alone, not on the sim speed
+// or the display's frame rate
+class SpinnerRotor {
+public:
+    // sensor on PD3 unless told otherwise, 0 rpm stands still
+    explicit SpinnerRotor(double rpm = 0, char port = 'D', int bit = 3);
+
+    // resolves the sensor pin and arms from the current cycle.
+    // called from Initialize, before the power on state is saved.
+    void Attach(avr_t *avr);
+
+    // re-arm from avr->cycle, after avr_reset cleared the cycle timers
+    void Arm(avr_t *avr);
+
+    // sim thread, the angle carries on from where it is
+    void SetRpm(avr_t *avr, double rpm);
+    double Rpm() const { return state.rpm; }
+    // the sensor pin's irq once attached, null if the core has no such pin
+    avr_irq_t *Sensor() const { return irq; }
+
+    // revolutions since Attach, the fraction is the way round
+    double Turns(avr_cycle_count_t cycle) const;
+    // radians from top dead centre, [0, 2pi)
+    double Angle(avr_cycle_count_t cycle) const;
+
+    // what checkpoints carry, so stepping back through an rpm change replays it exactly
+    struct State {
+        avr_cycle_count_t anchor;   // cycle the current rpm took over
+        double turns;               // revolutions at anchor
+        double period;              // cycles a revolution, 0 standing still
+        double rpm;
+    };
+    State state = {};
+
+private:
+    static avr_cycle_count_t Fire(avr_t *avr, avr_cycle_count_t when, void *param);
+
+    // cycle on which revolution n comes round, and the first revolution after 'cycle'
+    int64_t TdcCycle(int64_t n) const;
+    int64_t NextTurn(avr_cycle_count_t cycle) const;
+
+    char port;
+    int bit;
+    avr_irq_t *irq = nullptr;
+};
+
+#endif // SIMGETSPINNER_H
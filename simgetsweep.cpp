@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <ctype.h>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <sstream>
+
+#include "simgetsweep.h"
+#include "simgetpool.h"
+
+// firmware loading goes through libelf and simavr globals, only the runs are parallel
+static std::mutex loadLock;
+
+static std::string Trim(const std::string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+static bool ParseStimulus(const std::string &text, Stimulus &stim)
+{
+    std::istringstream in(text);
+    std::string kind;
+    unsigned long long cycle;
+
+    if (!(in >> cycle >> kind))
+        return false;
+
+    stim.cycle = cycle;
+
+    if (kind == "pin")
+    {
+        std::string pin;
+        unsigned value;
+        if (!(in >> pin >> value) || pin.size() != 2 || pin[1] < '0' || pin[1] > '7')
+            return false;
+        stim.cmd.type = CMD_SET_PIN;
+        stim.cmd.port = toupper(pin[0]);
+        stim.cmd.bit = pin[1] - '0';
+        stim.cmd.value = value;
+        return true;
+    }
+
+    if (kind == "poke")
+    {
+        std::string addr, value;
+        if (!(in >> addr >> value))
+            return false;
+        stim.cmd.type = CMD_POKE_DATA;
+        stim.cmd.addr = strtoul(addr.c_str(), nullptr, 0);
+        stim.cmd.value = strtoul(value.c_str(), nullptr, 0);
+        return true;
+    }
+
+    if (kind == "reset")
+    {
+        stim.cmd.type = CMD_RESET;
+        return true;
+    }
+
+    return false;
+}
+
+// one scenario per rpm, named name@<rpm>rpm when there is more than one
+static void ExpandRpm(const Scenario &scenario, const std::vector<double> &rpms, std::vector<Scenario> &scenarios)
+{
+    if (rpms.size() <= 1)
+    {
+        scenarios.push_back(scenario);
+        if (rpms.size())
+            scenarios.back().rpm = rpms[0];
+    }
+    else
+    {
+        for (double rpm : rpms)
+        {
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "@%grpm", rpm);
+            scenarios.push_back(scenario);
+            scenarios.back().rpm = rpm;
+            scenarios.back().name += suffix;
+        }
+    }
+}
+
+// one scenario per frequency, named name@freq when there is more than one, then per rpm
+static void ExpandScenario(const Scenario &scenario, const std::vector<uint32_t> &frequencies,
+                           const std::vector<double> &rpms, std::vector<Scenario> &scenarios)
+{
+    if (frequencies.size() <= 1)
+    {
+        Scenario s = scenario;
+        if (frequencies.size())
+            s.frequency = frequencies[0];
+        ExpandRpm(s, rpms, scenarios);
+    }
+    else
+    {
+        for (uint32_t freq : frequencies)
+        {
+            Scenario s = scenario;
+            s.frequency = freq;
+            s.name += "@" + std::to_string(freq);
+            ExpandRpm(s, rpms, scenarios);
+        }
+    }
+}
+
+bool LoadScenarioFile(const std::string &path, std::vector<Scenario> &scenarios)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "can't open scenario file " << path << std::endl;
+        return false;
+    }
+
+    const size_t loaded = scenarios.size();
+    Scenario defaults, current;
+    std::vector<uint32_t> defaultFreqs, freqs;
+    std::vector<double> defaultRpms, rpms;
+    bool inScenario = false;
+    std::string line;
+    int lineNo = 0;
+
+    auto finish = [&]()
+    {
+        if (!inScenario)
+            return;
+        size_t first = scenarios.size();
+        ExpandScenario(current, freqs, rpms, scenarios);
+        for (size_t i = first; i < scenarios.size(); i++)
+            std::stable_sort(scenarios[i].stimuli.begin(), scenarios[i].stimuli.end(),
+                             [](const Stimulus &a, const Stimulus &b) { return a.cycle < b.cycle; });
+    };
+
+    while (std::getline(in, line))
+    {
+        lineNo++;
+
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        line = Trim(line);
+        if (line.empty())
+            continue;
+
+        if (line.front() == '[' && line.back() == ']')
+        {
+            finish();
+            current = defaults;
+            current.name = Trim(line.substr(1, line.size() - 2));
+            freqs = defaultFreqs;
+            rpms = defaultRpms;
+            inScenario = true;
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+        {
+            std::cerr << path << ":" << lineNo << ": expected key=value" << std::endl;
+            return false;
+        }
+
+        std::string key = Trim(line.substr(0, eq));
+        std::string value = Trim(line.substr(eq + 1));
+        Scenario &target = inScenario ? current : defaults;
+        std::vector<uint32_t> &targetFreqs = inScenario ? freqs : defaultFreqs;
+        std::vector<double> &targetRpms = inScenario ? rpms : defaultRpms;
+
+        if (key == "firmware")
+            target.firmware = value;
+        else if (key == "mcu")
+            target.mcu = value;
+        else if (key == "cycles")
+            target.cycles = strtoull(value.c_str(), nullptr, 0);
+        else if (key == "usec")
+            target.usec = strtoull(value.c_str(), nullptr, 0);
+        else if (key == "freq")
+        {
+            std::istringstream list(value);
+            uint32_t freq;
+            targetFreqs.clear();
+            while (list >> freq)
+                targetFreqs.push_back(freq);
+        }
+        else if (key == "rpm")
+        {
+            std::istringstream list(value);
+            double rpm;
+            targetRpms.clear();
+            while (list >> rpm)
+                targetRpms.push_back(rpm);
+        }
+        else if (key == "stim")
+        {
+            Stimulus stim;
+            if (!ParseStimulus(value, stim))
+            {
+                std::cerr << path << ":" << lineNo << ": bad stimulus '" << value << "'" << std::endl;
+                return false;
+            }
+            target.stimuli.push_back(stim);
+        }
+        else
+        {
+            std::cerr << path << ":" << lineNo << ": unknown key '" << key << "'" << std::endl;
+            return false;
+        }
+    }
+
+    finish();
+
+    // keys with no [section] only set defaults, a sweep of nothing would pass silently
+    if (scenarios.size() == loaded)
+    {
+        std::cerr << path << ": no scenarios, each one starts with a [name] line" << std::endl;
+        return false;
+    }
+
+    for (const Scenario &s : scenarios)
+    {
+        if (s.firmware.empty() || (!s.cycles && !s.usec))
+        {
+            std::cerr << path << ": scenario '" << s.name << "' needs firmware and cycles or usec" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct ScenarioResult {
+    bool loaded = false;
+    RunStats stats;
+};
+
+// headless run in segments, applying each stimulus at its cycle
+static void RunScenario(const Scenario &scenario, ScenarioResult &result, const volatile sig_atomic_t *stop)
+{
+    AvrSimulator sim;
+    sim.disassemble = false;
+
+    SpinnerRotor rotor(scenario.rpm);
+    if (scenario.rpm > 0)
+        sim.rotor = &rotor;
+
+    {
+        std::lock_guard<std::mutex> guard(loadLock);
+        if (!sim.Initialize(scenario.mcu, scenario.firmware, scenario.frequency))
+            return;
+    }
+    result.loaded = true;
+
+    avr_cycle_count_t end = UINT64_MAX;
+    const char *endReason = "cycles";
+    if (scenario.cycles)
+        end = scenario.cycles;
+    if (scenario.usec)
+    {
+        avr_cycle_count_t timeCycle = (avr_cycle_count_t)((double)scenario.usec * scenario.frequency / 1000000.0);
+        if (timeCycle < end)
+        {
+            end = timeCycle;
+            endReason = "time";
+        }
+    }
+
+    RunStats &total = result.stats;
+    total.reason = endReason;
+    total.state = sim.avr->state;
+
+    size_t next = 0;
+    while (sim.avr->cycle < end)
+    {
+        while (next < scenario.stimuli.size() && scenario.stimuli[next].cycle <= sim.avr->cycle)
+        {
+            sim.commands.Push(scenario.stimuli[next++].cmd);
+            sim.ApplyCommands();
+        }
+
+        avr_cycle_count_t until = end;
+        if (next < scenario.stimuli.size())
+            until = std::min(until, scenario.stimuli[next].cycle);
+
+        HeadlessLimits limits;
+        limits.cycles = until - sim.avr->cycle;
+        limits.stop = stop;
+
+        RunStats part = sim.RunHeadless(limits);
+        total.cycles += part.cycles;
+        total.instructions += part.instructions;
+        total.wallSeconds += part.wallSeconds;
+        total.state = part.state;
+
+        if (part.state == cpu_Done || part.state == cpu_Crashed || (stop && *stop))
+        {
+            total.reason = part.reason;
+            break;
+        }
+    }
+
+    total.mhz = total.wallSeconds > 0 ? total.cycles / total.wallSeconds / 1000000.0 : 0;
+}
+
+int RunSweep(const std::vector<Scenario> &scenarios, unsigned jobs, const volatile sig_atomic_t *stop)
+{
+    std::vector<ScenarioResult> results(scenarios.size());
+    std::vector<std::function<void()>> work;
+
+    // each job writes only its own result slot
+    for (size_t i = 0; i < scenarios.size(); i++)
+        work.push_back([&, i]() { RunScenario(scenarios[i], results[i], stop); });
+
+    WorkStealingPool pool(jobs);
+
+    auto start = std::chrono::steady_clock::now();
+    pool.Run(work);
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int status = 0;
+    uint64_t totalCycles = 0;
+    double cpuSeconds = 0;
+
+    printf("{\"jobs\":%u,\"scenarios\":[", pool.Threads());
+    for (size_t i = 0; i < scenarios.size(); i++)
+    {
+        const Scenario &s = scenarios[i];
+        const RunStats &stats = results[i].stats;
+
+        printf("%s\n  {\"name\":\"%s\",\"firmware\":\"%s\",\"mcu\":\"%s\",\"frequency\":%u,\"rpm\":%g,\"stimuli\":%zu,",
+               i ? "," : "", s.name.c_str(), s.firmware.c_str(), s.mcu.c_str(), s.frequency, s.rpm, s.stimuli.size());
+
+        if (!results[i].loaded)
+        {
+            printf("\"state\":\"error\",\"stop_reason\":\"load\"}");
+            status = std::max(status, 1);
+            continue;
+        }
+
+        printf("\"cycles\":%llu,\"instructions\":%llu,\"sim_usec\":%.3f,\"wall_seconds\":%.6f,"
+               "\"effective_mhz\":%.3f,\"state\":\"%s\",\"stop_reason\":\"%s\"}",
+               (unsigned long long)stats.cycles, (unsigned long long)stats.instructions,
+               s.frequency ? stats.cycles * 1000000.0 / s.frequency : 0.0,
+               stats.wallSeconds, stats.mhz, GetAvrStateName(stats.state), stats.reason);
+
+        totalCycles += stats.cycles;
+        cpuSeconds += stats.wallSeconds;
+        if (stats.state == cpu_Crashed)
+            status = 2;
+    }
+
+    // speedup is the summed per scenario run time over the sweep's wall time
+    printf("\n  ],\"total_cycles\":%llu,\"wall_seconds\":%.6f,\"aggregate_mhz\":%.3f,\"speedup\":%.2f}\n",
+           (unsigned long long)totalCycles, wallSeconds,
+           wallSeconds > 0 ? totalCycles / wallSeconds / 1000000.0 : 0.0,
+           wallSeconds > 0 ? cpuSeconds / wallSeconds : 0.0);
+    fflush(stdout);
+
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef SIMGETSWEEP_H
+#define SIMGETSWEEP_H
+
+#include <string>
+#include <vector>
+#include <signal.h>
+
+#include "simgetavr.h"
+
+// a command applied once the simulator reaches 'cycle'
+struct Stimulus {
+    avr_cycle_count_t cycle = 0;
+    SimCommand cmd;
+};
+
+// one independent headless run
+struct Scenario {
+    std::string name;
+    std::string firmware;
+    std::string mcu = "attiny4313";
+    uint32_t frequency = 1000000;
+    uint64_t cycles = 0;                // simulated cycles, 0 = no limit
+    uint64_t usec = 0;                  // simulated time, 0 = no limit
+    double rpm = 0;                     // spinner TDC sensor on PD3, 0 = no spinner
+    std::vector<Stimulus> stimuli;      // sorted by cycle
+};
+
+// scenario file, key=value per line, # comments.
+// keys before the first [name] are defaults for every scenario after it.
+//
+//   firmware=elliePOV.hex
+//   mcu=attiny4313
+//   cycles=100000000
+//
+//   [spin]
+//   freq=1000000 8000000          several values expand to spin@1000000, spin@8000000
+//   rpm=600 1200                  so do several rpms, spin@600rpm, and with freq spin@1000000@600rpm
+//   stim=40000 pin D3 1           at cycle 40000 drive PD3 high
+//   stim=40100 pin D3 0
+//   stim=0 poke 0x60 0xff         data space write
+//   stim=90000 reset
+bool LoadScenarioFile(const std::string &path, std::vector<Scenario> &scenarios);
+
+// runs every scenario on a work stealing pool (jobs 0 = one per core) and prints
+// one JSON report. returns 2 if any scenario crashed, 1 if one failed to load.
+int RunSweep(const std::vector<Scenario> &scenarios, unsigned jobs, const volatile sig_atomic_t *stop);
+
+#endif // SIMGETSWEEP_H
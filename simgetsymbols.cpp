@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <stdio.h>
+
+#include "simgetsymbols.h"
+
+// simavr's segment offsets for the elf address spaces
+static const uint32_t dataOffset = 0x800000;
+static const uint32_t eepromOffset = 0x810000;
+static const uint32_t spaceEnd = 0x820000;     // fuses, lock bits and signature follow
+
+void SymbolIndex::Load(const elf_firmware_t &firmware)
+{
+    Clear();
+
+    for (uint32_t i = 0; i < firmware.symbolcount; i++)
+    {
+        const avr_symbol_t *s = firmware.symbol[i];
+        if (!s || !s->symbol[0])
+            continue;
+
+        if (s->addr < dataOffset)
+            Add(SYMBOL_FLASH, s->addr, s->size, s->symbol);
+        else if (s->addr < eepromOffset)
+            Add(SYMBOL_DATA, s->addr - dataOffset, s->size, s->symbol);
+        else if (s->addr < spaceEnd)
+            Add(SYMBOL_EEPROM, s->addr - eepromOffset, s->size, s->symbol);
+    }
+
+    Finish();
+}
+
+void SymbolIndex::Add(SymbolSpace space, uint32_t addr, uint32_t size, const std::string &name)
+{
+    tables[space].symbols.push_back({ addr, size, name });
+}
+
+// of several names for one address keep the sized one, then the one that isn't a
+// compiler or library internal, then the shortest
+static bool Preferred(const Symbol &a, const Symbol &b)
+{
+    if ((a.size != 0) != (b.size != 0))
+        return a.size != 0;
+    if ((a.name[0] == '_') != (b.name[0] == '_'))
+        return a.name[0] != '_';
+    return a.name.size() < b.name.size();
+}
+
+void SymbolIndex::Finish()
+{
+    for (int space = 0; space < SYMBOL_SPACES; space++)
+    {
+        std::vector<Symbol> &symbols = tables[space].symbols;
+
+        std::sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) {
+            return a.addr != b.addr ? a.addr < b.addr : Preferred(a, b);
+        });
+        symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                                  [](const Symbol &a, const Symbol &b) { return a.addr == b.addr; }),
+                      symbols.end());
+
+        // assembler labels come without a size. in flash they run up to the next symbol,
+        // a bare data label only names its first byte
+        for (size_t i = 0; i < symbols.size(); i++)
+        {
+            if (symbols[i].size)
+                continue;
+            if (space == SYMBOL_FLASH && i + 1 < symbols.size())
+                symbols[i].size = symbols[i + 1].addr - symbols[i].addr;
+            else
+                symbols[i].size = space == SYMBOL_FLASH ? 2 : 1;
+        }
+
+        // a symbol that doesn't cover an address past it can't be beaten by anything between
+        // it and the nearest earlier symbol that ends further out, Find jumps straight there
+        std::vector<int32_t> &outer = tables[space].outer;
+        outer.resize(symbols.size());
+        for (size_t i = 0; i < symbols.size(); i++)
+        {
+            const uint32_t end = symbols[i].addr + symbols[i].size;
+            int32_t j = (int32_t)i - 1;
+            while (j >= 0 && symbols[j].addr + symbols[j].size <= end)
+                j = outer[j];
+            outer[i] = j;
+        }
+    }
+}
+
+void SymbolIndex::Clear()
+{
+    for (Table &t : tables)
+    {
+        t.symbols.clear();
+        t.outer.clear();
+    }
+}
+
+const Symbol *SymbolIndex::Find(SymbolSpace space, uint32_t addr) const
+{
+    const Table &t = tables[space];
+
+    // the last symbol starting at or before addr, then out through the ones around it
+    int32_t i = (int32_t)(std::upper_bound(t.symbols.begin(), t.symbols.end(), addr,
+                                           [](uint32_t a, const Symbol &s) { return a < s.addr; }) -
+                          t.symbols.begin()) - 1;
+    for (; i >= 0; i = t.outer[i])
+    {
+        if (addr < t.symbols[i].addr + t.symbols[i].size)
+            return &t.symbols[i];
+    }
+    return nullptr;
+}
+
+const Symbol *SymbolIndex::At(SymbolSpace space, uint32_t addr) const
+{
+    const std::vector<Symbol> &symbols = tables[space].symbols;
+
+    auto it = std::lower_bound(symbols.begin(), symbols.end(), addr,
+                               [](const Symbol &s, uint32_t a) { return s.addr < a; });
+    return it != symbols.end() && it->addr == addr ? &*it : nullptr;
+}
+
+const Symbol *SymbolIndex::Lookup(const std::string &name, SymbolSpace space) const
+{
+    for (const Symbol &s : tables[space].symbols)
+    {
+        if (s.name == name)
+            return &s;
+    }
+    return nullptr;
+}
+
+int SymbolIndex::Format(SymbolSpace space, uint32_t addr, char *out, size_t size) const
+{
+    const Symbol *s = Find(space, addr);
+    if (!s)
+    {
+        if (size)
+            out[0] = 0;
+        return 0;
+    }
+
+    int n = addr == s->addr ? snprintf(out, size, "%s", s->name.c_str())
+                            : snprintf(out, size, "%s+0x%x", s->name.c_str(), addr - s->addr);
+    return std::min<int>(n, size ? (int)size - 1 : 0);
+}
+
+std::string SymbolIndex::Label(SymbolSpace space, uint32_t addr) const
+{
+    char text[128];
+    Format(space, addr, text, sizeof(text));
+    return text;
+}
+
+bool SymbolIndex::Empty() const
+{
+    for (const Table &t : tables)
+    {
+        if (!t.symbols.empty())
+            return false;
+    }
+    return true;
+}
+
+static void PutU32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static uint32_t GetU32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void SymbolIndex::Serialize(SymbolSpace space, std::vector<uint8_t> &out) const
+{
+    for (const Symbol &s : tables[space].symbols)
+    {
+        const size_t length = std::min<size_t>(s.name.size(), 255);
+        PutU32(out, s.addr);
+        PutU32(out, s.size);
+        out.push_back((uint8_t)length);
+        out.insert(out.end(), s.name.begin(), s.name.begin() + length);
+    }
+}
+
+bool SymbolIndex::Deserialize(SymbolSpace space, const uint8_t *in, size_t size)
+{
+    const uint8_t *end = in + size;
+    while (in < end)
+    {
+        if (end - in < 9 || end - in < 9 + in[8])
+            return false;
+
+        Add(space, GetU32(in), GetU32(in + 4), std::string((const char *)in + 9, in[8]));
+        in += 9 + in[8];
+    }
+    Finish();
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef SIMGETSYMBOLS_H
+#define SIMGETSYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "sim_elf.h"
+
+// address spaces of the avr elf, simavr keeps them apart with segment offsets
+enum SymbolSpace {
+    SYMBOL_FLASH,           // byte address
+    SYMBOL_DATA,            // data space address, registers and io included
+    SYMBOL_EEPROM,
+    SYMBOL_SPACES
+};
+
+struct Symbol {
+    uint32_t addr;
+    uint32_t size;          // never 0, see Finish
+    std::string name;
+};
+
+// elf symbols sorted by address per space. every symbol also links the nearest earlier one
+// that ends beyond it, so finding the one covering an address is a binary search plus a walk
+// out through the symbols nested around it, as many steps as they are deep.
+// read only once built, any thread can look things up.
+class SymbolIndex {
+public:
+    // functions and objects from simavr's elf reader, hex files have none
+    void Load(const elf_firmware_t &firmware);
+
+    void Add(SymbolSpace space, uint32_t addr, uint32_t size, const std::string &name);
+    // sorts, drops aliases and gives sizeless symbols a size. after the last Add
+    void Finish();
+    void Clear();
+
+    // innermost symbol covering addr, null if none
+    const Symbol *Find(SymbolSpace space, uint32_t addr) const;
+    // symbol starting exactly at addr
+    const Symbol *At(SymbolSpace space, uint32_t addr) const;
+    // by name, for the command line
+    const Symbol *Lookup(const std::string &name, SymbolSpace space) const;
+
+    // "name" or "name+0x1a" into out, returns the length, 0 with out empty if nothing covers addr
+    int Format(SymbolSpace space, uint32_t addr, char *out, size_t size) const;
+    std::string Label(SymbolSpace space, uint32_t addr) const;
+
+    const std::vector<Symbol> &Symbols(SymbolSpace space) const { return tables[space].symbols; }
+    bool Empty() const;
+
+    // one space as a flat block for a trace file: per symbol u32 addr, u32 size, u8 length, name
+    void Serialize(SymbolSpace space, std::vector<uint8_t> &out) const;
+    bool Deserialize(SymbolSpace space, const uint8_t *in, size_t size);
+
+private:
+    struct Table {
+        std::vector<Symbol> symbols;
+        std::vector<int32_t> outer;     // nearest earlier symbol ending beyond symbols[i], -1 none
+    };
+
+    Table tables[SYMBOL_SPACES];
+};
+
+#endif // SIMGETSYMBOLS_H
@@ -0,0 +1,300 @@
+#include <iostream>
+#include <stdlib.h>
+
+#include "simgettrace.h"
+
+extern "C" {
+    #include "simavr/sim/avr_ioport.h"
+}
+
+static const size_t frameCount = 16;
+
+bool ParseTraceTrigger(const std::string &text, TraceTrigger &trigger)
+{
+    size_t eq = text.find('=');
+    if (eq == std::string::npos)
+        return false;
+
+    std::string kind = text.substr(0, eq);
+    const char *value = text.c_str() + eq + 1;
+    char *end;
+
+    if (kind == "pc")
+    {
+        trigger.kind = TRIGGER_PC;
+        trigger.pc = (uint32_t)strtoul(value, &end, 0);
+        return end != value && !*end;
+    }
+    if (kind == "cycle")
+    {
+        trigger.kind = TRIGGER_CYCLE;
+        trigger.cycle = strtoull(value, &end, 0);
+        return end != value && !*end;
+    }
+    if (kind == "pin")
+    {
+        // PD3:1 or D3:1
+        if (*value == 'P' || *value == 'p')
+            value++;
+        if (!value[0] || !value[1] || value[1] < '0' || value[1] > '7' || value[2] != ':' ||
+            (value[3] != '0' && value[3] != '1') || value[4])
+            return false;
+
+        trigger.kind = TRIGGER_PIN;
+        trigger.port = (char)toupper((unsigned char)value[0]);
+        trigger.bit = value[1] - '0';
+        trigger.level = value[3] - '0';
+        return trigger.port >= 'A' && trigger.port <= 'L';
+    }
+    return false;
+}
+
+InstructionTrace::~InstructionTrace()
+{
+    Close();
+}
+
+bool InstructionTrace::Open(const std::string &path, avr_t *avr, bool registers, const SymbolIndex *symbols)
+{
+    for (TraceTrigger *t : { &start, &stop })
+    {
+        if (t->kind != TRIGGER_PIN)
+            continue;
+
+        t->irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(t->port), t->bit);
+        if (!t->irq)
+        {
+            std::cerr << "trace: " << avr->mmcu << " has no pin P" << t->port << t->bit << std::endl;
+            return false;
+        }
+    }
+
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    // simget-trace labels records with these, it has no elf to go by
+    std::vector<uint8_t> block;
+    if (symbols)
+        symbols->Serialize(SYMBOL_FLASH, block);
+
+    TraceFileHeader header = {};
+    memcpy(header.magic, TRACE_MAGIC, 8);
+    header.frequency = avr->frequency;
+    header.flags = (registers ? TRACE_FLAG_REGS : 0) | (block.empty() ? 0 : TRACE_FLAG_SYMBOLS);
+    if (avr->mmcu)
+        strncpy(header.mcu, avr->mmcu, sizeof(header.mcu) - 1);
+    fwrite(&header, sizeof(header), 1, file);
+    fileBytes = sizeof(header);
+
+    if (!block.empty())
+    {
+        uint32_t size = (uint32_t)block.size();
+        fwrite(&size, sizeof(size), 1, file);
+        fwrite(block.data(), 1, block.size(), file);
+        fileBytes += sizeof(size) + block.size();
+    }
+
+    this->registers = registers;
+    recording = false;
+    finished = false;
+
+    pool.clear();
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        pool.emplace_back(new Frame());
+        pool.back()->raw.reserve(TRACE_FRAME_MAX);
+        empty.Push(pool.back().get());
+    }
+
+    running = true;
+    thread = std::thread(&InstructionTrace::WriterThread, this);
+    return true;
+}
+
+void InstructionTrace::Close()
+{
+    if (!file)
+        return;
+
+    EndFrame();
+
+    running = false;
+    wakeup.Notify();
+    if (thread.joinable())
+        thread.join();
+
+    uint64_t indexOffset = fileBytes;
+    fwrite(index.data(), sizeof(TraceIndexEntry), index.size(), file);
+
+    TraceFooter footer = {};
+    footer.indexOffset = indexOffset;
+    footer.frames = index.size();
+    memcpy(footer.magic, TRACE_INDEX_MAGIC, 8);
+    fwrite(&footer, sizeof(footer), 1, file);
+
+    fclose(file);
+    file = nullptr;
+}
+
+bool InstructionTrace::CheckStart(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle)
+{
+    if (finished || (start.kind != TRIGGER_NONE && !Triggered(start, avr, pc, cycle)))
+        return false;
+
+    recording = true;
+    return true;
+}
+
+void InstructionTrace::Stopped()
+{
+    recording = false;
+    EndFrame();
+
+    // pc and pin windows open again the next time they match
+    if (start.kind != TRIGGER_PC && start.kind != TRIGGER_PIN)
+        finished = true;
+}
+
+void InstructionTrace::ReadRegisters(avr_t *avr, uint8_t *out)
+{
+    memcpy(out, avr->data, 32);
+
+    uint8_t sreg = 0;
+    for (int i = 0; i < 8; i++)
+        sreg |= (avr->sreg[i] ? 1 : 0) << i;
+    out[32] = sreg;
+}
+
+bool InstructionTrace::BeginFrame(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle)
+{
+    if (!empty.Pop(frame))
+    {
+        frame = nullptr;
+        return false;
+    }
+
+    frame->info = {};
+    frame->info.firstCycle = cycle;
+    frame->raw.clear();
+
+    // the record for this instruction follows with no register changes
+    TraceFrameStart s = {};
+    s.cycle = cycle;
+    s.pc = pc;
+    ReadRegisters(avr, regs);
+    memcpy(s.regs, regs, sizeof(regs));
+    frame->raw.insert(frame->raw.end(), (const uint8_t *)&s, (const uint8_t *)&s + sizeof(s));
+
+    lastPc = pc;
+    lastCycle = cycle;
+    return true;
+}
+
+void InstructionTrace::EndFrame()
+{
+    if (!frame)
+        return;
+
+    frame->info.lastCycle = lastCycle;
+    frame->info.rawBytes = (uint32_t)frame->raw.size();
+    full.Push(frame);
+    wakeup.Notify();
+    frame = nullptr;
+}
+
+void InstructionTrace::Append(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle)
+{
+    // a restore, reset or reverse seek moved the clock, start again from absolute state
+    if (frame && cycle != lastCycle)
+        EndFrame();
+
+    if (!frame && !BeginFrame(avr, pc, cycle))
+    {
+        dropped++;
+        return;
+    }
+
+    int64_t words = ((int64_t)pc - (int64_t)lastPc) / 2;
+    uint64_t zigzag = (uint64_t)(words * 2) ^ (uint64_t)(words >> 63);
+
+    uint64_t mask = 0;
+    uint8_t now[TRACE_REGS];
+    if (registers)
+    {
+        ReadRegisters(avr, now);
+        if (memcmp(now, regs, sizeof(now)) != 0)
+        {
+            for (int r = 0; r < TRACE_REGS; r++)
+            {
+                if (now[r] != regs[r])
+                    mask |= 1ull << r;
+            }
+        }
+    }
+
+    std::vector<uint8_t> &out = frame->raw;
+    TracePutVarint(out, zigzag << 1 | (mask ? 1 : 0));
+    TracePutVarint(out, avr->cycle - cycle);
+    if (mask)
+    {
+        TracePutVarint(out, mask);
+        for (int r = 0; r < TRACE_REGS; r++)
+        {
+            if (mask & (1ull << r))
+                out.push_back(now[r]);
+        }
+        memcpy(regs, now, sizeof(regs));
+    }
+
+    frame->info.records++;
+    records++;
+    lastPc = pc;
+    lastCycle = avr->cycle;
+
+    if (out.size() >= TRACE_FRAME_BYTES)
+        EndFrame();
+}
+
+void InstructionTrace::WriterThread()
+{
+    std::vector<uint8_t> packed;
+    Frame *f;
+
+    for (;;)
+    {
+        // read the flag first so a frame queued by Close is still written
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        while (full.Pop(f))
+        {
+            if (f->info.records)
+            {
+                TraceCompress(f->raw.data(), f->raw.size(), packed);
+                f->info.packedBytes = (uint32_t)packed.size();
+
+                TraceIndexEntry entry;
+                entry.info = f->info;
+                entry.offset = fileBytes;
+                index.push_back(entry);
+
+                fwrite(&f->info, sizeof(f->info), 1, file);
+                fwrite(packed.data(), 1, packed.size(), file);
+
+                frames.fetch_add(1, std::memory_order_relaxed);
+                rawBytes.fetch_add(f->raw.size(), std::memory_order_relaxed);
+                fileBytes.fetch_add(sizeof(f->info) + packed.size(), std::memory_order_relaxed);
+            }
+            empty.Push(f);
+        }
+
+        if (stopping)
+            break;
+
+        // asleep until EndFrame hands over a frame or Close stops us
+        wakeup.Wait([this] { return !full.Empty() || !running.load(std::memory_order_acquire); });
+    }
+}
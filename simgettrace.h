@@ -0,0 +1,125 @@
+#ifndef SIMGETTRACE_H
+#define SIMGETTRACE_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sim_avr.h"
+#include "simgetcommand.h"
+#include "simgettracefile.h"
+
+enum TraceTriggerKind {
+    TRIGGER_NONE,
+    TRIGGER_PC,         // instruction at this byte address is about to run
+    TRIGGER_CYCLE,      // cycle reached
+    TRIGGER_PIN,        // pin at this level
+};
+
+// start or stop condition: pc=0x1a4, cycle=100000 or pin=PD3:1
+struct TraceTrigger {
+    TraceTriggerKind kind = TRIGGER_NONE;
+    uint32_t pc = 0;
+    uint64_t cycle = 0;
+    char port = 0;
+    int bit = 0;
+    uint32_t level = 0;
+    avr_irq_t *irq = nullptr;       // resolved on Open
+};
+
+bool ParseTraceTrigger(const std::string &text, TraceTrigger &trigger);
+
+// full execution trace. the sim thread appends one varint record per instruction to a
+// raw frame, full frames go to a writer thread that compresses them and keeps the index.
+// when every frame buffer is still queued the records are dropped and counted, the
+// sim thread never waits on compression or the disk.
+class InstructionTrace {
+public:
+    ~InstructionTrace();
+
+    // start and stop triggers are resolved here. registers adds the changed
+    // registers to every record, about 2x the size.
+    bool Open(const std::string &path, avr_t *avr, bool registers, const SymbolIndex *symbols = nullptr);
+
+    // flushes the current frame, writes the index and closes. sim thread stopped.
+    void Close();
+
+    // sim thread, after every avr_run. pc and cycle are from before it.
+    void Record(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle)
+    {
+        if (!recording && !CheckStart(avr, pc, cycle)) {
+            return;
+        }
+        if (stop.kind != TRIGGER_NONE && Triggered(stop, avr, pc, cycle)) {
+            Stopped();
+            return;
+        }
+        Append(avr, pc, cycle);
+    }
+
+    TraceTrigger start, stop;
+
+    uint64_t Records() const { return records; }
+    uint64_t Dropped() const { return dropped; }
+    uint64_t Frames() const { return frames.load(std::memory_order_relaxed); }
+    uint64_t RawBytes() const { return rawBytes.load(std::memory_order_relaxed); }
+    uint64_t FileBytes() const { return fileBytes.load(std::memory_order_relaxed); }
+
+private:
+    static bool Triggered(const TraceTrigger &t, avr_t *avr, uint32_t pc, avr_cycle_count_t cycle)
+    {
+        switch (t.kind) {
+        case TRIGGER_PC:
+            return pc == t.pc;
+        case TRIGGER_CYCLE:
+            return cycle >= t.cycle;
+        case TRIGGER_PIN:
+            return t.irq && t.irq->value == t.level;
+        default:
+            return true;
+        }
+    }
+
+    bool CheckStart(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle);
+    void Stopped();
+    void Append(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle);
+    bool BeginFrame(avr_t *avr, uint32_t pc, avr_cycle_count_t cycle);
+    void EndFrame();
+    void ReadRegisters(avr_t *avr, uint8_t *regs);
+    void WriterThread();
+
+    struct Frame {
+        TraceFrameInfo info;
+        std::vector<uint8_t> raw;
+    };
+
+    // sim thread
+    bool recording = false;
+    bool finished = false;              // a cycle triggered window doesn't come back
+    bool registers = false;
+    Frame *frame = nullptr;
+    uint32_t lastPc = 0;
+    avr_cycle_count_t lastCycle = 0;
+    uint8_t regs[TRACE_REGS];
+    uint64_t records = 0;
+    uint64_t dropped = 0;
+
+    // frames circulate sim thread -> writer -> sim thread
+    std::vector<std::unique_ptr<Frame>> pool;
+    SpscQueue<Frame *, 32> full;
+    SpscQueue<Frame *, 32> empty;
+    Wakeup wakeup;                      // the writer sleeps on full
+
+    FILE *file = nullptr;
+    std::vector<TraceIndexEntry> index;
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> rawBytes{0};
+    std::atomic<uint64_t> fileBytes{0};
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+};
+
+#endif // SIMGETTRACE_H
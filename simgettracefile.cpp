@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <iostream>
+
+#include "simgettracefile.h"
+
+static inline uint32_t Read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void PutLength(std::vector<uint8_t> &out, size_t len)
+{
+    while (len >= 255)
+    {
+        out.push_back(255);
+        len -= 255;
+    }
+    out.push_back((uint8_t)len);
+}
+
+// token: literal count << 4 | match length - 4, 15 means more length bytes follow.
+// then the literals, a 16 bit offset and the extra match length. the last sequence
+// has literals only.
+static void PutSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t count,
+                        size_t match, size_t offset)
+{
+    size_t extra = match ? match - 4 : 0;
+    out.push_back((uint8_t)(std::min<size_t>(count, 15) << 4 | std::min<size_t>(extra, 15)));
+    if (count >= 15)
+        PutLength(out, count - 15);
+    out.insert(out.end(), literals, literals + count);
+
+    if (match)
+    {
+        out.push_back((uint8_t)offset);
+        out.push_back((uint8_t)(offset >> 8));
+        if (extra >= 15)
+            PutLength(out, extra - 15);
+    }
+}
+
+void TraceCompress(const uint8_t *in, size_t size, std::vector<uint8_t> &out)
+{
+    const int hashBits = 12;
+    uint32_t table[1 << hashBits] = { 0 };     // position + 1 of the last 4 bytes with this hash
+
+    out.clear();
+    out.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    // leave the tail as literals, keeps the match loop free of bounds checks
+    while (size >= 12 && pos + 12 <= size)
+    {
+        uint32_t seq = Read32(in + pos);
+        uint32_t hash = (seq * 2654435761u) >> (32 - hashBits);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)(pos + 1);
+
+        if (!candidate || pos - (candidate - 1) > 65535 || Read32(in + candidate - 1) != seq)
+        {
+            pos++;
+            continue;
+        }
+
+        size_t ref = candidate - 1;
+        size_t len = 4;
+        while (pos + len < size - 5 && in[ref + len] == in[pos + len])
+            len++;
+
+        PutSequence(out, in + anchor, pos - anchor, len, pos - ref);
+        pos += len;
+        anchor = pos;
+    }
+
+    PutSequence(out, in + anchor, size - anchor, 0, 0);
+}
+
+static bool GetLength(const uint8_t *in, size_t size, size_t &pos, size_t &len)
+{
+    uint8_t b;
+    do
+    {
+        if (pos >= size)
+            return false;
+        b = in[pos++];
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool TraceDecompress(const uint8_t *in, size_t size, uint8_t *out, size_t outSize)
+{
+    size_t pos = 0;
+    size_t written = 0;
+
+    while (pos < size)
+    {
+        uint8_t token = in[pos++];
+
+        size_t count = token >> 4;
+        if (count == 15 && !GetLength(in, size, pos, count))
+            return false;
+        if (pos + count > size || written + count > outSize)
+            return false;
+
+        memcpy(out + written, in + pos, count);
+        pos += count;
+        written += count;
+
+        if (pos == size)
+            break;
+
+        if (pos + 2 > size)
+            return false;
+        size_t offset = in[pos] | in[pos + 1] << 8;
+        pos += 2;
+
+        size_t len = token & 15;
+        if (len == 15 && !GetLength(in, size, pos, len))
+            return false;
+        len += 4;
+
+        if (offset == 0 || offset > written || written + len > outSize)
+            return false;
+
+        // byte at a time, matches may overlap their own output
+        const uint8_t *from = out + written - offset;
+        for (size_t i = 0; i < len; i++)
+            out[written + i] = from[i];
+        written += len;
+    }
+
+    return written == outSize;
+}
+
+TraceReader::~TraceReader()
+{
+    if (file)
+        fclose(file);
+}
+
+bool TraceReader::Open(const std::string &path)
+{
+    file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "failed to open " << path << std::endl;
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, 8) != 0)
+    {
+        std::cerr << path << ": not a simget trace" << std::endl;
+        return false;
+    }
+
+    // nothing read from the file is sized past its end, a damaged count can't allocate gigabytes
+    fseeko(file, 0, SEEK_END);
+    const uint64_t fileSize = (uint64_t)ftello(file);
+    fseeko(file, sizeof(header), SEEK_SET);
+
+    // frames start after the symbols
+    off_t frames = sizeof(header);
+    if (header.flags & TRACE_FLAG_SYMBOLS)
+    {
+        uint32_t size;
+        std::vector<uint8_t> block;
+        if (fread(&size, sizeof(size), 1, file) == 1)
+        {
+            if (size <= fileSize - frames - sizeof(size))
+                block.resize(size);
+            if (block.size() != size || fread(block.data(), 1, size, file) != size ||
+                !symbols.Deserialize(SYMBOL_FLASH, block.data(), size))
+                std::cerr << path << ": symbol table is damaged, printing without it" << std::endl;
+        }
+        frames += sizeof(size) + size;
+    }
+
+    TraceFooter footer;
+    if (fseeko(file, -(off_t)sizeof(footer), SEEK_END) == 0 && fread(&footer, sizeof(footer), 1, file) == 1 &&
+        memcmp(footer.magic, TRACE_INDEX_MAGIC, 8) == 0)
+    {
+        const uint64_t end = fileSize - sizeof(footer);
+        if (footer.indexOffset > end || footer.frames > (end - footer.indexOffset) / sizeof(TraceIndexEntry))
+        {
+            std::cerr << path << ": index damaged" << std::endl;
+            return false;
+        }
+        index.resize(footer.frames);
+        if (fseeko(file, (off_t)footer.indexOffset, SEEK_SET) != 0 ||
+            fread(index.data(), sizeof(TraceIndexEntry), index.size(), file) != index.size())
+        {
+            std::cerr << path << ": index truncated" << std::endl;
+            return false;
+        }
+        for (const TraceIndexEntry &entry : index)
+        {
+            if (entry.offset > fileSize || fileSize - entry.offset < sizeof(TraceFrameInfo) + (uint64_t)entry.info.packedBytes)
+            {
+                std::cerr << path << ": index damaged" << std::endl;
+                return false;
+            }
+        }
+    }
+    else
+    {
+        // walk the frame headers, stops at the first incomplete frame
+        rebuilt = true;
+        off_t offset = frames;
+        TraceIndexEntry entry;
+        fseeko(file, offset, SEEK_SET);
+        while (fread(&entry.info, sizeof(entry.info), 1, file) == 1)
+        {
+            entry.offset = (uint64_t)offset;
+            offset += sizeof(entry.info) + entry.info.packedBytes;
+            if (fseeko(file, offset, SEEK_SET) != 0)
+                break;
+            index.push_back(entry);
+        }
+
+        // fseek past the end succeeds, drop a frame cut short by a crash
+        fseeko(file, 0, SEEK_END);
+        while (!index.empty() && index.back().offset + sizeof(TraceFrameInfo) + index.back().info.packedBytes >
+                                     (uint64_t)ftello(file))
+            index.pop_back();
+    }
+
+    for (size_t i = 1; i < index.size(); i++)
+    {
+        if (index[i].info.firstCycle < index[i - 1].info.lastCycle)
+            ordered = false;
+    }
+
+    return true;
+}
+
+bool TraceReader::ReadFrame(size_t frame, std::vector<uint8_t> &packed)
+{
+    if (frame >= index.size())
+        return false;
+
+    const TraceIndexEntry &entry = index[frame];
+    packed.resize(entry.info.packedBytes);
+
+    std::lock_guard<std::mutex> guard(lock);
+    return fseeko(file, (off_t)(entry.offset + sizeof(TraceFrameInfo)), SEEK_SET) == 0 &&
+           fread(packed.data(), 1, packed.size(), file) == packed.size();
+}
+
+bool TraceReader::LoadFrame(size_t frame, std::vector<uint8_t> &raw)
+{
+    std::vector<uint8_t> packed;
+    if (!ReadFrame(frame, packed))
+        return false;
+
+    // the writer never makes a frame bigger, a damaged header can't ask for gigabytes
+    if (index[frame].info.rawBytes > TRACE_FRAME_MAX)
+        return false;
+
+    raw.resize(index[frame].info.rawBytes);
+    return TraceDecompress(packed.data(), packed.size(), raw.data(), raw.size());
+}
+
+size_t TraceReader::FindCycle(uint64_t cycle) const
+{
+    auto reaches = [cycle](const TraceIndexEntry &e) { return e.info.lastCycle > cycle; };
+
+    if (ordered)
+    {
+        return std::partition_point(index.begin(), index.end(),
+                                    [&](const TraceIndexEntry &e) { return !reaches(e); }) - index.begin();
+    }
+    return std::find_if(index.begin(), index.end(), reaches) - index.begin();
+}
@@ -0,0 +1,196 @@
+#ifndef SIMGETTRACEFILE_H
+#define SIMGETTRACEFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "simgetsymbols.h"
+
+// instruction trace file, shared by the recorder and simget-trace. little endian.
+//
+//   TraceFileHeader
+//   u32 size and the flash symbols, SymbolIndex::Serialize     } TRACE_FLAG_SYMBOLS
+//   per frame: TraceFrameInfo, then packedBytes of LZ compressed frame
+//   TraceIndexEntry per frame, TraceFooter
+//
+// a frame decompresses to a TraceFrameStart followed by one record per instruction:
+//
+//   varint  zigzag(pc words - previous pc words) << 1 | has registers
+//   varint  cycles the instruction took (interrupt entry and sleep included)
+//   varint  mask of changed registers, bit 0..31 r0..r31, bit 32 SREG   } has registers
+//   byte    new value per set bit                                       }
+//
+// every frame starts from absolute state so frames decode independently. without a
+// footer (the recorder didn't get to close) the frames are scanned to rebuild the index.
+
+#define TRACE_MAGIC "SGTRACE1"
+#define TRACE_INDEX_MAGIC "SGTINDX1"
+#define TRACE_REGS 33               // r0..r31, SREG
+
+// raw bytes per frame, a few thousand instructions. small enough that the decoder can jump
+// close to any cycle, big enough for the compressor to find repeats. the record that
+// reaches it ends the frame, so no frame is bigger than TRACE_FRAME_MAX
+#define TRACE_FRAME_BYTES (64 * 1024)
+#define TRACE_RECORD_MAX (3 * 10 + TRACE_REGS)     // three 64 bit varints, every register
+#define TRACE_FRAME_MAX (TRACE_FRAME_BYTES + TRACE_RECORD_MAX)
+
+enum {
+    TRACE_FLAG_REGS = 1,            // records carry register writes
+    TRACE_FLAG_SYMBOLS = 2,         // flash symbols follow the header
+};
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t frequency;
+    uint32_t flags;
+    char mcu[16];
+};
+
+struct TraceFrameInfo {
+    uint32_t rawBytes;
+    uint32_t packedBytes;
+    uint32_t records;
+    uint32_t reserved;
+    uint64_t firstCycle;            // cycle the first instruction started on
+    uint64_t lastCycle;             // cycle after the last instruction
+};
+
+struct TraceFrameStart {
+    uint64_t cycle;
+    uint32_t pc;                    // byte address
+    uint8_t regs[TRACE_REGS];       // after the first record, which never changes them
+    uint8_t reserved[3];
+};
+
+struct TraceIndexEntry {
+    TraceFrameInfo info;
+    uint64_t offset;                // file offset of the TraceFrameInfo
+};
+
+struct TraceFooter {
+    uint64_t indexOffset;
+    uint64_t frames;
+    char magic[8];
+};
+
+// one decoded instruction
+struct TraceRecord {
+    uint64_t cycle;                 // cycle the instruction started on
+    uint32_t pc;                    // byte address
+    uint32_t cycles;
+    uint64_t changed;               // register mask, 0 without TRACE_FLAG_REGS
+    const uint8_t *regs;            // register file after the instruction
+};
+
+// LZ77, lz4 style sequences with a 64k window. fast enough to keep up with the sim
+// thread on one core and good for 3-5x on top of the varint records.
+void TraceCompress(const uint8_t *in, size_t size, std::vector<uint8_t> &out);
+bool TraceDecompress(const uint8_t *in, size_t size, uint8_t *out, size_t outSize);
+
+static inline void TracePutVarint(std::vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static inline bool TraceGetVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// calls fn(const TraceRecord &) for every record of a decompressed frame, false if corrupt
+template <class Fn>
+bool DecodeTraceFrame(const uint8_t *raw, size_t size, Fn fn)
+{
+    if (size < sizeof(TraceFrameStart))
+        return false;
+
+    TraceFrameStart start;
+    memcpy(&start, raw, sizeof(start));
+
+    uint8_t regs[TRACE_REGS];
+    memcpy(regs, start.regs, sizeof(regs));
+
+    TraceRecord rec;
+    rec.cycle = start.cycle;
+    rec.pc = start.pc;
+    rec.regs = regs;
+
+    const uint8_t *p = raw + sizeof(start);
+    const uint8_t *end = raw + size;
+    while (p < end)
+    {
+        uint64_t head, cycles, mask = 0;
+        if (!TraceGetVarint(p, end, head) || !TraceGetVarint(p, end, cycles))
+            return false;
+
+        uint64_t zz = head >> 1;
+        int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+        rec.pc = (uint32_t)(rec.pc + delta * 2);
+
+        if (head & 1)
+        {
+            if (!TraceGetVarint(p, end, mask))
+                return false;
+            for (int r = 0; r < TRACE_REGS; r++)
+            {
+                if (mask & (1ull << r))
+                {
+                    if (p == end)
+                        return false;
+                    regs[r] = *p++;
+                }
+            }
+        }
+
+        rec.cycles = (uint32_t)cycles;
+        rec.changed = mask;
+        fn((const TraceRecord &)rec);
+        rec.cycle += cycles;
+    }
+    return true;
+}
+
+// random access to a trace file by frame
+class TraceReader {
+public:
+    ~TraceReader();
+
+    bool Open(const std::string &path);
+
+    // compressed bytes of a frame, safe to call from several threads
+    bool ReadFrame(size_t frame, std::vector<uint8_t> &packed);
+    // decompressed frame, ready for DecodeTraceFrame
+    bool LoadFrame(size_t frame, std::vector<uint8_t> &raw);
+
+    // first frame whose cycles reach 'cycle'
+    size_t FindCycle(uint64_t cycle) const;
+
+    TraceFileHeader header;
+    SymbolIndex symbols;            // flash only, empty if the firmware had none
+    std::vector<TraceIndexEntry> index;
+    bool rebuilt = false;           // no footer, index came from a scan
+    bool ordered = true;            // false if a reverse seek re-traced history
+
+private:
+    FILE *file = nullptr;
+    std::mutex lock;
+};
+
+#endif // SIMGETTRACEFILE_H
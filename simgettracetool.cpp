@@ -0,0 +1,223 @@
+#include <argparse/argparse.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "simgetpool.h"
+#include "simgettracefile.h"
+
+// simget-trace, turns a --trace file back into text. frames are expanded in
+// parallel a batch at a time and printed in file order.
+
+static const char *RegisterName(int r)
+{
+    static char names[TRACE_REGS][5];
+    if (!names[0][0])
+    {
+        for (int i = 0; i < 32; i++)
+            snprintf(names[i], sizeof(names[i]), "r%d", i);
+        snprintf(names[32], sizeof(names[32]), "SREG");
+    }
+    return names[r];
+}
+
+struct TraceFilter
+{
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+    uint32_t pcMin = 0;
+    uint32_t pcMax = UINT32_MAX;
+    bool registers = false;
+    bool symbols = false;
+};
+
+static bool ExpandFrame(TraceReader &reader, size_t frame, const TraceFilter &filter, std::string &text)
+{
+    std::vector<uint8_t> raw;
+    if (!reader.LoadFrame(frame, raw))
+        return false;
+
+    char line[128];
+    return DecodeTraceFrame(raw.data(), raw.size(), [&](const TraceRecord &rec) {
+        if (rec.cycle < filter.from || rec.cycle >= filter.to || rec.pc < filter.pcMin || rec.pc > filter.pcMax)
+            return;
+
+        snprintf(line, sizeof(line), "%12llu  %05x  %2u", (unsigned long long)rec.cycle, rec.pc, rec.cycles);
+        text += line;
+
+        if (filter.symbols)
+        {
+            char name[96];
+            reader.symbols.Format(SYMBOL_FLASH, rec.pc, name, sizeof(name));
+            snprintf(line, sizeof(line), "  %-24s", name);
+            text += line;
+        }
+
+        if (filter.registers && rec.changed)
+        {
+            for (int r = 0; r < TRACE_REGS; r++)
+            {
+                if (rec.changed & (1ull << r))
+                {
+                    snprintf(line, sizeof(line), "  %s=%02x", RegisterName(r), rec.regs[r]);
+                    text += line;
+                }
+            }
+        }
+        text += '\n';
+    });
+}
+
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("simget-trace");
+
+    program.add_argument("trace")
+        .help("Trace file written by simget --trace");
+
+    program.add_argument("--from")
+        .scan<'u', uint64_t>()
+        .default_value(static_cast<uint64_t>(0))
+        .help("First cycle to print");
+
+    program.add_argument("--to")
+        .scan<'u', uint64_t>()
+        .default_value(static_cast<uint64_t>(UINT64_MAX))
+        .help("Stop before this cycle");
+
+    program.add_argument("--pc")
+        .default_value(std::string(""))
+        .help("Only instructions in this flash byte range, lo:hi inclusive (0x100:0x1ff), or in a function");
+
+    program.add_argument("--regs")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Print the registers each instruction changed");
+
+    program.add_argument("--no-symbols")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Leave out the function column of traces recorded from an elf");
+
+    program.add_argument("--index")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Print the frame index instead of the records");
+
+    program.add_argument("--jobs", "-j")
+        .scan<'u', unsigned>()
+        .default_value(0u)
+        .help("Frames expanded in parallel (0 = one per core)");
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+
+    TraceReader reader;
+    if (!reader.Open(program.get<std::string>("trace")))
+        return 1;
+
+    TraceFilter filter;
+    filter.from = program.get<uint64_t>("--from");
+    filter.to = program.get<uint64_t>("--to");
+    filter.registers = program.get<bool>("--regs");
+    filter.symbols = !reader.symbols.Empty() && !program.get<bool>("--no-symbols");
+
+    std::string pc = program.get<std::string>("--pc");
+    const Symbol *function = pc.empty() ? nullptr : reader.symbols.Lookup(pc, SYMBOL_FLASH);
+    if (function)
+    {
+        filter.pcMin = function->addr;
+        filter.pcMax = function->addr + function->size - 1;
+    }
+    else if (!pc.empty())
+    {
+        char *end;
+        filter.pcMin = (uint32_t)strtoul(pc.c_str(), &end, 0);
+        bool good = end != pc.c_str() && *end == ':';
+        if (good)
+        {
+            const char *hi = end + 1;
+            filter.pcMax = (uint32_t)strtoul(hi, &end, 0);
+            good = end != hi && !*end;
+        }
+        if (!good)
+        {
+            std::cerr << "--pc wants lo:hi or a function name" << std::endl;
+            return 1;
+        }
+    }
+
+    if (filter.registers && !(reader.header.flags & TRACE_FLAG_REGS))
+        std::cerr << "trace was recorded without --trace-regs" << std::endl;
+
+    printf("# %s %u Hz, %zu frames%s\n", reader.header.mcu, reader.header.frequency, reader.index.size(),
+           reader.rebuilt ? " (no index, recovered by scanning)" : "");
+
+    if (program.get<bool>("--index"))
+    {
+        for (size_t i = 0; i < reader.index.size(); i++)
+        {
+            const TraceFrameInfo &info = reader.index[i].info;
+            printf("%6zu  %12llu .. %12llu  %6u records  %7u -> %6u bytes\n", i,
+                   (unsigned long long)info.firstCycle, (unsigned long long)info.lastCycle, info.records,
+                   info.rawBytes, info.packedBytes);
+        }
+        return 0;
+    }
+
+    // a reverse seek while recording puts history in twice, then every frame is a candidate
+    size_t first = reader.ordered ? reader.FindCycle(filter.from) : 0;
+
+    WorkStealingPool pool(program.get<unsigned>("--jobs"));
+    const size_t batch = pool.Threads() * 4;
+
+    std::vector<std::string> texts;
+    std::vector<std::function<void()>> jobs;
+    bool ok = true;
+
+    for (size_t frame = first; frame < reader.index.size(); frame += batch)
+    {
+        if (reader.ordered && reader.index[frame].info.firstCycle >= filter.to)
+            break;
+
+        size_t count = std::min(batch, reader.index.size() - frame);
+        texts.assign(count, std::string());
+        std::vector<char> good(count, 1);
+        jobs.clear();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const TraceFrameInfo &info = reader.index[frame + i].info;
+            if (info.lastCycle <= filter.from || info.firstCycle >= filter.to)
+                continue;
+
+            jobs.push_back([&, i, frame]() { good[i] = ExpandFrame(reader, frame + i, filter, texts[i]); });
+        }
+
+        pool.Run(jobs);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!good[i])
+            {
+                std::cerr << "frame " << frame + i << " is corrupt" << std::endl;
+                ok = false;
+            }
+            fwrite(texts[i].data(), 1, texts[i].size(), stdout);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,1315 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+#include "imgui.h"
+
+// comes from the imgui_club repo
+#include "imgui_memory_editor.h"
+
+#include "simgetui.h"
+
+extern "C"
+{
+#include "simavr/sim/avr_ioport.h"
+#include "simavr/sim/sim_avr.h"
+#include "simavr/sim/sim_core.h"
+#include "simavr/sim/sim_mcu_structs.h"
+}
+
+const char *Get_MNemonic_Name(int Type);
+
+void ShowAvrDetailsFull(AvrSimulator &avrSim)
+{
+    avr_t *avr = avrSim.avr;
+
+    if (!avr)
+        return;
+
+    // Start a new ImGui window
+    if (ImGui::Begin("AVR Details Full"))
+    { // Only proceed if the window is open
+        ImGui::Text("IO End: %u", avr->ioend);
+        ImGui::Text("RAM End: %u", avr->ramend);
+        ImGui::Text("Flash End: %u", avr->flashend);
+        ImGui::Text("E2 End: %u", avr->e2end);
+        ImGui::Text("Vector Size: %u", avr->vector_size);
+
+        ImGui::Text("Fuse:");
+        for (int i = 0; i < 6; ++i)
+            ImGui::Text("\t[%d]: 0x%X", i, avr->fuse[i]);
+
+        ImGui::Text("Lockbits: 0x%X", avr->lockbits);
+
+        ImGui::Text("Signature:");
+        ImGui::Text("\t0x%X%X%X", avr->signature[0], avr->signature[1], avr->signature[2]);
+
+        ImGui::Text("Serial:");
+        for (int i = 0; i < 9; ++i)
+            ImGui::Text("\t[%d]: 0x%X", i, avr->serial[i]);
+
+        ImGui::Text("RAMPZ: %u", avr->rampz);
+        ImGui::Text("EIND: %u", avr->eind);
+        ImGui::Text("Address Size: %u", avr->address_size);
+
+        ImGui::Text("Reset Flags:");
+        ImGui::Text("\tPORF: %u", avr->reset_flags.porf.bit);
+        ImGui::Text("\tEXTRF: %u", avr->reset_flags.extrf.bit);
+        ImGui::Text("\tBORF: %u", avr->reset_flags.borf.bit);
+        ImGui::Text("\tWDRF: %u", avr->reset_flags.wdrf.bit);
+
+        ImGui::Text("Code End: %u", avr->codeend);
+        ImGui::Text("Run Cycle Count: %lu", avr->run_cycle_count);
+        ImGui::Text("Run Cycle Limit: %lu", avr->run_cycle_limit);
+        ImGui::Text("Sleep Usec: %u", avr->sleep_usec);
+        ImGui::Text("Time Base: %lu", avr->time_base);
+
+        // Custom init/deinit functions and data are not displayed as they are function pointers and context data
+
+        // Skipping run and sleep function pointers for the same reason
+
+        // Skipping irq_pool, sreg, interrupt_state, pc, reset_pc, io, io_shared_io, flash, data, io_port, commands, cycle_timers, interrupts, trace, log, trace_data, vcd, gdb, gdb_port, io_console_buffer, data_names as these are complex types or pointers
+
+        ImGui::End();
+    }
+}
+
+static SimScheduler *editorScheduler;
+
+// memory editor writes become commands so they land between instructions
+static void WriteFlash(ImU8 *data, size_t off, ImU8 d)
+{
+    SimCommand cmd;
+    cmd.type = CMD_WRITE_FLASH;
+    cmd.addr = off;
+    cmd.value = d;
+    editorScheduler->Post(cmd);
+}
+
+static void WriteRam(ImU8 *data, size_t off, ImU8 d)
+{
+    SimCommand cmd;
+    cmd.type = CMD_POKE_DATA;
+    cmd.addr = off;
+    cmd.value = d;
+    editorScheduler->Post(cmd);
+}
+
+// 0 for a word that never ran up to 1 for the hottest one. log scaled, so a delay loop
+// doesn't leave everything else looking cold
+static float ProfileHeat(const ProfileCounts &profile, size_t word)
+{
+    if (word >= profile.cycles.size() || !profile.cycles[word] || !profile.maxCycles)
+        return 0.0f;
+    return logf(1.0f + profile.cycles[word]) / logf(1.0f + profile.maxCycles);
+}
+
+// blue through to red
+static ImVec4 HeatColor(float heat, float alpha)
+{
+    return ImVec4(0.2f + 0.8f * heat, 0.3f, 1.0f - 0.8f * heat, alpha);
+}
+
+static const ProfileCounts *editorProfile;
+static const SymbolIndex *editorSymbols;
+
+static const char *FlashLabel(const ImU8 *data, size_t off)
+{
+    static char label[128];
+    editorSymbols->Format(SYMBOL_FLASH, off, label, sizeof(label));
+    return label;
+}
+
+static const char *RamLabel(const ImU8 *data, size_t off)
+{
+    static char label[128];
+    editorSymbols->Format(SYMBOL_DATA, off, label, sizeof(label));
+    return label;
+}
+
+static bool ProfileHighlight(const ImU8 *data, size_t off)
+{
+    return editorProfile && off / 2 < editorProfile->cycles.size() && editorProfile->cycles[off / 2];
+}
+
+static ImU32 ProfileTint(const ImU8 *data, size_t off)
+{
+    return ImGui::GetColorU32(HeatColor(ProfileHeat(*editorProfile, off / 2), 0.45f));
+}
+
+void HexEditor(AvrSimulator &avrSim, SimScheduler &scheduler, bool run)
+{
+    static MemoryEditor mem_edit_1;
+
+    avr_t *avr = avrSim.avr;
+
+    if (!avr)
+        return;
+
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    static size_t start;
+
+    // only chase if not pc changed
+    {
+
+        if (start != snap.pc)
+        {
+
+            size_t end = snap.pc + 1;
+            start = snap.pc;
+
+            mem_edit_1.HighlightPC(start, end);
+        }
+    }
+
+    // executed words get a heat tint while there are profile counts
+    editorProfile = snap.profile.get();
+    mem_edit_1.HighlightFn = ProfileHighlight;
+    mem_edit_1.HighlightColorFn = ProfileTint;
+
+    editorSymbols = &avrSim.symbols;
+    mem_edit_1.LabelFn = FlashLabel;
+
+    editorScheduler = &scheduler;
+    mem_edit_1.WriteFn = WriteFlash;
+    mem_edit_1.DrawWindow("Memory Editor FLASH", avr->flash, avr->flashend);
+}
+
+// RAM editor change tracking, UI thread only. every byte remembers when it last changed
+// between two drawn frames, the tint fades out over fadeSeconds. against a baseline the
+// bytes that differ from it stay marked and the fade shows which of them are still moving
+static struct {
+    std::vector<uint8_t> previous;      // data space as drawn last frame
+    std::vector<uint8_t> baseline;
+    std::vector<float> changed;         // ImGui time of the last change per byte
+    std::vector<DiffRange> ranges;      // scratch for frame diffs
+    std::vector<DiffRange> fromBaseline;
+    std::vector<uint8_t> watched;       // WATCH_* of the published watchpoints per byte
+    uint64_t sequence = 0;
+    bool useBaseline = false;
+    float fadeSeconds = 2.0f;
+    float now = 0;
+} ramChanges;
+
+static bool RamChanged(const ImU8 *data, size_t off)
+{
+    if (off < ramChanges.watched.size() && ramChanges.watched[off])
+        return true;
+    if (ramChanges.useBaseline && InDiff(ramChanges.fromBaseline, (uint32_t)off))
+        return true;
+    return off < ramChanges.changed.size() && ramChanges.now - ramChanges.changed[off] < ramChanges.fadeSeconds;
+}
+
+static ImU32 RamChangeTint(const ImU8 *data, size_t off)
+{
+    float age = off < ramChanges.changed.size() ? ramChanges.now - ramChanges.changed[off] : ramChanges.fadeSeconds;
+    float fade = std::max(0.0f, 1.0f - age / ramChanges.fadeSeconds);
+
+    // watched and settled: red, differs from the baseline and settled: a steady dim blue
+    if (fade <= 0.0f && off < ramChanges.watched.size() && ramChanges.watched[off])
+        return IM_COL32(255, 60, 60, 110);
+    if (fade <= 0.0f)
+        return IM_COL32(80, 120, 255, 70);
+    return IM_COL32(255, 200, 0, (int)(40 + 160 * fade));
+}
+
+static void UpdateRamChanges(const SimSnapshot &snap)
+{
+    const size_t size = snap.data.size();
+    ramChanges.now = (float)ImGui::GetTime();
+
+    if (ramChanges.previous.size() != size)
+    {
+        ramChanges.previous = snap.data;
+        ramChanges.changed.assign(size, -1e9f);
+        ramChanges.baseline = snap.data;
+        ramChanges.fromBaseline.clear();
+        ramChanges.sequence = snap.sequence;
+        return;
+    }
+
+    if (ramChanges.sequence == snap.sequence)
+        return;
+    ramChanges.sequence = snap.sequence;
+
+    DiffBytes(ramChanges.previous.data(), snap.data.data(), size, ramChanges.ranges);
+    for (const DiffRange &r : ramChanges.ranges)
+    {
+        std::fill(ramChanges.changed.begin() + r.start, ramChanges.changed.begin() + r.end, ramChanges.now);
+        memcpy(ramChanges.previous.data() + r.start, snap.data.data() + r.start, r.end - r.start);
+    }
+
+    if (ramChanges.useBaseline)
+        DiffBytes(ramChanges.baseline.data(), snap.data.data(), size, ramChanges.fromBaseline);
+
+    ramChanges.watched.assign(snap.watchpoints.empty() ? 0 : size, 0);
+    for (const Watchpoint &w : snap.watchpoints)
+    {
+        for (uint32_t a = w.addr; a < (uint32_t)w.addr + w.size && a < size; a++)
+            ramChanges.watched[a] |= w.flags;
+    }
+}
+
+static const char *WatchKindName(uint8_t flags)
+{
+    if (flags & WATCH_VALUE)
+        return "value";
+    if ((flags & WATCH_READ) && (flags & WATCH_WRITE))
+        return "rw";
+    return flags & WATCH_WRITE ? "write" : "read";
+}
+
+// watchpoints are set on the byte selected in the editor, hits stop the sim thread
+static void ShowWatchpoints(AvrSimulator &avrSim, SimScheduler &scheduler, const SimSnapshot &snap, size_t selected)
+{
+    static int addr = 0x60, size = 1, kind = 1, value = 0, mask = 0xff;
+    static const uint8_t kinds[] = { WATCH_READ, WATCH_WRITE, WATCH_READ | WATCH_WRITE, WATCH_VALUE };
+
+    if (selected != (size_t)-1)
+        addr = (int)selected;
+
+    ImGui::SetNextItemWidth(80);
+    ImGui::Combo("##kind", &kind, "read\0write\0rw\0value\0");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(60);
+    ImGui::InputInt("@", &addr, 0, 0, ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(60);
+    ImGui::InputInt("bytes", &size, 0);
+    if (kinds[kind] == WATCH_VALUE)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(40);
+        ImGui::InputInt("=", &value, 0, 0, ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(40);
+        ImGui::InputInt("mask", &mask, 0, 0, ImGuiInputTextFlags_CharsHexadecimal);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("watch"))
+    {
+        SimCommand cmd;
+        cmd.type = CMD_WATCHPOINT;
+        cmd.addr = (uint32_t)addr;
+        cmd.target = (uint64_t)std::max(size, 1);
+        cmd.bit = kinds[kind];
+        cmd.value = (uint32_t)value & 0xff;
+        cmd.mask = (uint8_t)mask;
+        scheduler.Post(cmd);
+    }
+
+    for (const Watchpoint &w : snap.watchpoints)
+    {
+        ImGui::PushID(w.addr * 16 + w.flags);
+        if (ImGui::SmallButton("x"))
+        {
+            SimCommand cmd;
+            cmd.type = CMD_WATCHPOINT_REMOVE;
+            cmd.addr = w.addr;
+            scheduler.Post(cmd);
+        }
+        ImGui::PopID();
+        ImGui::SameLine();
+
+        char name[96];
+        avrSim.symbols.Format(SYMBOL_DATA, w.addr, name, sizeof(name));
+        if (w.flags & WATCH_VALUE)
+            ImGui::Text("%-5s %04x+%u == %02x/%02x %-20s %llu hits", WatchKindName(w.flags), w.addr, w.size, w.value,
+                        w.mask, name, (unsigned long long)w.hits);
+        else
+            ImGui::Text("%-5s %04x+%u %-28s %llu hits", WatchKindName(w.flags), w.addr, w.size, name,
+                        (unsigned long long)w.hits);
+    }
+
+    // newest first
+    for (auto it = snap.watchHits.rbegin(); it != snap.watchHits.rend(); ++it)
+    {
+        char data[96], code[96];
+        avrSim.symbols.Format(SYMBOL_DATA, it->addr, data, sizeof(data));
+        avrSim.symbols.Format(SYMBOL_FLASH, it->pc, code, sizeof(code));
+        ImGui::TextDisabled("%llu: %s %04x %s %02x -> %02x pc %04x %s", (unsigned long long)it->cycle,
+                            WatchKindName(it->flags), it->addr, data, it->before, it->after, it->pc, code);
+    }
+}
+
+void HexEditorRAM(AvrSimulator &avrSim, SimScheduler &scheduler)
+{
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (snap.data.empty())
+        return;
+
+    UpdateRamChanges(snap);
+
+    // edits are posted to the sim thread, the snapshot buffer being drawn stays untouched
+    static MemoryEditor mem_edit_1;
+    editorScheduler = &scheduler;
+    editorSymbols = &avrSim.symbols;
+    mem_edit_1.WriteFn = WriteRam;
+    mem_edit_1.LabelFn = RamLabel;
+    mem_edit_1.HighlightFn = RamChanged;
+    mem_edit_1.HighlightColorFn = RamChangeTint;
+
+    ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Memory Editor RAM"))
+    {
+        if (ImGui::Checkbox("against baseline", &ramChanges.useBaseline) && ramChanges.useBaseline)
+            DiffBytes(ramChanges.baseline.data(), snap.data.data(), snap.data.size(), ramChanges.fromBaseline);
+        ImGui::SameLine();
+        if (ImGui::Button("set baseline"))
+        {
+            ramChanges.baseline = snap.data;
+            ramChanges.fromBaseline.clear();
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderFloat("fade s", &ramChanges.fadeSeconds, 0.1f, 10.0f, "%.1f");
+        if (ramChanges.useBaseline)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%zu ranges differ", ramChanges.fromBaseline.size());
+        }
+
+        if (ImGui::CollapsingHeader("watchpoints"))
+            ShowWatchpoints(avrSim, scheduler, snap, mem_edit_1.DataEditingAddr);
+
+        mem_edit_1.DrawContents((void *)snap.data.data(), snap.data.size() - 1);
+    }
+    ImGui::End();
+}
+
+// two checkpoints of the ring compared by the sim thread, one row per differing range
+void ShowCheckpointDiff(AvrSimulator &avrSim, SimScheduler &scheduler)
+{
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (!snap.checkpoints)
+        return;
+
+    if (ImGui::Begin("Checkpoint Diff"))
+    {
+        static int a = 0, b = 1;
+        const int last = (int)snap.checkpoints - 1;
+
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderInt("A", &a, 0, last);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderInt("B", &b, 0, last);
+        ImGui::SameLine();
+        if (ImGui::Button("diff"))
+        {
+            SimCommand cmd;
+            cmd.type = CMD_DIFF_CHECKPOINTS;
+            cmd.base = snap.checkpointCycles[std::min(a, last)];
+            cmd.target = snap.checkpointCycles[std::min(b, last)];
+            scheduler.Post(cmd);
+        }
+
+        const DataDiff *diff = snap.checkpointDiff.get();
+        if (diff)
+        {
+            ImGui::Text("cycle %llu vs %llu, %zu ranges", (unsigned long long)diff->cycleA,
+                        (unsigned long long)diff->cycleB, diff->ranges.size());
+
+            if (ImGui::BeginTable("diff", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingFixedFit))
+            {
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableSetupColumn("addr");
+                ImGui::TableSetupColumn("symbol");
+                ImGui::TableSetupColumn("A");
+                ImGui::TableSetupColumn("B");
+                ImGui::TableHeadersRow();
+
+                ImGuiListClipper clipper;
+                clipper.Begin(diff->ranges.size());
+                while (clipper.Step())
+                {
+                    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                    {
+                        const DiffRange &r = diff->ranges[i];
+
+                        // the first few bytes of each side
+                        char bytesA[40] = "", bytesB[40] = "";
+                        const uint32_t shown = std::min<uint32_t>(r.end - r.start, 8);
+                        for (uint32_t n = 0; n < shown; n++)
+                        {
+                            snprintf(bytesA + n * 3, 4, "%02x ", diff->a[r.start + n]);
+                            snprintf(bytesB + n * 3, 4, "%02x ", diff->b[r.start + n]);
+                        }
+                        if (shown < r.end - r.start)
+                        {
+                            strcat(bytesA, "...");
+                            strcat(bytesB, "...");
+                        }
+
+                        char name[96];
+                        avrSim.symbols.Format(SYMBOL_DATA, r.start, name, sizeof(name));
+
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%04x+%u", r.start, r.end - r.start);
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(name);
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(bytesA);
+                        ImGui::TableNextColumn();
+                        ImGui::TextUnformatted(bytesB);
+                    }
+                }
+                clipper.End();
+                ImGui::EndTable();
+            }
+        }
+    }
+    ImGui::End();
+}
+
+void displayIO(AvrSimulator &avrSim, SimScheduler &scheduler, const std::string &io_type, uint8_t addr, char *cname)
+{
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (addr >= snap.data.size())
+        return;
+
+    // display register name, address, and current value
+    ImGui::Text("%s%s (0x%02X) 0x%02X", io_type.c_str(), cname, addr, snap.data[addr]);
+    // ImGui::SameLine();
+
+    // calculate spacing based on window width
+    float windowWidth = ImGui::GetWindowWidth();
+    float spacing = windowWidth / 9; // 8 bits + label
+
+    // display the bit numbers
+    ImGui::SetCursorPosX(spacing); // Initial spacing for alignment
+    for (int i = 7; i >= 0; --i)
+    {
+        ImGui::Text("%d", i);
+        if (i > 0)
+        {
+            ImGui::SameLine();
+            ImGui::SetCursorPosX((spacing * (8 - i + 1)));
+        }
+    }
+
+    // put text in box
+    ImGui::SameLine();
+
+    std::string name;
+
+    // display the checkboxes for each bit
+    for (int i = 7; i >= 0; --i)
+    {
+        ImGui::SetCursorPosX((spacing * (8 - i))); // adjust for checkbox size
+        bool bitSet = snap.data[addr] & (1 << i);
+        name = std::string("##") + io_type + cname + std::to_string(i);
+
+        if (ImGui::Checkbox(name.c_str(), &bitSet))
+        {
+            SimCommand cmd;
+
+            if (io_type == "PIN")
+            {
+                // drive the pin high/low
+                cmd.type = CMD_SET_PIN;
+                cmd.port = cname[0];
+                cmd.bit = i;
+                cmd.value = bitSet;
+            }
+            else
+            {
+                // toggle the bit if the checkbox is clicked
+                cmd.type = CMD_POKE_DATA;
+                cmd.addr = addr;
+                cmd.mask = 1 << i;
+                cmd.value = bitSet ? 0xff : 0;
+            }
+
+            scheduler.Post(cmd);
+        }
+        if (i > 0)
+        {
+            ImGui::SameLine();
+        }
+    }
+}
+
+void ModifyAvrIoRegister(AvrSimulator &avrSim, SimScheduler &scheduler, avr_ioport_t *port)
+{
+    if (!port)
+        return;
+
+    char cname[2] = {
+        0,
+        0,
+    };
+    cname[0] = port->name;
+
+    displayIO(avrSim, scheduler, "PORT", port->r_port, cname);
+    displayIO(avrSim, scheduler, "DDR", port->r_ddr, cname);
+    displayIO(avrSim, scheduler, "PIN", port->r_pin, cname);
+}
+
+void ModifyAvrIoRegisters(AvrSimulator &avrSim, SimScheduler &scheduler)
+{
+    avr_t *avr = avrSim.avr;
+
+    if (!avr)
+        return;
+
+    // recast to mcu type
+    mcu_attiny4313_t *mcu = (mcu_attiny4313_t *)avr;
+
+    ImGui::Begin("AVR IO Register Control");
+
+    ModifyAvrIoRegister(avrSim, scheduler, &mcu->porta);
+    ModifyAvrIoRegister(avrSim, scheduler, &mcu->portb);
+    ModifyAvrIoRegister(avrSim, scheduler, &mcu->portd);
+
+    ImGui::End();
+}
+
+// --add-trace signals with their live value, only when there are any
+void ShowWatchSignals(AvrSimulator &avrSim)
+{
+    // fixed after startup, only 'last' and 'changes' move and those come from the snapshot
+    const std::vector<WatchSignal> &signals = avrSim.watch.Signals();
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (signals.empty())
+        return;
+
+    ImGui::Begin("Signals");
+
+    if (ImGui::BeginTable("signals", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("name");
+        ImGui::TableSetupColumn("addr");
+        ImGui::TableSetupColumn("mask");
+        ImGui::TableSetupColumn("value");
+        ImGui::TableSetupColumn("changes");
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < signals.size(); i++)
+        {
+            const WatchSignal &s = signals[i];
+            uint8_t value = s.addr < snap.data.size() ? (snap.data[s.addr] & s.mask) >> s.shift : 0;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(s.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%04x", s.addr);
+            ImGui::TableNextColumn();
+            ImGui::Text("%02x", s.mask);
+            ImGui::TableNextColumn();
+            ImGui::Text(s.width == 1 ? "%d" : "%02x", value);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", i < snap.watchChanges.size() ? (unsigned long long)snap.watchChanges[i] : 0ull);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+// callees sorted by inclusive cycles, the costly path reads top down
+static void DrawCallNode(const CallGraphCounts &graph, const SymbolIndex &symbols, int index)
+{
+    const CallNode &node = graph.nodes[index];
+
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+
+    ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanFullWidth;
+    if (node.child < 0)
+        flags |= ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+    if (index == 0)
+        flags |= ImGuiTreeNodeFlags_DefaultOpen;
+
+    char name[96];
+    if (index == 0)
+        snprintf(name, sizeof(name), "reset");
+    else if (!symbols.Format(SYMBOL_FLASH, node.addr, name, sizeof(name)))
+        snprintf(name, sizeof(name), "0x%04x", node.addr);
+
+    bool open = ImGui::TreeNodeEx((void *)(intptr_t)index, flags, node.isr ? "isr %s" : "%s", name);
+
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", (unsigned long long)node.calls);
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", (unsigned long long)node.inclusive);
+    ImGui::TableNextColumn();
+    ImGui::Text("%5.1f%%", graph.totalCycles ? 100.0 * node.inclusive / graph.totalCycles : 0.0);
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", (unsigned long long)node.exclusive);
+
+    if (!open || node.child < 0)
+        return;
+
+    std::vector<int> callees;
+    for (int c = node.child; c >= 0; c = graph.nodes[c].sibling)
+        callees.push_back(c);
+    std::sort(callees.begin(), callees.end(),
+              [&](int a, int b) { return graph.nodes[a].inclusive > graph.nodes[b].inclusive; });
+
+    for (int c : callees)
+        DrawCallNode(graph, symbols, c);
+    ImGui::TreePop();
+}
+
+void ShowCallGraph(AvrSimulator &avrSim, SimScheduler &scheduler)
+{
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (ImGui::Begin("Call Graph"))
+    {
+        bool recording = snap.callGraphing;
+        if (ImGui::Checkbox("record", &recording))
+        {
+            SimCommand cmd;
+            cmd.type = CMD_CALLGRAPH;
+            cmd.value = recording;
+            scheduler.Post(cmd);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("clear"))
+        {
+            SimCommand cmd;
+            cmd.type = CMD_CALLGRAPH_CLEAR;
+            scheduler.Post(cmd);
+        }
+
+        const CallGraphCounts *graph = snap.callGraph.get();
+        if (graph)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%zu contexts, %llu cycles", graph->nodes.size(), (unsigned long long)graph->totalCycles);
+        }
+
+        if (graph && ImGui::BeginTable("calls", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("function", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("calls");
+            ImGui::TableSetupColumn("inclusive");
+            ImGui::TableSetupColumn("incl %");
+            ImGui::TableSetupColumn("exclusive");
+            ImGui::TableHeadersRow();
+
+            // the reset root, then each interrupt root on its sibling chain
+            for (int root = 0; root >= 0; root = graph->nodes[root].sibling)
+                DrawCallNode(*graph, avrSim.symbols, root);
+
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+
+void ShowAvrState(const int state)
+{
+
+    ImGui::Text("State: %s", GetAvrStateName(state));
+}
+
+void DumpAvrRegisters(AvrSimulator &avrSim)
+{
+
+    avr_t *avr = avrSim.avr;
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (!avr || snap.data.size() < 32)
+        return;
+
+    ImGui::Begin("AVR Register Dump");
+
+    for (int i = 0; i < 32; i++)
+    {
+        ImGui::Text("%s=%02x", avr_regname(avr, i), snap.data[i]);
+        if ((i % 8) != 7)
+            ImGui::SameLine();
+    }
+
+    uint16_t y = snap.data[R_YL] | (snap.data[R_YH] << 8);
+    for (int i = 0; i < 20; i++)
+    {
+        if( (size_t)(y + i) < snap.data.size() )   {
+            ImGui::Text("Y+%02d=%02x", i, snap.data[y + i]);
+        }
+        if (i % 10 != 9)
+            ImGui::SameLine();
+    }
+
+    ImGui::End();
+}
+
+static const Breakpoint *FindBreakpoint(const std::vector<Breakpoint> &list, uint32_t addr)
+{
+    auto it = std::lower_bound(list.begin(), list.end(), addr,
+                               [](const Breakpoint &bp, uint32_t a) { return bp.addr < a; });
+    return it != list.end() && it->addr == addr ? &*it : nullptr;
+}
+
+// parsed and compiled here, the sim thread only swaps it in
+static bool PostBreakpoint(AvrSimulator &avrSim, SimScheduler &scheduler, const std::string &spec, bool tracepoint,
+                           std::string &error)
+{
+    Breakpoint bp;
+    if (!avrSim.breakpoints.Parse(spec, tracepoint, avrSim.symbols, bp, error))
+        return false;
+
+    avrSim.breakpoints.Post(std::move(bp));
+    SimCommand cmd;
+    cmd.type = CMD_BREAKPOINT_POSTED;
+    scheduler.Post(cmd);
+    error.clear();
+    return true;
+}
+
+static void BreakpointTooltip(const Breakpoint &bp)
+{
+    ImGui::BeginTooltip();
+    ImGui::Text("%s at 0x%04x", bp.tracepoint ? "tracepoint" : "breakpoint", bp.addr);
+    if (!bp.condition.Empty())
+        ImGui::Text("if %s", bp.condition.Source().c_str());
+    if (!bp.log.Empty())
+        ImGui::Text("log %s", bp.log.Source().c_str());
+    ImGui::Text("reached %llu, hit %llu", (unsigned long long)bp.count, (unsigned long long)bp.hits);
+    ImGui::EndTooltip();
+}
+
+bool ShowAvrDisasm(AvrSimulator &avr, SimScheduler &scheduler)
+{
+    static bool followPC = true;
+    static int lastPCRow = -1;
+    static int scrollToRow = -1;
+
+    // memory editor writes and restores that took flash back, once per snapshot whether
+    // the window is open or not
+    static uint64_t flashSequence = 0;
+    const SimSnapshot &snap = avr.snapshot.Front();
+    if (snap.sequence != flashSequence)
+    {
+        flashSequence = snap.sequence;
+        if (snap.dirtyFlash.end > snap.dirtyFlash.start)
+            avr.disasm.Refresh(avr.avr->flash, snap.dirtyFlash.start, snap.dirtyFlash.end - snap.dirtyFlash.start);
+    }
+
+    if (ImGui::Begin("AVR Disasm Window"))
+    {
+        DisasmCache &cache = avr.disasm;
+
+        ImGui::Checkbox("follow pc", &followPC);
+        ImGui::SameLine();
+        ImGui::Text("%zu references", cache.XRefs().Size());
+
+        const ProfileCounts *profile = snap.profile.get();
+
+        // sample period 0 counts every instruction
+        static int sampleEvery = 0;
+        bool profiling = snap.profiling;
+        if (ImGui::Checkbox("profile", &profiling))
+        {
+            SimCommand cmd;
+            cmd.type = CMD_PROFILE;
+            cmd.addr = (uint32_t)std::max(sampleEvery, 0);
+            cmd.value = profiling;
+            scheduler.Post(cmd);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100);
+        ImGui::InputInt("sample every", &sampleEvery, 100, 1000);
+        ImGui::SameLine();
+        if (ImGui::Button("clear"))
+        {
+            SimCommand cmd;
+            cmd.type = CMD_PROFILE_CLEAR;
+            scheduler.Post(cmd);
+        }
+        if (profile)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%llu cycles%s", (unsigned long long)profile->totalCycles, profile->sampled ? " sampled" : "");
+        }
+
+        ImGui::BeginChild("##disasm");
+
+        const std::vector<DisasmLine> &lines = cache.Lines();
+        const std::vector<DisasmRow> &rows = cache.Rows();
+        const float lineHeight = ImGui::GetTextLineHeightWithSpacing();
+        const int pcRow = cache.RowForAddress(snap.pc);
+
+        if (scrollToRow >= 0)
+        {
+            ImGui::SetScrollY(scrollToRow * lineHeight - ImGui::GetWindowHeight() / 2);
+            scrollToRow = -1;
+        }
+        else if (followPC && pcRow >= 0 && pcRow != lastPCRow)
+        {
+            ImGui::SetScrollY(pcRow * lineHeight - ImGui::GetWindowHeight() / 2);
+        }
+        lastPCRow = pcRow;
+
+        int32_t jumpTo = -1;
+
+        ImGuiListClipper clipper;
+        clipper.Begin(rows.size(), lineHeight);
+        while (clipper.Step())
+        {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+            {
+                const DisasmLine &line = lines[rows[row].line];
+
+                ImGui::PushID(row);
+
+                if (rows[row].note >= 0)
+                {
+                    // referrer lines jump to the referring instruction
+                    const DisasmNote &note = line.notes[rows[row].note];
+                    if (note.jump >= 0)
+                    {
+                        if (ImGui::Selectable(note.text.c_str()))
+                            jumpTo = note.jump;
+                    }
+                    else
+                    {
+                        ImGui::TextUnformatted(note.text.c_str());
+                    }
+                    ImGui::PopID();
+                    continue;
+                }
+
+                // heat column, share of all profiled cycles spent on this instruction
+                if (profile)
+                {
+                    const size_t word = line.address / 2;
+                    const uint64_t cycles = word < profile->cycles.size() ? profile->cycles[word] : 0;
+                    if (cycles && profile->totalCycles)
+                    {
+                        ImGui::TextColored(HeatColor(ProfileHeat(*profile, word), 1.0f), "%5.1f%%",
+                                           100.0 * cycles / profile->totalCycles);
+                        if (ImGui::IsItemHovered())
+                            ImGui::SetTooltip("%llu %s, %llu cycles", (unsigned long long)profile->hits[word],
+                                              profile->sampled ? "samples" : "hits", (unsigned long long)cycles);
+                    }
+                    else
+                    {
+                        ImGui::TextDisabled("     -");
+                    }
+                    ImGui::SameLine();
+                }
+
+                if (row == pcRow)
+                {
+                    ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 1.0f, 0.0f, 1.0f));
+                }
+
+                const Breakpoint *bp = FindBreakpoint(snap.breakpoints, line.address);
+                const bool breakpoint = bp != nullptr;
+
+                // where a call or jump goes, by name
+                char target[96] = "";
+                XRefRange refs = cache.XRefs().From(line.address);
+                if (!refs.empty())
+                {
+                    char name[88];
+                    if (avr.symbols.Format(SYMBOL_FLASH, refs.begin()->to, name, sizeof(name)))
+                        snprintf(target, sizeof(target), "  <%s>", name);
+                }
+
+                // gutter, a click sets or clears a plain breakpoint
+                const char *mark = !bp ? " ##bp" : bp->tracepoint ? "o##bp" : !bp->condition.Empty() ? "?##bp" : "*##bp";
+                if (ImGui::Selectable(mark, false, 0, ImVec2(ImGui::CalcTextSize("*").x, 0)))
+                {
+                    SimCommand cmd;
+                    cmd.type = CMD_BREAKPOINT;
+                    cmd.addr = line.address;
+                    cmd.value = !breakpoint;
+                    scheduler.Post(cmd);
+                }
+                if (bp && ImGui::IsItemHovered())
+                    BreakpointTooltip(*bp);
+                ImGui::SameLine();
+
+                ImGui::Text("0x%04x: %s%-3s%s %s%s", line.address,
+                            line.cycles ? "[" : "", line.cycles ? line.cycles : "", line.cycles ? "]" : "",
+                            line.text.c_str(), target);
+
+                if (row == pcRow)
+                {
+                    ImGui::PopStyleColor();
+                }
+
+                // right click lists where this instruction goes and who comes here
+                if (ImGui::BeginPopupContextItem("xrefs"))
+                {
+                    if (ImGui::Selectable(breakpoint ? "clear breakpoint" : "set breakpoint"))
+                    {
+                        SimCommand cmd;
+                        cmd.type = CMD_BREAKPOINT;
+                        cmd.addr = line.address;
+                        cmd.value = !breakpoint;
+                        scheduler.Post(cmd);
+                    }
+                    if (ImGui::Selectable("run to here"))
+                    {
+                        SimCommand cmd;
+                        cmd.type = CMD_RUN_TO;
+                        cmd.addr = line.address;
+                        scheduler.Post(cmd);
+                    }
+
+                    // conditional breakpoint or tracepoint on this instruction
+                    static char condition[128], value[64];
+                    static bool tracepoint = false;
+                    static std::string error;
+                    ImGui::SetNextItemWidth(200);
+                    ImGui::InputText("if", condition, sizeof(condition));
+                    ImGui::SetNextItemWidth(200);
+                    ImGui::InputText("log", value, sizeof(value));
+                    ImGui::Checkbox("tracepoint", &tracepoint);
+                    ImGui::SameLine();
+                    if (ImGui::Button("set"))
+                    {
+                        char spec[256];
+                        snprintf(spec, sizeof(spec), "0x%x if %s log %s", line.address, condition, value);
+                        if (PostBreakpoint(avr, scheduler, spec, tracepoint, error))
+                            ImGui::CloseCurrentPopup();
+                    }
+                    if (!error.empty())
+                        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", error.c_str());
+                    ImGui::Separator();
+
+                    for (const XRef &ref : cache.XRefs().From(line.address))
+                    {
+                        char label[64];
+                        snprintf(label, sizeof(label), "go to 0x%04x (%s)", ref.to, Get_MNemonic_Name(ref.type));
+                        if (ImGui::Selectable(label))
+                            jumpTo = ref.to;
+                    }
+                    for (const XRef &ref : cache.XRefs().To(line.address))
+                    {
+                        char label[64];
+                        snprintf(label, sizeof(label), "referrer 0x%04x (%s)", ref.from, Get_MNemonic_Name(ref.type));
+                        if (ImGui::Selectable(label))
+                            jumpTo = ref.from;
+                    }
+                    ImGui::EndPopup();
+                }
+
+                ImGui::PopID();
+            }
+        }
+        clipper.End();
+
+        if (jumpTo >= 0)
+        {
+            scrollToRow = cache.RowForAddress(jumpTo);
+            followPC = false;
+        }
+
+        ImGui::EndChild();
+        ImGui::End();
+    }
+    return true;
+}
+
+bool ShowAvrDetails(AvrSimulator &avr, SimScheduler &scheduler)
+{
+    const SimSnapshot &snap = avr.snapshot.Front();
+
+    // Start a new ImGui window
+    if (ImGui::Begin("AVR Details Window"))
+    { // Only proceed if the window is open
+
+        ImGui::Text("MCU: %s", avr.avr->mmcu);
+        ImGui::Text("Frequency: %d Hz", avr.avr->frequency);
+        ImGui::Text("Cycle Counter: %lu", snap.cycle);
+        ImGui::Text("Instructions: %lu", snap.instructions);
+
+        ImGui::Text("VCC: %d V", avr.avr->vcc);
+        ImGui::Text("AVCC: %d V", avr.avr->avcc);
+        ImGui::Text("AREF: %d V", avr.avr->aref);
+
+        ImGui::Text("pc:       0x%x", snap.pc);
+        ImGui::Text("reset pc: 0x%x", avr.avr->reset_pc);
+        ImGui::Text("sp:       0x%x", snap.sp);
+
+        {
+            const char *_sreg_bit_name = "cznvshti";
+            char buffer[32] = {0};
+            for (int _sbi = 0; _sbi < 8; _sbi++)
+            {
+                buffer[_sbi] = snap.sreg[_sbi] ? toupper(_sreg_bit_name[_sbi]) : '.';
+            }
+            ImGui::Text("sreg: %s", buffer);
+        }
+
+        SimCommand cmd;
+
+        bool run = snap.running;
+        if (ImGui::Checkbox("run", &run))
+        {
+            cmd.type = CMD_SET_RUN;
+            cmd.value = run;
+            scheduler.Post(cmd);
+        }
+
+        bool animate = snap.animating;
+        if (ImGui::Checkbox("animate", &animate))
+        {
+            cmd.type = CMD_SET_ANIMATE;
+            cmd.value = animate;
+            scheduler.Post(cmd);
+        }
+
+        // animate pace, logarithmic from one a second to millions. kept here while dragging,
+        // the snapshot lags a frame behind
+        static int unit = AvrSimulator::ANIMATE_INSTRUCTIONS;
+        static float rate = 1000.0f;
+        ImGui::SetNextItemWidth(120);
+        bool paceChanged = ImGui::Combo("##unit", &unit, "instr/s\0sim us/s\0");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(200);
+        paceChanged |= ImGui::SliderFloat("rate", &rate, 1.0f, 10000000.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+        if (paceChanged)
+        {
+            cmd.type = CMD_ANIMATE_RATE;
+            cmd.value = unit;
+            cmd.target = (uint64_t)(std::max(rate, 1.0f) * 1000.0);
+            scheduler.Post(cmd);
+        }
+        // in the unit the sim measured it in, the combo may be a frame ahead
+        if (snap.animating)
+            ImGui::Text("achieved: %.0f %s", snap.animateAchieved, snap.animateUnit == AvrSimulator::ANIMATE_SIM_USEC ? "sim us/s" : "instr/s");
+
+        int mode = scheduler.mode;
+        if (ImGui::Combo("pacing", &mode, "max speed\0real time\0multiplier\0"))
+        {
+            scheduler.mode = mode;
+            scheduler.Wake();
+        }
+        if (mode == PACE_MULTIPLIER)
+        {
+            float multiplier = scheduler.multiplier;
+            if (ImGui::DragFloat("x", &multiplier, 0.01f, 0.001f, 1000.0f, "%.3f", ImGuiSliderFlags_Logarithmic))
+            {
+                scheduler.multiplier = multiplier;
+                scheduler.Wake();
+            }
+        }
+        ImGui::Text("speed: %.3fx  drift: %.0f us (max %.0f us)  slips: %u%s",
+                    scheduler.speed.load(), scheduler.driftUsec.load(), scheduler.maxDriftUsec.load(),
+                    scheduler.slips.load(), scheduler.parked ? "  parked" : "");
+
+        if (ImGui::Button("step"))
+        {
+            cmd.type = CMD_STEP;
+            scheduler.Post(cmd);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("step over"))
+        {
+            cmd.type = CMD_STEP_OVER;
+            scheduler.Post(cmd);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("step out"))
+        {
+            cmd.type = CMD_STEP_OUT;
+            scheduler.Post(cmd);
+        }
+
+        static uint64_t runCycles = 1000;
+        if (ImGui::Button("run cycles"))
+        {
+            cmd.type = CMD_RUN_CYCLES;
+            cmd.target = runCycles;
+            scheduler.Post(cmd);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputScalar("##cycles", ImGuiDataType_U64, &runCycles);
+
+        // only published while a target is still far off
+        if (snap.stepping)
+        {
+            ImGui::Text("running to target...");
+            ImGui::SameLine();
+            if (ImGui::Button("stop"))
+            {
+                cmd.type = CMD_SET_RUN;
+                cmd.value = 0;
+                scheduler.Post(cmd);
+            }
+        }
+
+        if (ImGui::Button("reset"))
+        {
+            cmd.type = CMD_RESET;
+            scheduler.Post(cmd);
+        }
+
+        if (ImGui::Button("restart"))
+        {
+            cmd.type = CMD_RESTART;
+            scheduler.Post(cmd);
+        }
+
+        if (snap.checkpoints)
+        {
+            if (ImGui::Button("reverse step"))
+            {
+                cmd.type = CMD_REVERSE_STEP;
+                scheduler.Post(cmd);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("reverse continue"))
+            {
+                cmd.type = CMD_REVERSE_CONTINUE;
+                scheduler.Post(cmd);
+            }
+
+            // follows the machine unless being dragged, every change seeks
+            static bool scrubbing = false;
+            static uint64_t scrub = 0;
+            uint64_t first = snap.checkpointFirst;
+            uint64_t end = std::max(snap.timelineEnd, snap.cycle);
+
+            if (!scrubbing)
+                scrub = snap.cycle;
+            if (ImGui::SliderScalar("timeline", ImGuiDataType_U64, &scrub, &first, &end, "%llu"))
+            {
+                cmd.type = CMD_SEEK;
+                cmd.target = scrub;
+                scheduler.Post(cmd);
+            }
+            scrubbing = ImGui::IsItemActive();
+
+            ImGui::Text("checkpoints: %zu, %zu KB, cycles %llu..%llu", snap.checkpoints, snap.checkpointBytes / 1024,
+                        (unsigned long long)snap.checkpointFirst, (unsigned long long)snap.checkpointLast);
+        }
+
+        for (const SimCommand &c : snap.recentCommands)
+        {
+            if (c.type == CMD_SET_PIN)
+                ImGui::TextDisabled("%10llu %s %c%d=%u", (unsigned long long)c.cycle, GetSimCommandName(c.type), c.port, c.bit, c.value);
+            else if (c.type == CMD_SPINNER_RPM)
+                ImGui::TextDisabled("%10llu %s %.1f", (unsigned long long)c.cycle, GetSimCommandName(c.type), c.target / 1000.0);
+            else
+                ImGui::TextDisabled("%10llu %s 0x%04x=0x%02x", (unsigned long long)c.cycle, GetSimCommandName(c.type), c.addr, c.value);
+        }
+
+        ShowAvrState(snap.state);
+
+        if (snap.state == cpu_Done || snap.state == cpu_Crashed)
+        {
+            ImGui::Text("DONE/CRASHED");
+        };
+
+        ImGui::End(); // End of AVR Details Window
+    }
+
+    return snap.running;
+}
+
+// every breakpoint and tracepoint with its counters, plus the latest tracepoint log
+void ShowBreakpoints(AvrSimulator &avrSim, SimScheduler &scheduler)
+{
+    const SimSnapshot &snap = avrSim.snapshot.Front();
+
+    if (ImGui::Begin("Breakpoints"))
+    {
+        static char spec[256];
+        static bool tracepoint = false;
+        static std::string error;
+        ImGui::SetNextItemWidth(300);
+        ImGui::InputTextWithHint("##spec", "location [if condition] [log expression]", spec, sizeof(spec));
+        ImGui::SameLine();
+        ImGui::Checkbox("tracepoint", &tracepoint);
+        ImGui::SameLine();
+        if (ImGui::Button("add"))
+            PostBreakpoint(avrSim, scheduler, spec, tracepoint, error);
+        if (!error.empty())
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", error.c_str());
+
+        if (ImGui::BeginTable("breakpoints", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+        {
+            ImGui::TableSetupColumn("");
+            ImGui::TableSetupColumn("addr");
+            ImGui::TableSetupColumn("function");
+            ImGui::TableSetupColumn("condition");
+            ImGui::TableSetupColumn("reached");
+            ImGui::TableSetupColumn("hits");
+            ImGui::TableHeadersRow();
+
+            for (const Breakpoint &bp : snap.breakpoints)
+            {
+                ImGui::PushID((int)bp.addr);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                if (ImGui::SmallButton("x"))
+                {
+                    SimCommand cmd;
+                    cmd.type = CMD_BREAKPOINT;
+                    cmd.addr = bp.addr;
+                    cmd.value = 0;
+                    scheduler.Post(cmd);
+                }
+
+                char function[96];
+                avrSim.symbols.Format(SYMBOL_FLASH, bp.addr, function, sizeof(function));
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%c 0x%04x", bp.tracepoint ? 'o' : '*', bp.addr);
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(function);
+                ImGui::TableNextColumn();
+                ImGui::Text("%s%s%s", bp.condition.Source().c_str(), bp.log.Empty() ? "" : " log ", bp.log.Source().c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)bp.count);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)bp.hits);
+                ImGui::PopID();
+            }
+            ImGui::EndTable();
+        }
+
+        if (snap.tracepointCount)
+        {
+            ImGui::Text("%llu tracepoint hits, latest first", (unsigned long long)snap.tracepointCount);
+            for (auto it = snap.tracepointHits.rbegin(); it != snap.tracepointHits.rend(); ++it)
+            {
+                char function[96];
+                avrSim.symbols.Format(SYMBOL_FLASH, it->addr, function, sizeof(function));
+                ImGui::TextDisabled("%llu: 0x%04x %s = %d (0x%x)", (unsigned long long)it->cycle, it->addr, function,
+                                    it->value, (unsigned)it->value);
+            }
+        }
+    }
+    ImGui::End();
+}
+
+void ShowAvrWindows(AvrSimulator &avrSim, SimScheduler &scheduler)
+{
+    bool run = ShowAvrDetails(avrSim, scheduler);
+
+    ShowAvrDisasm(avrSim, scheduler);
+
+    ShowAvrDetailsFull(avrSim);
+    DumpAvrRegisters(avrSim);
+
+    HexEditor(avrSim, scheduler, run);
+    HexEditorRAM(avrSim, scheduler);
+
+    ModifyAvrIoRegisters(avrSim, scheduler);
+
+    ShowWatchSignals(avrSim);
+    ShowCallGraph(avrSim, scheduler);
+    ShowCheckpointDiff(avrSim, scheduler);
+    ShowBreakpoints(avrSim, scheduler);
+}
@@ -0,0 +1,25 @@
+#ifndef SIMGETUI_H
+#define SIMGETUI_H
+
+#include "simgetavr.h"
+#include "simgetsched.h"
+
+// ImGui windows for the simulator. No GL in here, the caller owns the
+// context and backend, so these can also be driven by the bench.
+
+void ShowAvrDetailsFull(AvrSimulator &avrSim);
+bool ShowAvrDetails(AvrSimulator &avr, SimScheduler &scheduler);
+bool ShowAvrDisasm(AvrSimulator &avr, SimScheduler &scheduler);
+void DumpAvrRegisters(AvrSimulator &avrSim);
+void HexEditor(AvrSimulator &avrSim, SimScheduler &scheduler, bool run);
+void HexEditorRAM(AvrSimulator &avrSim, SimScheduler &scheduler);
+void ModifyAvrIoRegisters(AvrSimulator &avrSim, SimScheduler &scheduler);
+void ShowWatchSignals(AvrSimulator &avrSim);
+void ShowCallGraph(AvrSimulator &avrSim, SimScheduler &scheduler);
+void ShowCheckpointDiff(AvrSimulator &avrSim, SimScheduler &scheduler);
+void ShowBreakpoints(AvrSimulator &avrSim, SimScheduler &scheduler);
+
+// every simulator window, built from the current snapshot
+void ShowAvrWindows(AvrSimulator &avrSim, SimScheduler &scheduler);
+
+#endif
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <ctype.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unordered_map>
+
+#include "simgetvcd.h"
+
+extern "C" {
+    #include "simavr/sim/avr_ioport.h"
+    #include "simavr/sim/sim_cycle_timers.h"
+}
+
+// whitespace separated tokens from a file read in fixed chunks, captures of
+// several GB never have to fit in memory
+class VcdTokens {
+public:
+    explicit VcdTokens(FILE *file) : file(file), buffer(1 << 18) {}
+
+    bool Next(std::string &token)
+    {
+        token.clear();
+        for (;;)
+        {
+            if (pos == len)
+            {
+                len = fread(buffer.data(), 1, buffer.size(), file);
+                pos = 0;
+                if (!len)
+                    return !token.empty();
+            }
+
+            char c = buffer[pos++];
+            if (isspace((unsigned char)c))
+            {
+                if (!token.empty())
+                    return true;
+            }
+            else
+            {
+                token += c;
+            }
+        }
+    }
+
+    // everything up to the next $end, joined without spaces
+    bool UntilEnd(std::string &text)
+    {
+        std::string token;
+        text.clear();
+        while (Next(token))
+        {
+            if (token == "$end")
+                return true;
+            text += token;
+        }
+        return false;
+    }
+
+private:
+    FILE *file;
+    std::vector<char> buffer;
+    size_t pos = 0, len = 0;
+};
+
+static double TimescaleSeconds(const std::string &text)
+{
+    char *end;
+    double n = strtod(text.c_str(), &end);
+    std::string unit = end;
+
+    if (unit == "s")
+        return n;
+    if (unit == "ms")
+        return n * 1e-3;
+    if (unit == "us")
+        return n * 1e-6;
+    if (unit == "ns")
+        return n * 1e-9;
+    if (unit == "ps")
+        return n * 1e-12;
+    if (unit == "fs")
+        return n * 1e-15;
+    return 0;
+}
+
+// PB3, PORTB3, PORTB[3], PB, PORTB[7:0]. port letter in 'port', bit range low..high
+static bool ParsePinName(const std::string &name, int width, char &port, int &low, int &high)
+{
+    size_t i = name.compare(0, 4, "PORT") == 0 ? 4 : (name.compare(0, 1, "P") == 0 ? 1 : std::string::npos);
+    if (i == std::string::npos || i >= name.size())
+        return false;
+
+    port = (char)toupper((unsigned char)name[i++]);
+    if (port < 'A' || port > 'L')
+        return false;
+
+    std::string rest = name.substr(i);
+    if (rest.empty())
+    {
+        low = 0;
+        high = width - 1;
+    }
+    else if (rest.size() == 1 && rest[0] >= '0' && rest[0] <= '7')
+    {
+        low = high = rest[0] - '0';
+    }
+    else if (sscanf(rest.c_str(), "[%d:%d]", &high, &low) == 2)
+    {
+    }
+    else if (sscanf(rest.c_str(), "[%d]", &low) == 1)
+    {
+        high = low;
+    }
+    else
+    {
+        return false;
+    }
+
+    return low >= 0 && high <= 7 && high - low + 1 == width;
+}
+
+bool VcdStimulus::Load(const std::string &path, uint32_t frequency)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "failed to open " << path << std::endl;
+        return false;
+    }
+
+    events.clear();
+    pins.clear();
+    ignored = 0;
+
+    VcdTokens tokens(file);
+
+    // identifier -> pin index per value bit, lsb first, -1 for bits not driven
+    std::unordered_map<std::string, std::vector<int>> ids;
+    int pinIndex[12][8];
+    std::fill(&pinIndex[0][0], &pinIndex[0][0] + 12 * 8, -1);
+    std::vector<int> lastValue;
+
+    double cyclesPerTick = 1e-9 * frequency;      // vcd default timescale is 1ns
+    uint64_t tick = 0;
+    bool ok = true;
+
+    auto change = [&](const std::vector<int> &bits, const std::string &value) {
+        uint64_t cycle = (uint64_t)(tick * cyclesPerTick + 0.5);
+        char extend = value[0] == 'x' || value[0] == 'z' ? value[0] : '0';
+        for (size_t k = 0; k < bits.size(); k++)
+        {
+            if (bits[k] < 0)
+                continue;
+
+            char c = k < value.size() ? value[value.size() - 1 - k] : extend;
+            // x and z leave the pin where it is
+            if (c != '0' && c != '1')
+                continue;
+
+            int v = c - '0';
+            if (lastValue[bits[k]] == v)
+                continue;
+
+            lastValue[bits[k]] = v;
+            events.push_back({ cycle, (uint16_t)bits[k], (uint8_t)v });
+        }
+    };
+
+    std::string token, text;
+    while (ok && tokens.Next(token))
+    {
+        char c = token[0];
+
+        if (c == '#')
+        {
+            tick = strtoull(token.c_str() + 1, nullptr, 10);
+        }
+        else if (c == '0' || c == '1' || c == 'x' || c == 'X' || c == 'z' || c == 'Z')
+        {
+            auto it = ids.find(token.substr(1));
+            if (it != ids.end())
+                change(it->second, std::string(1, (char)tolower(c)));
+        }
+        else if (c == 'b' || c == 'B')
+        {
+            std::string value = token.substr(1);
+            ok = tokens.Next(token);
+            auto it = ids.find(token);
+            if (ok && it != ids.end())
+            {
+                std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+                change(it->second, value);
+            }
+        }
+        else if (c == 'r' || c == 'R')
+        {
+            ok = tokens.Next(token);
+        }
+        else if (token == "$timescale")
+        {
+            ok = tokens.UntilEnd(text);
+            double seconds = TimescaleSeconds(text);
+            if (seconds <= 0)
+            {
+                std::cerr << path << ": bad $timescale '" << text << "'" << std::endl;
+                fclose(file);
+                return false;
+            }
+            cyclesPerTick = seconds * frequency;
+        }
+        else if (token == "$var")
+        {
+            // type width id reference [range] $end
+            std::string type, width, id;
+            ok = tokens.Next(type) && tokens.Next(width) && tokens.Next(id) && tokens.UntilEnd(text);
+
+            char port;
+            int low, high;
+            if (ok && ParsePinName(text, atoi(width.c_str()), port, low, high))
+            {
+                std::vector<int> &bits = ids[id];
+                for (int bit = low; bit <= high; bit++)
+                {
+                    int &index = pinIndex[port - 'A'][bit];
+                    if (index < 0)
+                    {
+                        index = (int)pins.size();
+                        pins.push_back({ port, (uint8_t)bit, nullptr });
+                        lastValue.push_back(-1);
+                    }
+                    bits.push_back(index);
+                }
+            }
+            else if (ok)
+            {
+                ignored++;
+            }
+        }
+        else if (token == "$dumpvars" || token == "$dumpall" || token == "$dumpon" ||
+                 token == "$dumpoff" || token == "$end")
+        {
+            // the changes inside are ordinary value changes
+        }
+        else if (c == '$')
+        {
+            // $scope, $comment, $date, $version, $enddefinitions ...
+            ok = tokens.UntilEnd(text);
+        }
+    }
+
+    fclose(file);
+
+    if (!ok)
+    {
+        std::cerr << path << ": truncated" << std::endl;
+        return false;
+    }
+
+    // a well formed vcd is already in time order
+    if (!std::is_sorted(events.begin(), events.end(),
+                        [](const StimulusEvent &a, const StimulusEvent &b) { return a.cycle < b.cycle; }))
+    {
+        std::stable_sort(events.begin(), events.end(),
+                         [](const StimulusEvent &a, const StimulusEvent &b) { return a.cycle < b.cycle; });
+    }
+    events.shrink_to_fit();
+
+    return true;
+}
+
+void VcdStimulus::Attach(avr_t *avr)
+{
+    for (StimulusPin &pin : pins)
+    {
+        pin.irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(pin.port), pin.bit);
+        if (!pin.irq)
+            std::cerr << "stimulus: " << avr->mmcu << " has no pin P" << pin.port << (int)pin.bit << std::endl;
+    }
+
+    Arm(avr);
+}
+
+void VcdStimulus::Arm(avr_t *avr)
+{
+    avr_cycle_timer_cancel(avr, Fire, this);
+
+    next = std::lower_bound(events.begin(), events.end(), avr->cycle,
+                            [](const StimulusEvent &e, uint64_t cycle) { return e.cycle < cycle; }) - events.begin();
+
+    if (next < events.size())
+        avr_cycle_timer_register(avr, events[next].cycle - avr->cycle, Fire, this);
+}
+
+avr_cycle_count_t VcdStimulus::Fire(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    VcdStimulus *s = (VcdStimulus *)param;
+    const std::vector<StimulusEvent> &events = s->events;
+
+    // a restored checkpoint brings this timer back with an older 'when'
+    size_t i = s->next;
+    if (i >= events.size() || events[i].cycle != when)
+    {
+        i = std::lower_bound(events.begin(), events.end(), when,
+                             [](const StimulusEvent &e, uint64_t cycle) { return e.cycle < cycle; }) - events.begin();
+    }
+
+    for (; i < events.size() && events[i].cycle <= when; i++)
+    {
+        avr_irq_t *irq = s->pins[events[i].pin].irq;
+        if (irq)
+            avr_raise_irq(irq, events[i].value);
+    }
+
+    s->next = i;
+    return i < events.size() ? events[i].cycle : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef SIMGETVCD_H
+#define SIMGETVCD_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "sim_avr.h"
+
+// one pin change, already converted to cycles
+struct StimulusEvent {
+    uint64_t cycle;
+    uint16_t pin;           // index into the pin table
+    uint8_t value;
+};
+
+struct StimulusPin {
+    char port;
+    uint8_t bit;
+    avr_irq_t *irq;         // resolved on Attach, null if the core has no such pin
+};
+
+// a VCD capture driven back into the port pins. the file is parsed once, streamed in
+// chunks, into one time sorted event array. replay is a single cycle timer that only
+// ever waits for the next event, so there is nothing to check per instruction.
+class VcdStimulus {
+public:
+    // pins are matched by reference name: PB3, PORTB3, PORTB [3], or a PB / PORTB
+    // vector for the whole port. other signals are counted and ignored.
+    bool Load(const std::string &path, uint32_t frequency);
+
+    // resolves the pin irqs and arms the timer from the current cycle.
+    // called from Initialize, before the power on state is saved.
+    void Attach(avr_t *avr);
+
+    // re-arm from avr->cycle, after avr_reset cleared the cycle timers
+    void Arm(avr_t *avr);
+
+    size_t Events() const { return events.size(); }
+    size_t Pins() const { return pins.size(); }
+    size_t Ignored() const { return ignored; }
+
+private:
+    static avr_cycle_count_t Fire(avr_t *avr, avr_cycle_count_t when, void *param);
+
+    std::vector<StimulusEvent> events;
+    std::vector<StimulusPin> pins;
+    size_t next = 0;                    // first event not fired yet
+    size_t ignored = 0;
+};
+
+#endif // SIMGETVCD_H
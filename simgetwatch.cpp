@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+
+#include "simgetwatch.h"
+
+// most recent watchpoint hits kept for the UI and the command line
+static const size_t maxHits = 256;
+
+// addressing modes of the data access instructions
+enum {
+    MODE_NONE,
+    MODE_X,         // ld/st X, X+
+    MODE_X_DEC,     // -X
+    MODE_Y,         // Y+, ldd/std Y+q
+    MODE_Y_DEC,
+    MODE_Z,
+    MODE_Z_DEC,
+    MODE_DIRECT,    // lds/sts, address in the next word
+    MODE_IO,        // in/out/sbi/cbi/sbic/sbis, data address in arg
+    MODE_PUSH,      // SP
+    MODE_POP,       // SP + 1
+    MODE_CALL,      // return address pushed below SP
+    MODE_RET,       // return address popped above SP
+};
+
+DataWatch::AccessOp DataWatch::Compile(uint16_t o)
+{
+    const uint8_t R = ACCESS_READ, W = ACCESS_WRITE;
+
+    // ldd/std Y+q, Z+q, q = 0 is plain ld/st Y, Z
+    if ((o & 0xd000) == 0x8000)
+    {
+        uint8_t q = ((o >> 8) & 0x20) | ((o >> 7) & 0x18) | (o & 7);
+        return { (uint8_t)(o & 8 ? MODE_Y : MODE_Z), (uint8_t)(o & 0x200 ? W : R), q, 0 };
+    }
+
+    if ((o & 0xfc00) == 0x9000)
+    {
+        uint8_t f = o & 0x200 ? W : R;
+        switch (o & 0xf)
+        {
+        case 0x0: return { MODE_DIRECT, f, 0, 0 };
+        case 0x1: return { MODE_Z, f, 0, 0 };
+        case 0x2: return { MODE_Z_DEC, f, 0, 0 };
+        case 0x9: return { MODE_Y, f, 0, 0 };
+        case 0xa: return { MODE_Y_DEC, f, 0, 0 };
+        case 0xc:
+        case 0xd: return { MODE_X, f, 0, 0 };
+        case 0xe: return { MODE_X_DEC, f, 0, 0 };
+        case 0xf: return { (uint8_t)(f == W ? MODE_PUSH : MODE_POP), f, 0, 0 };
+        case 0x4:
+        case 0x5:
+        case 0x6:
+        case 0x7:
+            // xch/las/lac/lat on Z, the 0x90 side is lpm/elpm
+            if (f == W)
+                return { MODE_Z, (uint8_t)(R | W), 0, 0 };
+            break;
+        }
+        return { MODE_NONE, 0, 0, 0 };
+    }
+
+    if ((o & 0xfe0e) == 0x940e || (o & 0xf000) == 0xd000 || o == 0x9509 || o == 0x9519)
+        return { MODE_CALL, W, 0, 0 };
+    if (o == 0x9508 || o == 0x9518)
+        return { MODE_RET, R, 0, 0 };
+
+    // in/out
+    if ((o & 0xf000) == 0xb000)
+        return { MODE_IO, (uint8_t)(o & 0x800 ? W : R), (uint8_t)(0x20 + (((o >> 5) & 0x30) | (o & 0xf))), 0 };
+
+    // cbi/sbic/sbi/sbis
+    if ((o & 0xfc00) == 0x9800)
+    {
+        uint8_t f = o & 0x100 ? R : (uint8_t)(R | W);
+        return { MODE_IO, f, (uint8_t)(0x20 + ((o >> 3) & 0x1f)), 0 };
+    }
+
+    return { MODE_NONE, 0, 0, 0 };
+}
+
+void DataWatch::CompileAll()
+{
+    ops.resize((avr->flashend + 1) / 2);
+    for (size_t i = 0; i < ops.size(); i++)
+        ops[i] = Compile(avr->flash[i * 2] | (avr->flash[i * 2 + 1] << 8));
+}
+
+// the tables are only built once something is watched
+void DataWatch::Prepare()
+{
+    if (!ops.empty())
+        return;
+
+    CompileAll();
+    flags.assign(avr->ramend + 1, 0);
+    first.assign(avr->ramend + 1, -1);
+}
+
+void DataWatch::Attach(avr_t *avr)
+{
+    this->avr = avr;
+    ops.clear();
+    flags.clear();
+    first.clear();
+    signals.clear();
+    watchpoints.clear();
+    hits.clear();
+    hitCount = 0;
+    triggered = false;
+    armed = 0;
+    hit = false;
+}
+
+void DataWatch::Invalidate(uint32_t addr)
+{
+    size_t word = addr / 2;
+    if (word < ops.size())
+        ops[word] = Compile(avr->flash[word * 2] | (avr->flash[word * 2 + 1] << 8));
+}
+
+bool DataWatch::Access(const avr_t *avr, avr_flashaddr_t pc, DataAccess &a) const
+{
+    size_t word = pc / 2;
+    if (word >= ops.size())
+        return false;
+
+    const AccessOp op = ops[word];
+    const uint8_t *d = avr->data;
+    const uint16_t sp = d[R_SPL] | (d[R_SPH] << 8);
+
+    a.size = 1;
+    a.flags = op.flags;
+
+    switch (op.mode)
+    {
+    case MODE_NONE:
+        return false;
+    case MODE_X:
+        a.addr = d[R_XL] | (d[R_XH] << 8);
+        break;
+    case MODE_X_DEC:
+        a.addr = (d[R_XL] | (d[R_XH] << 8)) - 1;
+        break;
+    case MODE_Y:
+        a.addr = (d[R_YL] | (d[R_YH] << 8)) + op.arg;
+        break;
+    case MODE_Y_DEC:
+        a.addr = (d[R_YL] | (d[R_YH] << 8)) - 1;
+        break;
+    case MODE_Z:
+        a.addr = (d[R_ZL] | (d[R_ZH] << 8)) + op.arg;
+        break;
+    case MODE_Z_DEC:
+        a.addr = (d[R_ZL] | (d[R_ZH] << 8)) - 1;
+        break;
+    case MODE_DIRECT:
+        if (pc + 3 > avr->flashend)
+            return false;
+        a.addr = avr->flash[pc + 2] | (avr->flash[pc + 3] << 8);
+        break;
+    case MODE_IO:
+        a.addr = op.arg;
+        break;
+    case MODE_PUSH:
+        a.addr = sp;
+        break;
+    case MODE_POP:
+        a.addr = sp + 1;
+        break;
+    case MODE_CALL:
+        a.size = avr->address_size;
+        a.addr = sp - a.size + 1;
+        break;
+    case MODE_RET:
+        a.size = avr->address_size;
+        a.addr = sp + 1;
+        break;
+    }
+    return true;
+}
+
+bool DataWatch::AddSignal(const std::string &spec)
+{
+    size_t eq = spec.find('=');
+    size_t at = spec.find('@', eq == std::string::npos ? 0 : eq);
+    if (eq == std::string::npos || eq == 0 || at == std::string::npos)
+    {
+        std::cerr << "--add-trace: expected name=kind@addr/mask, got '" << spec << "'\n";
+        return false;
+    }
+
+    std::string name = spec.substr(0, eq);
+    std::string kind = spec.substr(eq + 1, at - eq - 1);
+
+    char *end;
+    unsigned long addr = strtoul(spec.c_str() + at + 1, &end, 0);
+    unsigned long mask = 0xff;
+    if (*end == '/')
+        mask = strtoul(end + 1, &end, 0);
+
+    if (*end || mask == 0 || mask > 0xff)
+    {
+        std::cerr << "--add-trace: bad address or mask in '" << spec << "'\n";
+        return false;
+    }
+
+    // r0..r31 never go through the data bus
+    if (addr < 32 || addr > avr->ramend)
+    {
+        std::cerr << "--add-trace: 0x" << std::hex << addr << std::dec << " is not an io or sram address\n";
+        return false;
+    }
+
+    if (kind != "trace" && kind != "portpin")
+    {
+        std::cerr << "--add-trace: unknown kind '" << kind << "', use trace or portpin\n";
+        return false;
+    }
+
+    Prepare();
+
+    auto add = [&](const std::string &wire, uint8_t wireMask) {
+        WatchSignal s;
+        s.name = wire;
+        s.addr = (uint16_t)addr;
+        s.mask = wireMask;
+        s.shift = (uint8_t)__builtin_ctz(wireMask);
+        s.width = (uint8_t)(32 - __builtin_clz(wireMask) - s.shift);
+        s.last = (avr->data[addr] & wireMask) >> s.shift;
+        s.next = first[addr];
+        s.changes = 0;
+
+        first[addr] = (int)signals.size();
+        flags[addr] |= WATCH_SIGNAL;
+        signals.push_back(s);
+        armed++;
+    };
+
+    if (kind == "trace")
+    {
+        add(name, (uint8_t)mask);
+    }
+    else
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (mask & (1 << bit))
+                add(name + (char)('0' + bit), (uint8_t)(1 << bit));
+        }
+    }
+
+    return true;
+}
+
+int DataWatch::SetWatchpoint(uint16_t addr, uint16_t size, uint8_t kind, uint8_t value, uint8_t mask)
+{
+    kind &= WATCH_POINTS;
+
+    // r0..r31 never go through the data bus
+    if (!kind || !size || addr < 32 || (uint32_t)addr + size - 1 > avr->ramend)
+        return -1;
+
+    Prepare();
+    watchpoints.push_back({ addr, size, kind, (uint8_t)(value & mask), mask, 0 });
+    for (uint32_t a = addr; a < (uint32_t)addr + size; a++)
+        flags[a] |= kind;
+    armed++;
+
+    return (int)watchpoints.size() - 1;
+}
+
+bool DataWatch::RemoveWatchpoint(uint16_t addr)
+{
+    const size_t count = watchpoints.size();
+    watchpoints.erase(std::remove_if(watchpoints.begin(), watchpoints.end(),
+                                     [addr](const Watchpoint &w) { return w.addr == addr; }),
+                      watchpoints.end());
+    if (watchpoints.size() == count)
+        return false;
+
+    armed -= count - watchpoints.size();
+
+    // ranges may overlap, put the flags of the remaining ones back
+    for (uint8_t &f : flags)
+        f &= ~WATCH_POINTS;
+    for (const Watchpoint &w : watchpoints)
+    {
+        for (uint32_t a = w.addr; a < (uint32_t)w.addr + w.size; a++)
+            flags[a] |= w.flags;
+    }
+    return true;
+}
+
+bool DataWatch::AddWatchpoint(const std::string &spec, const SymbolIndex &symbols)
+{
+    size_t at = spec.find('@');
+    if (at == std::string::npos || at == 0)
+    {
+        std::cerr << "--watch: expected kind@addr[:size][=value[/mask]], got '" << spec << "'\n";
+        return false;
+    }
+
+    std::string kind = spec.substr(0, at);
+    uint8_t f = kind == "read"    ? WATCH_READ
+                : kind == "write" ? WATCH_WRITE
+                : kind == "rw"    ? WATCH_READ | WATCH_WRITE
+                : kind == "value" ? WATCH_VALUE
+                                  : 0;
+    if (!f)
+    {
+        std::cerr << "--watch: unknown kind '" << kind << "', use read, write, rw or value\n";
+        return false;
+    }
+
+    size_t end = spec.find_first_of(":=", at + 1);
+    std::string target = spec.substr(at + 1, end == std::string::npos ? std::string::npos : end - at - 1);
+
+    // a number, or a data symbol covering all of its object
+    char *rest;
+    unsigned long addr = strtoul(target.c_str(), &rest, 0);
+    unsigned long size = 1;
+    if (target.empty() || *rest)
+    {
+        const Symbol *s = symbols.Lookup(target, SYMBOL_DATA);
+        if (!s)
+        {
+            std::cerr << "--watch: no data symbol '" << target << "'\n";
+            return false;
+        }
+        addr = s->addr;
+        size = s->size;
+    }
+
+    const char *p = spec.c_str() + (end == std::string::npos ? spec.size() : end);
+    if (*p == ':')
+    {
+        size = strtoul(p + 1, &rest, 0);
+        p = rest;
+    }
+
+    unsigned long value = 0, mask = 0xff;
+    bool match = false;
+    if (*p == '=')
+    {
+        match = true;
+        value = strtoul(p + 1, &rest, 0);
+        p = rest;
+        if (*p == '/')
+        {
+            mask = strtoul(p + 1, &rest, 0);
+            p = rest;
+        }
+    }
+
+    if (*p || size == 0 || size > 0xffff || value > 0xff || mask == 0 || mask > 0xff || match != (f == WATCH_VALUE))
+    {
+        std::cerr << "--watch: bad size, value or mask in '" << spec << "', only value takes =value\n";
+        return false;
+    }
+
+    if (addr > 0xffff || SetWatchpoint((uint16_t)addr, (uint16_t)size, f, (uint8_t)value, (uint8_t)mask) < 0)
+    {
+        std::cerr << "--watch: 0x" << std::hex << addr << std::dec << "+" << size << " is not io or sram\n";
+        return false;
+    }
+    return true;
+}
+
+void DataWatch::Check(avr_t *avr, avr_cycle_count_t cycle)
+{
+    for (int i = 0; i < pending.size; i++)
+    {
+        const size_t addr = (size_t)pending.addr + i;
+        if (addr >= flags.size() || !(flags[addr] & WATCH_POINTS))
+            continue;
+
+        const uint8_t after = avr->data[addr];
+        for (Watchpoint &w : watchpoints)
+        {
+            if (addr < w.addr || addr >= (size_t)w.addr + w.size)
+                continue;
+
+            uint8_t match = 0;
+            if (pending.flags & ACCESS_READ)
+                match |= w.flags & WATCH_READ;
+            if (pending.flags & ACCESS_WRITE)
+            {
+                match |= w.flags & WATCH_WRITE;
+                if ((w.flags & WATCH_VALUE) && (after & w.mask) == w.value)
+                    match |= WATCH_VALUE;
+            }
+            if (!match)
+                continue;
+
+            w.hits++;
+            hitCount++;
+            triggered = true;
+            hits.push_back({ pendingPc, cycle, (uint16_t)addr, match, before[i], after });
+            if (hits.size() > maxHits)
+                hits.pop_front();
+        }
+    }
+}
+
+void DataWatch::Changed(avr_t *avr, avr_cycle_count_t cycle)
+{
+    hit = false;
+    if (!watchpoints.empty() && !quiet)
+        Check(avr, cycle);
+
+    if (!(pending.flags & ACCESS_WRITE))
+        return;
+
+    for (int i = 0; i < pending.size; i++)
+    {
+        size_t addr = (size_t)pending.addr + i;
+        if (addr >= flags.size() || !(flags[addr] & WATCH_SIGNAL))
+            continue;
+
+        for (int s = first[addr]; s >= 0; s = signals[s].next)
+        {
+            WatchSignal &signal = signals[s];
+            uint8_t value = (avr->data[addr] & signal.mask) >> signal.shift;
+            if (value == signal.last)
+                continue;
+
+            signal.last = value;
+            signal.changes++;
+            if (onChange)
+                onChange(s, signal, cycle);
+        }
+    }
+}
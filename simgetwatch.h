@@ -0,0 +1,170 @@
+#ifndef SIMGETWATCH_H
+#define SIMGETWATCH_H
+
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "sim_avr.h"
+#include "simgetsymbols.h"
+
+// data space access of one instruction, worked out before it runs
+struct DataAccess {
+    uint16_t addr;
+    uint8_t size;       // bytes from addr, 2-3 for call/ret
+    uint8_t flags;      // ACCESS_READ / ACCESS_WRITE
+};
+
+enum {
+    ACCESS_READ = 1,
+    ACCESS_WRITE = 2,
+};
+
+// per data address flags
+enum {
+    WATCH_SIGNAL = 1,   // one or more WatchSignals on this byte
+    WATCH_READ = 2,     // watchpoints stop on a read
+    WATCH_WRITE = 4,    // on a write
+    WATCH_VALUE = 8,    // on a write leaving their value
+    WATCH_POINTS = WATCH_READ | WATCH_WRITE | WATCH_VALUE,
+};
+
+// stops the sim thread after an instruction accessing [addr, addr + size)
+struct Watchpoint {
+    uint16_t addr;
+    uint16_t size;
+    uint8_t flags;          // WATCH_READ / WATCH_WRITE / WATCH_VALUE
+    uint8_t value;          // WATCH_VALUE, a write leaving (byte & mask) == value
+    uint8_t mask;
+    uint64_t hits;
+};
+
+// one watchpoint hit, per byte
+struct WatchHit {
+    avr_flashaddr_t pc;         // the instruction that made the access
+    avr_cycle_count_t cycle;    // when it started
+    uint16_t addr;
+    uint8_t flags;              // what matched, WATCH_READ / WATCH_WRITE / WATCH_VALUE
+    uint8_t before;
+    uint8_t after;
+};
+
+// a named, masked view of one data byte, --add-trace name=kind@addr/mask
+struct WatchSignal {
+    std::string name;
+    uint16_t addr;
+    uint8_t mask;
+    uint8_t shift;
+    uint8_t width;
+    uint8_t last;           // masked, shifted value as of the last change
+    int next;               // next signal on the same address, -1
+    uint64_t changes;
+};
+
+// watches on data space addresses. every flash word is compiled once into the
+// addressing mode of its data access (ld/st/push/call/in/out/sbi ...), so while
+// anything is armed an instruction costs a table lookup, the effective address and
+// one flag byte test. with nothing armed the sim thread doesn't look at it at all.
+//
+// watchpoints share the flag table, an instruction touching a watched byte stops the
+// sim thread once it has run, with the pc, old and new value of the byte recorded.
+//
+// writes the cpu doesn't make with an instruction (interrupt entry pushing the pc,
+// peripherals updating their registers) are not seen, neither are r0..r31.
+class DataWatch {
+public:
+    // sizes the tables for this core, forgets every watch
+    void Attach(avr_t *avr);
+
+    // simavr style "name=kind@addr/mask", kind trace (masked value as a vector) or
+    // portpin (one wire per mask bit). adds one WatchSignal per wire, returns false
+    // with a message on a bad spec
+    bool AddSignal(const std::string &spec);
+    const std::vector<WatchSignal> &Signals() const { return signals; }
+
+    // sim thread, called with the index of a signal whose value changed, signal.last is the new value
+    std::function<void(int index, const WatchSignal &signal, avr_cycle_count_t cycle)> onChange;
+
+    // from the UI or the command line, returns the index or -1 outside io/sram
+    int SetWatchpoint(uint16_t addr, uint16_t size, uint8_t kind, uint8_t value = 0, uint8_t mask = 0xff);
+    // removes every watchpoint starting at addr
+    bool RemoveWatchpoint(uint16_t addr);
+    // "kind@addr[:size][=value[/mask]]", kind read, write, rw or value, addr a number or a
+    // data symbol (its size unless one is given). false with a message on a bad spec
+    bool AddWatchpoint(const std::string &spec, const SymbolIndex &symbols);
+    const std::vector<Watchpoint> &Watchpoints() const { return watchpoints; }
+
+    std::deque<WatchHit> hits;      // most recent last, capped
+    uint64_t hitCount = 0;
+    bool triggered = false;         // a watchpoint hit since the owner last cleared it
+    bool quiet = false;             // re-executing known history, hits are not recorded again
+
+    // flash was written, recompile the word at this byte address
+    void Invalidate(uint32_t addr);
+
+    // the data access of the instruction at pc, false if it has none
+    bool Access(const avr_t *avr, avr_flashaddr_t pc, DataAccess &access) const;
+
+    // sim thread, around avr_run while armed
+    void Before(avr_t *avr)
+    {
+        DataAccess a;
+        hit = Access(avr, avr->pc, a) && Flagged(a);
+        if (hit) {
+            pending = a;
+            pendingPc = avr->pc;
+            for (int i = 0; i < a.size && (size_t)a.addr + i < flags.size(); i++) {
+                before[i] = avr->data[a.addr + i];
+            }
+        }
+    }
+    void After(avr_t *avr, avr_cycle_count_t cycle)
+    {
+        if (hit) {
+            Changed(avr, cycle);
+        }
+    }
+
+    uint32_t armed = 0;             // signals and watchpoints set, the sim thread skips all of this at 0
+
+private:
+    struct AccessOp {
+        uint8_t mode;
+        uint8_t flags;
+        uint8_t arg;                // displacement or io data address
+        uint8_t reserved;
+    };
+
+    static AccessOp Compile(uint16_t opcode);
+    void CompileAll();
+    void Prepare();
+    void Check(avr_t *avr, avr_cycle_count_t cycle);
+
+    bool Flagged(const DataAccess &a) const
+    {
+        for (int i = 0; i < a.size; i++) {
+            if ((size_t)a.addr + i < flags.size() && flags[a.addr + i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Changed(avr_t *avr, avr_cycle_count_t cycle);
+
+    avr_t *avr = nullptr;
+    std::vector<AccessOp> ops;          // per flash word
+    std::vector<uint8_t> flags;         // per data address
+    std::vector<int> first;             // per data address, first WatchSignal or -1
+    std::vector<WatchSignal> signals;
+    std::vector<Watchpoint> watchpoints;
+
+    bool hit = false;
+    DataAccess pending;
+    avr_flashaddr_t pendingPc = 0;
+    uint8_t before[4];
+};
+
+#endif // SIMGETWATCH_H
@@ -0,0 +1,273 @@
+#include <chrono>
+#include <iostream>
+
+#include "simgetwave.h"
+
+extern "C" {
+    #include "simavr/sim/avr_ioport.h"
+}
+
+// compact layout, all integers little endian or LEB128 varints:
+//
+//   "SGWAVE1\n"
+//   u32 frequency, varint signal count
+//   per signal: varint width, varint name length, name bytes, varint value at the start
+//   per event:  varint cycle delta, varint signal, varint value
+//
+// about 4 bytes an event against ~20 for vcd, and no number formatting on the way out.
+static const char compactMagic[] = "SGWAVE1\n";
+
+// write in big pieces, the ring absorbs the bursts in between
+static const size_t flushBytes = 1 << 20;
+
+WaveWriter::WaveWriter()
+    : ring(new SpscQueue<WaveEvent, 1 << 16>())
+{
+}
+
+WaveWriter::~WaveWriter()
+{
+    Stop();
+}
+
+uint32_t WaveWriter::AddSignal(const std::string &name, int width, uint32_t initial)
+{
+    // vcd identifiers are printable ascii strings, base 94 from '!'
+    uint32_t index = (uint32_t)signals.size();
+    std::string id;
+    uint32_t n = index;
+    do
+    {
+        id += (char)('!' + n % 94);
+        n /= 94;
+    } while (n);
+
+    signals.push_back({ name, width, id, initial });
+    return index;
+}
+
+void WaveWriter::AddProbe(avr_t *avr, avr_irq_t *irq, uint32_t signal, uint32_t mask, int shift)
+{
+    probes.emplace_back(new Probe{ this, avr, irq, signal, mask, shift, (irq->value & mask) >> shift });
+    avr_irq_register_notify(irq, OnIrq, probes.back().get());
+}
+
+void WaveWriter::AddPortPins(avr_t *avr)
+{
+    for (char port = 'A'; port <= 'L'; port++)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            avr_irq_t *irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit);
+            if (!irq)
+                continue;
+
+            char name[4] = { 'P', port, (char)('0' + bit), 0 };
+            AddProbe(avr, irq, AddSignal(name, 1, irq->value & 1), 1, 0);
+        }
+    }
+}
+
+void WaveWriter::OnIrq(avr_irq_t *irq, uint32_t value, void *param)
+{
+    Probe *p = (Probe *)param;
+    uint32_t v = (value & p->mask) >> p->shift;
+
+    if (v == p->last)
+        return;
+
+    p->last = v;
+    p->writer->Record(p->avr->cycle, p->signal, v);
+}
+
+void WaveWriter::Record(uint64_t cycle, uint32_t signal, uint32_t value)
+{
+    if (ring->Push({ cycle, signal, value }))
+        recorded.fetch_add(1, std::memory_order_relaxed);
+    else
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool WaveWriter::Start(const std::string &path, WaveFormat format, uint32_t frequency)
+{
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "failed to open " << path << " for writing\n";
+        return false;
+    }
+
+    this->format = format;
+    this->frequency = frequency ? frequency : 1;
+    buffer.reserve(flushBytes + 4096);
+
+    WriteHeader();
+
+    running = true;
+    thread = std::thread(&WaveWriter::WriterThread, this);
+    return true;
+}
+
+void WaveWriter::Stop()
+{
+    for (auto &p : probes)
+        avr_irq_unregister_notify(p->irq, OnIrq, p.get());
+    probes.clear();
+
+    if (!file)
+        return;
+
+    running = false;
+    if (thread.joinable())
+        thread.join();
+
+    fclose(file);
+    file = nullptr;
+}
+
+static void PutVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+void WaveWriter::WriteHeader()
+{
+    // the sim thread isn't running yet, the probes hold the levels everything starts from
+    for (auto &p : probes)
+        signals[p->signal].initial = p->last;
+
+    if (format == WAVE_COMPACT)
+    {
+        buffer.append(compactMagic, sizeof(compactMagic) - 1);
+        for (int i = 0; i < 4; i++)
+            buffer += (char)(frequency >> (i * 8));
+
+        PutVarint(buffer, signals.size());
+        for (const Signal &s : signals)
+        {
+            PutVarint(buffer, s.width);
+            PutVarint(buffer, s.name.size());
+            buffer += s.name;
+            PutVarint(buffer, s.initial);
+        }
+        return;
+    }
+
+    buffer += "$comment simget ";
+    buffer += std::to_string(frequency);
+    buffer += " Hz $end\n$timescale 1ps $end\n$scope module simget $end\n";
+    for (const Signal &s : signals)
+    {
+        buffer += "$var wire " + std::to_string(s.width) + " " + s.id + " " + s.name + " $end\n";
+    }
+    buffer += "$upscope $end\n$enddefinitions $end\n$dumpvars\n";
+    for (const Signal &s : signals)
+        WriteValue(s, s.initial);
+    buffer += "$end\n";
+}
+
+void WaveWriter::WriteEvent(const WaveEvent &ev)
+{
+    // a reset, restore or reverse seek takes the clock back, vcd time must not go backwards
+    if (wroteTime && ev.cycle < lastCycle)
+    {
+        stale++;
+        return;
+    }
+
+    if (format == WAVE_COMPACT)
+    {
+        PutVarint(buffer, ev.cycle - lastCycle);
+        PutVarint(buffer, ev.signal);
+        PutVarint(buffer, ev.value);
+        lastCycle = ev.cycle;
+        wroteTime = true;
+        return;
+    }
+
+    if (!wroteTime || ev.cycle != lastCycle)
+    {
+        // whole seconds exactly, the remainder in double so big cycle counts can't overflow
+        uint64_t ps = ev.cycle / frequency * 1000000000000ull +
+                      (uint64_t)((double)(ev.cycle % frequency) * 1e12 / frequency + 0.5);
+        buffer += '#';
+        buffer += std::to_string(ps);
+        buffer += '\n';
+        lastCycle = ev.cycle;
+        wroteTime = true;
+    }
+
+    WriteValue(signals[ev.signal], ev.value);
+}
+
+void WaveWriter::WriteValue(const Signal &s, uint32_t value)
+{
+    if (s.width == 1)
+    {
+        buffer += (char)('0' + (value & 1));
+    }
+    else
+    {
+        char bits[33];
+        int n = 0;
+        for (int bit = s.width - 1; bit >= 0; bit--)
+            bits[n++] = (char)('0' + ((value >> bit) & 1));
+        buffer += 'b';
+        buffer.append(bits, n);
+        buffer += ' ';
+    }
+    buffer += s.id;
+    buffer += '\n';
+}
+
+void WaveWriter::Flush()
+{
+    if (!buffer.empty())
+    {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+}
+
+void WaveWriter::WriterThread()
+{
+    auto lastFlush = std::chrono::steady_clock::now();
+    WaveEvent ev;
+
+    for (;;)
+    {
+        // read the flag first so nothing pushed before Stop is left behind
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        while (ring->Pop(ev))
+        {
+            WriteEvent(ev);
+            if (buffer.size() >= flushBytes)
+            {
+                Flush();
+                lastFlush = std::chrono::steady_clock::now();
+            }
+        }
+
+        if (stopping)
+            break;
+
+        // keep the file tailable while the sim is idle or slow
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastFlush > std::chrono::milliseconds(250))
+        {
+            Flush();
+            fflush(file);
+            lastFlush = now;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    Flush();
+}
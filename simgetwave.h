@@ -0,0 +1,105 @@
+#ifndef SIMGETWAVE_H
+#define SIMGETWAVE_H
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sim_avr.h"
+#include "simgetcommand.h"
+
+enum WaveFormat {
+    WAVE_VCD,       // text, opens in gtkwave / pulseview
+    WAVE_COMPACT,   // varint records, see simgetwave.cpp for the layout
+};
+
+// one transition, cycle stamped on the sim thread
+struct WaveEvent {
+    uint64_t cycle;
+    uint32_t signal;
+    uint32_t value;
+};
+
+// records pin transitions from irq callbacks and --add-trace values on the sim thread into
+// a lock free ring, a background thread formats and writes them in large chunks.
+// a full ring drops the event and counts it, the sim thread never waits on the disk.
+class WaveWriter {
+public:
+    WaveWriter();
+    ~WaveWriter();
+
+    // every port pin the core has, PA0..PL7
+    void AddPortPins(avr_t *avr);
+
+    // any other signal, 'initial' as of Start, later values come in through Record. returns its id
+    uint32_t AddSignal(const std::string &name, int width, uint32_t initial);
+
+    // sim thread, never blocks
+    void Record(uint64_t cycle, uint32_t signal, uint32_t value);
+
+    // signals must all be added before Start
+    bool Start(const std::string &path, WaveFormat format, uint32_t frequency);
+
+    // drains the ring, flushes and closes the file. the sim thread must be stopped.
+    void Stop();
+
+    bool Active() const { return file != nullptr; }
+
+    uint64_t Recorded() const { return recorded.load(std::memory_order_relaxed); }
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+    // events behind the last written time, after a reset, restore or reverse seek
+    uint64_t Stale() const { return stale; }
+
+private:
+    struct Signal {
+        std::string name;
+        int width;
+        std::string id;     // vcd identifier
+        uint32_t initial;   // what the header dumps
+    };
+
+    struct Probe {
+        WaveWriter *writer;
+        avr_t *avr;
+        avr_irq_t *irq;
+        uint32_t signal;
+        uint32_t mask;
+        int shift;
+        uint32_t last;
+    };
+
+    static void OnIrq(avr_irq_t *irq, uint32_t value, void *param);
+
+    void AddProbe(avr_t *avr, avr_irq_t *irq, uint32_t signal, uint32_t mask, int shift);
+
+    void WriterThread();
+    void WriteHeader();
+    void WriteEvent(const WaveEvent &ev);
+    void WriteValue(const Signal &s, uint32_t value);
+    void Flush();
+
+    std::vector<Signal> signals;
+    std::vector<std::unique_ptr<Probe>> probes;
+
+    // 64k events, 1MB
+    std::unique_ptr<SpscQueue<WaveEvent, 1 << 16>> ring;
+    std::atomic<uint64_t> recorded{0};
+    std::atomic<uint64_t> dropped{0};
+
+    // writer thread only
+    FILE *file = nullptr;
+    WaveFormat format = WAVE_VCD;
+    uint32_t frequency = 1000000;
+    std::string buffer;
+    uint64_t lastCycle = 0;
+    bool wroteTime = false;
+    uint64_t stale = 0;
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+};
+
+#endif // SIMGETWAVE_H